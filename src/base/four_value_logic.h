@@ -1,6 +1,8 @@
 #ifndef SIGNAL_CONTENT_BASE_FOUR_VALUE_LOGIC_H_
 #define SIGNAL_CONTENT_BASE_FOUR_VALUE_LOGIC_H_
 
+#include <vector>
+
 namespace signal_content {
 namespace base {
   enum class FourValueLogic : char {
@@ -28,14 +30,11 @@ namespace base {
     }
   }
 
-  // Assumes vector starts with highest-order bit.
-  inline unsigned int FVLtoUInt(std::vector<FourValueLogic> word) {
-    int val = 0;
+  // Assumes vector starts with highest-order bit. X and Z are read as zero.
+  inline unsigned int FVLtoUInt(const std::vector<FourValueLogic>& word) {
+    unsigned int val = 0;
     for (FourValueLogic bit : word) {
-      val = val << 1;
-      if (bit == FourValueLogic::ONE) {
-        ++val;
-      }
+      val = (val << 1) | (bit == FourValueLogic::ONE);
     }
     return val;
   }
@@ -0,0 +1,364 @@
+/*
+ * four_value_simd.h
+ *
+ * Vectorized kernels for four-value logic in bit-plane form.
+ *
+ * The bit-plane encoding is the one used by PackedFv: a value plane holding
+ * the low bit of each FourValueLogic and an unknown plane holding the high
+ * bit, so ZERO is (0, 0), ONE is (1, 0), X is (0, 1) and Z is (1, 1). Packed
+ * masks are MSB-first: the first value lands in the most significant bit.
+ *
+ * Each kernel has an AVX2 and an SSE2 implementation, selected at compile
+ * time from the target flags, and a scalar fallback.
+ */
+
+#ifndef SIGNAL_CONTENT_BASE_FOUR_VALUE_SIMD_H_
+#define SIGNAL_CONTENT_BASE_FOUR_VALUE_SIMD_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "four_value_logic.h"
+
+namespace signal_content {
+namespace base {
+namespace simd {
+
+typedef uint64_t Word;
+
+// Packing: FourValueLogic bytes to value and unknown masks.
+
+inline void PackFvScalar(const FourValueLogic* values, size_t num_values,
+                         Word* value_mask, Word* unknown_mask) {
+  Word value = 0;
+  Word unknown = 0;
+  for (size_t i = 0; i < num_values; ++i) {
+    const char encoding = static_cast<char>(values[i]);
+    value = (value << 1) | (encoding & 0x1);
+    unknown = (unknown << 1) | ((encoding >> 1) & 0x1);
+  }
+  *value_mask = value;
+  *unknown_mask = unknown;
+}
+
+#ifdef __SSE2__
+// Reverses the byte order of a register, so that movemask puts the first
+// value in the most significant bit.
+inline __m128i ReverseBytes(__m128i x) {
+  x = _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 2, 3));
+  x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+  x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+#endif
+
+// Packs exactly 16 values.
+inline void PackFv16(const FourValueLogic* values, uint16_t* value_mask,
+                     uint16_t* unknown_mask) {
+#ifdef __SSE2__
+  const __m128i bytes = ReverseBytes(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(values)));
+  // Shifting 16-bit lanes moves bit 0 (or 1) of every byte into its bit 7,
+  // where movemask picks it up.
+  *value_mask = static_cast<uint16_t>(
+      _mm_movemask_epi8(_mm_slli_epi16(bytes, 7)));
+  *unknown_mask = static_cast<uint16_t>(
+      _mm_movemask_epi8(_mm_slli_epi16(bytes, 6)));
+#else
+  Word value, unknown;
+  PackFvScalar(values, 16, &value, &unknown);
+  *value_mask = static_cast<uint16_t>(value);
+  *unknown_mask = static_cast<uint16_t>(unknown);
+#endif
+}
+
+// Packs exactly 32 values.
+inline void PackFv32(const FourValueLogic* values, uint32_t* value_mask,
+                     uint32_t* unknown_mask) {
+#ifdef __AVX2__
+  const __m256i reverse = _mm256_setr_epi8(
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values));
+  bytes = _mm256_shuffle_epi8(bytes, reverse);
+  bytes = _mm256_permute2x128_si256(bytes, bytes, 0x01);
+  *value_mask = static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_slli_epi16(bytes, 7)));
+  *unknown_mask = static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_slli_epi16(bytes, 6)));
+#else
+  uint16_t value_hi, value_lo, unknown_hi, unknown_lo;
+  PackFv16(values, &value_hi, &unknown_hi);
+  PackFv16(values + 16, &value_lo, &unknown_lo);
+  *value_mask = (uint32_t(value_hi) << 16) | value_lo;
+  *unknown_mask = (uint32_t(unknown_hi) << 16) | unknown_lo;
+#endif
+}
+
+// Packs up to 64 values into right-aligned masks, as PackedFv::PeekBits
+// returns them. Never reads past values[num_values - 1].
+inline void PackFv(const FourValueLogic* values, size_t num_values,
+                   Word* value_mask, Word* unknown_mask) {
+  Word value = 0;
+  Word unknown = 0;
+  size_t i = 0;
+  for (; i + 32 <= num_values; i += 32) {
+    uint32_t v, u;
+    PackFv32(values + i, &v, &u);
+    value = (value << 16 << 16) | v;
+    unknown = (unknown << 16 << 16) | u;
+  }
+  for (; i + 16 <= num_values; i += 16) {
+    uint16_t v, u;
+    PackFv16(values + i, &v, &u);
+    value = (value << 16) | v;
+    unknown = (unknown << 16) | u;
+  }
+  if (i < num_values) {
+    Word v, u;
+    PackFvScalar(values + i, num_values - i, &v, &u);
+    value = (value << (num_values - i)) | v;
+    unknown = (unknown << (num_values - i)) | u;
+  }
+  *value_mask = value;
+  *unknown_mask = unknown;
+}
+
+// Unpacking: value and unknown masks back to FourValueLogic bytes.
+
+inline void UnpackFvScalar(Word value_mask, Word unknown_mask,
+                           size_t num_values, FourValueLogic* out) {
+  for (size_t i = 0; i < num_values; ++i) {
+    const size_t shift = num_values - 1 - i;
+    out[i] = static_cast<FourValueLogic>(
+        ((value_mask >> shift) & 0x1) | (((unknown_mask >> shift) & 0x1) << 1));
+  }
+}
+
+#ifdef __SSE2__
+// Expands a 16-bit MSB-first mask to one 0x00/0xFF byte per bit.
+inline __m128i ExpandMask16(uint16_t mask) {
+  const __m128i select = _mm_set_epi8(
+      1, 2, 4, 8, 16, 32, 64, (char)128, 1, 2, 4, 8, 16, 32, 64, (char)128);
+  const __m128i spread = _mm_set_epi64x(
+      (long long)((mask & 0xFF) * 0x0101010101010101ULL),
+      (long long)((mask >> 8) * 0x0101010101010101ULL));
+  return _mm_cmpeq_epi8(_mm_and_si128(spread, select), select);
+}
+#endif
+
+// Unpacks exactly 16 values.
+inline void UnpackFv16(uint16_t value_mask, uint16_t unknown_mask,
+                       FourValueLogic* out) {
+#ifdef __SSE2__
+  const __m128i bytes = _mm_or_si128(
+      _mm_and_si128(ExpandMask16(value_mask), _mm_set1_epi8(1)),
+      _mm_and_si128(ExpandMask16(unknown_mask), _mm_set1_epi8(2)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), bytes);
+#else
+  UnpackFvScalar(value_mask, unknown_mask, 16, out);
+#endif
+}
+
+#ifdef __AVX2__
+inline __m256i ExpandMask32(uint32_t mask) {
+  const __m256i select = _mm256_set1_epi64x(0x0102040810204080LL);
+  const __m256i spread = _mm256_set_epi64x(
+      (long long)((mask & 0xFF) * 0x0101010101010101ULL),
+      (long long)(((mask >> 8) & 0xFF) * 0x0101010101010101ULL),
+      (long long)(((mask >> 16) & 0xFF) * 0x0101010101010101ULL),
+      (long long)((mask >> 24) * 0x0101010101010101ULL));
+  return _mm256_cmpeq_epi8(_mm256_and_si256(spread, select), select);
+}
+#endif
+
+// Unpacks exactly 32 values.
+inline void UnpackFv32(uint32_t value_mask, uint32_t unknown_mask,
+                       FourValueLogic* out) {
+#ifdef __AVX2__
+  const __m256i bytes = _mm256_or_si256(
+      _mm256_and_si256(ExpandMask32(value_mask), _mm256_set1_epi8(1)),
+      _mm256_and_si256(ExpandMask32(unknown_mask), _mm256_set1_epi8(2)));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), bytes);
+#else
+  UnpackFv16(static_cast<uint16_t>(value_mask >> 16),
+             static_cast<uint16_t>(unknown_mask >> 16), out);
+  UnpackFv16(static_cast<uint16_t>(value_mask),
+             static_cast<uint16_t>(unknown_mask), out + 16);
+#endif
+}
+
+// Unpacks up to 64 right-aligned values. Never writes past
+// out[num_values - 1].
+inline void UnpackFv(Word value_mask, Word unknown_mask, size_t num_values,
+                     FourValueLogic* out) {
+  size_t i = 0;
+  for (; i + 32 <= num_values; i += 32) {
+    const size_t shift = num_values - i - 32;
+    UnpackFv32(static_cast<uint32_t>(value_mask >> shift),
+               static_cast<uint32_t>(unknown_mask >> shift), out + i);
+  }
+  for (; i + 16 <= num_values; i += 16) {
+    const size_t shift = num_values - i - 16;
+    UnpackFv16(static_cast<uint16_t>(value_mask >> shift),
+               static_cast<uint16_t>(unknown_mask >> shift), out + i);
+  }
+  UnpackFvScalar(value_mask, unknown_mask, num_values - i, out + i);
+}
+
+// Four-value logic operations on bit-planes.
+//
+// Each operation is written once against a small set of bitwise primitives
+// and instantiated for 64-bit words and vector registers. Z inputs to AND, OR
+// and XOR behave as X, as in Verilog; Resolve models two drivers on one net.
+
+inline Word And(Word a, Word b) { return a & b; }
+inline Word Or(Word a, Word b) { return a | b; }
+inline Word Xor(Word a, Word b) { return a ^ b; }
+inline Word AndNot(Word a, Word b) { return ~a & b; }
+#ifdef __SSE2__
+inline __m128i And(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+inline __m128i Or(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+inline __m128i Xor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+inline __m128i AndNot(__m128i a, __m128i b) { return _mm_andnot_si128(a, b); }
+#endif
+#ifdef __AVX2__
+inline __m256i And(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+inline __m256i Or(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+inline __m256i Xor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+inline __m256i AndNot(__m256i a, __m256i b) {
+  return _mm256_andnot_si256(a, b);
+}
+#endif
+
+inline Word AllOnes(Word) { return ~Word(0); }
+#ifdef __SSE2__
+inline __m128i AllOnes(__m128i) { return _mm_set1_epi32(-1); }
+#endif
+#ifdef __AVX2__
+inline __m256i AllOnes(__m256i) { return _mm256_set1_epi32(-1); }
+#endif
+
+struct FvAndOp {
+  template <typename T>
+  static void Apply(T av, T au, T bv, T bu, T* rv, T* ru) {
+    const T ones = AllOnes(av);
+    const T one = And(AndNot(au, av), AndNot(bu, bv));
+    const T zero = Or(AndNot(Or(av, au), ones), AndNot(Or(bv, bu), ones));
+    *rv = one;
+    *ru = AndNot(Or(one, zero), ones);
+  }
+};
+
+struct FvOrOp {
+  template <typename T>
+  static void Apply(T av, T au, T bv, T bu, T* rv, T* ru) {
+    const T ones = AllOnes(av);
+    const T one = Or(AndNot(au, av), AndNot(bu, bv));
+    const T zero = And(AndNot(Or(av, au), ones), AndNot(Or(bv, bu), ones));
+    *rv = one;
+    *ru = AndNot(Or(one, zero), ones);
+  }
+};
+
+struct FvXorOp {
+  template <typename T>
+  static void Apply(T av, T au, T bv, T bu, T* rv, T* ru) {
+    const T unknown = Or(au, bu);
+    *rv = AndNot(unknown, Xor(av, bv));
+    *ru = unknown;
+  }
+};
+
+// Z yields to the other driver, equal drivers agree, and anything else
+// (including any X) resolves to X.
+struct FvResolveOp {
+  template <typename T>
+  static void Apply(T av, T au, T bv, T bu, T* rv, T* ru) {
+    const T ones = AllOnes(av);
+    const T a_z = And(av, au);
+    const T b_z = And(bv, bu);
+    const T equal = AndNot(Or(Xor(av, bv), Xor(au, bu)), ones);
+    const T neither_z = AndNot(Or(a_z, b_z), ones);
+    *rv = Or(And(a_z, bv), And(AndNot(a_z, Or(b_z, equal)), av));
+    *ru = Or(Or(And(a_z, bu), AndNot(a_z, And(b_z, au))),
+             And(neither_z, Or(AndNot(equal, ones), au)));
+  }
+};
+
+// Applies 'Op' to 'num_words' words of two bit-plane operands. The outputs
+// may alias either input.
+template <typename Op>
+void ApplyPlanes(const Word* a_value, const Word* a_unknown,
+                 const Word* b_value, const Word* b_unknown,
+                 Word* value_out, Word* unknown_out, size_t num_words) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 4 <= num_words; i += 4) {
+    __m256i rv, ru;
+    Op::Apply(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_value + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_unknown + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_value + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_unknown + i)),
+        &rv, &ru);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(value_out + i), rv);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(unknown_out + i), ru);
+  }
+#elif defined(__SSE2__)
+  for (; i + 2 <= num_words; i += 2) {
+    __m128i rv, ru;
+    Op::Apply(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_value + i)),
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_unknown + i)),
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_value + i)),
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(b_unknown + i)),
+              &rv, &ru);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(value_out + i), rv);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(unknown_out + i), ru);
+  }
+#endif
+  for (; i < num_words; ++i) {
+    Word rv, ru;
+    Op::Apply(a_value[i], a_unknown[i], b_value[i], b_unknown[i], &rv, &ru);
+    value_out[i] = rv;
+    unknown_out[i] = ru;
+  }
+}
+
+inline void FvAnd(const Word* a_value, const Word* a_unknown,
+                  const Word* b_value, const Word* b_unknown,
+                  Word* value_out, Word* unknown_out, size_t num_words) {
+  ApplyPlanes<FvAndOp>(a_value, a_unknown, b_value, b_unknown,
+                       value_out, unknown_out, num_words);
+}
+
+inline void FvOr(const Word* a_value, const Word* a_unknown,
+                 const Word* b_value, const Word* b_unknown,
+                 Word* value_out, Word* unknown_out, size_t num_words) {
+  ApplyPlanes<FvOrOp>(a_value, a_unknown, b_value, b_unknown,
+                      value_out, unknown_out, num_words);
+}
+
+inline void FvXor(const Word* a_value, const Word* a_unknown,
+                  const Word* b_value, const Word* b_unknown,
+                  Word* value_out, Word* unknown_out, size_t num_words) {
+  ApplyPlanes<FvXorOp>(a_value, a_unknown, b_value, b_unknown,
+                       value_out, unknown_out, num_words);
+}
+
+inline void FvResolve(const Word* a_value, const Word* a_unknown,
+                      const Word* b_value, const Word* b_unknown,
+                      Word* value_out, Word* unknown_out, size_t num_words) {
+  ApplyPlanes<FvResolveOp>(a_value, a_unknown, b_value, b_unknown,
+                           value_out, unknown_out, num_words);
+}
+
+}  // namespace simd
+}  // namespace base
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_BASE_FOUR_VALUE_SIMD_H_ */
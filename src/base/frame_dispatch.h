@@ -0,0 +1,78 @@
+/*
+ * frame_dispatch.h
+ *
+ * Maps a frame size known only at runtime onto code instantiated for a fixed
+ * FRAME_SIZE, so that runtime-sized (VFrame) paths get the same unrolled,
+ * allocation-free loops as FrameFv<FRAME_SIZE> code for the widths that are
+ * actually in use.
+ *
+ * A dispatch target is a functor with a result_type typedef, a member
+ * template 'template <size_t FRAME_SIZE> result_type Run()' and a
+ * 'result_type RunGeneric()' fallback for sizes that are not instantiated:
+ *
+ *   struct CountOnes {
+ *     typedef size_t result_type;
+ *     template <size_t FRAME_SIZE> size_t Run() { ... }
+ *     size_t RunGeneric() { ... }
+ *   };
+ *   size_t ones = DispatchFrameSize(frame_size, count_ones);
+ */
+
+#ifndef SIGNAL_CONTENT_BASE_FRAME_DISPATCH_H_
+#define SIGNAL_CONTENT_BASE_FRAME_DISPATCH_H_
+
+#include <cstddef>
+
+namespace signal_content {
+namespace base {
+
+template <size_t... SIZES>
+struct FrameSizeList {};
+
+// Frame sizes with pre-instantiated specializations. 17 is an RCT tower word:
+// a fine grain bit followed by the ECAL and HCAL bytes.
+typedef FrameSizeList<8, 16, 17, 32, 64, 128> DispatchedFrameSizes;
+
+namespace internal {
+
+template <typename Functor, typename List>
+struct FrameSizeDispatcher;
+
+template <typename Functor>
+struct FrameSizeDispatcher<Functor, FrameSizeList<>> {
+  static typename Functor::result_type Dispatch(size_t, Functor& functor) {
+    return functor.RunGeneric();
+  }
+};
+
+template <typename Functor, size_t SIZE, size_t... REST>
+struct FrameSizeDispatcher<Functor, FrameSizeList<SIZE, REST...>> {
+  static typename Functor::result_type Dispatch(size_t frame_size,
+                                                Functor& functor) {
+    if (frame_size == SIZE) {
+      return functor.template Run<SIZE>();
+    }
+    return FrameSizeDispatcher<Functor, FrameSizeList<REST...>>::Dispatch(
+        frame_size, functor);
+  }
+};
+
+}  // namespace internal
+
+template <typename Functor, typename List>
+typename Functor::result_type DispatchFrameSize(size_t frame_size,
+                                                Functor& functor) {
+  return internal::FrameSizeDispatcher<Functor, List>::Dispatch(frame_size,
+                                                                functor);
+}
+
+template <typename Functor>
+typename Functor::result_type DispatchFrameSize(size_t frame_size,
+                                                Functor& functor) {
+  return DispatchFrameSize<Functor, DispatchedFrameSizes>(frame_size, functor);
+}
+
+}  // namespace base
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_BASE_FRAME_DISPATCH_H_ */
@@ -18,6 +18,7 @@
 #include <vector>
 
 #include "four_value_logic.h"
+#include "packed_fv.h"
 #include "queue_fv.h"
 
 namespace signal_content {
@@ -183,6 +184,112 @@ inline VFrameVector ConvertToFrameVector(QueueFv&& q, int frame_size) {
   return frame_vector;
 }
 
+// Methods for constructing frame containers from a PackedFv. Frames are
+// copied out a word at a time rather than popped value by value.
+template <size_t FRAME_SIZE>
+FrameQueue<FRAME_SIZE> ConvertToFrameQueue(PackedFv&& q) {
+  FrameQueue<FRAME_SIZE> frame_queue;
+  if (q.size() % FRAME_SIZE != 0) {
+    throw std::runtime_error("Queue is not a multiple of frame size.");
+  }
+  for (size_t index = 0; index < q.size(); index += FRAME_SIZE) {
+    FrameFv<FRAME_SIZE> frame;
+    q.CopyValues(index, FRAME_SIZE, frame.data());
+    frame_queue.emplace(std::move(frame));
+  }
+  q.clear();
+  return frame_queue;
+}
+
+inline VFrameQueue ConvertToFrameQueue(PackedFv&& q, int frame_size) {
+  VFrameQueue frame_queue;
+  if (q.size() % frame_size != 0) {
+    throw std::runtime_error("Queue is not a multiple of frame size.");
+  }
+  for (size_t index = 0; index < q.size(); index += frame_size) {
+    VFrameFv frame(frame_size);
+    q.CopyValues(index, frame_size, frame.data());
+    frame_queue.emplace(std::move(frame));
+  }
+  q.clear();
+  return frame_queue;
+}
+
+template <size_t FRAME_SIZE>
+FrameDeque<FRAME_SIZE> ConvertToFrameDeque(PackedFv&& q) {
+  FrameDeque<FRAME_SIZE> frame_deque;
+  if (q.size() % FRAME_SIZE != 0) {
+    throw std::runtime_error("Queue is not a multiple of frame size.");
+  }
+  for (size_t index = 0; index < q.size(); index += FRAME_SIZE) {
+    frame_deque.emplace_back();
+    q.CopyValues(index, FRAME_SIZE, frame_deque.back().data());
+  }
+  q.clear();
+  return frame_deque;
+}
+
+inline VFrameDeque ConvertToFrameDeque(PackedFv&& q, int frame_size) {
+  VFrameDeque frame_deque;
+  if (q.size() % frame_size != 0) {
+    throw std::runtime_error("Queue is not a multiple of frame size.");
+  }
+  for (size_t index = 0; index < q.size(); index += frame_size) {
+    frame_deque.emplace_back(frame_size);
+    q.CopyValues(index, frame_size, frame_deque.back().data());
+  }
+  q.clear();
+  return frame_deque;
+}
+
+template <size_t FRAME_SIZE>
+FrameVector<FRAME_SIZE> ConvertToFrameVector(PackedFv&& q) {
+  FrameVector<FRAME_SIZE> frame_vector(q.size() / FRAME_SIZE);
+  if (q.size() % FRAME_SIZE != 0) {
+    throw std::runtime_error("Queue is not a multiple of frame size.");
+  }
+  for (size_t frame_num = 0; frame_num < frame_vector.size(); ++frame_num) {
+    q.CopyValues(frame_num * FRAME_SIZE, FRAME_SIZE,
+                 frame_vector[frame_num].data());
+  }
+  q.clear();
+  return frame_vector;
+}
+
+inline VFrameVector ConvertToFrameVector(PackedFv&& q, int frame_size) {
+  if (q.size() % frame_size != 0) {
+    throw std::runtime_error("Queue is not a multiple of frame size.");
+  }
+  VFrameVector frame_vector(q.size() / frame_size, VFrameFv(frame_size));
+  for (size_t frame_num = 0; frame_num < frame_vector.size(); ++frame_num) {
+    q.CopyValues(frame_num * frame_size, frame_size,
+                 frame_vector[frame_num].data());
+  }
+  q.clear();
+  return frame_vector;
+}
+
+// Methods for packing frame containers back into a PackedFv.
+template <size_t FRAME_SIZE>
+PackedFv ConvertToPackedFv(FrameDeque<FRAME_SIZE>&& fd) {
+  PackedFv q;
+  q.reserve(fd.size() * FRAME_SIZE);
+  while (!fd.empty()) {
+    q.PushValues(fd.front().data(), FRAME_SIZE);
+    fd.pop_front();
+  }
+  return q;
+}
+
+inline PackedFv ConvertToPackedFv(VFrameDeque&& fd) {
+  PackedFv q;
+  while (!fd.empty()) {
+    q.PushValues(fd.front().data(), fd.front().size());
+    fd.pop_front();
+  }
+  return q;
+}
+
 }  // base
 }  // signal_content
 
@@ -0,0 +1,200 @@
+/*
+ * frame_view.h
+ *
+ * Non-owning views that present a PackedFv as a sequence of frames, without
+ * copying it into per-frame containers.
+ *
+ * A view is described by the offset of its first frame, the frame size, and
+ * the stride between the starts of consecutive frames (all in values). With
+ * stride == frame size the frames tile the buffer; a larger stride selects a
+ * field out of each frame of a wider stream, e.g. the ECAL byte of every
+ * tower word.
+ *
+ * Views hold a pointer to the underlying PackedFv, which must outlive them and
+ * must not be popped from while they are in use.
+ */
+
+#ifndef SIGNAL_CONTENT_BASE_FRAME_VIEW_H_
+#define SIGNAL_CONTENT_BASE_FRAME_VIEW_H_
+
+#include <cstddef>
+#include <stdexcept>
+
+#include "four_value_logic.h"
+#include "frame_fv.h"
+#include "packed_fv.h"
+
+namespace signal_content {
+namespace base {
+
+class VFrameView {
+ public:
+  typedef PackedFv::Word Word;
+
+  // Views all of 'bits' as back-to-back frames of 'frame_size' values.
+  VFrameView(const PackedFv& bits, size_t frame_size)
+      : VFrameView(bits, frame_size, 0, frame_size,
+                   frame_size ? bits.size() / frame_size : 0) {
+    if (frame_size == 0 || bits.size() % frame_size != 0) {
+      throw std::runtime_error("Queue is not a multiple of frame size.");
+    }
+  }
+
+  VFrameView(const PackedFv& bits, size_t frame_size, size_t offset,
+             size_t stride, size_t num_frames)
+      : bits_(&bits), frame_size_(frame_size), offset_(offset),
+        stride_(stride), num_frames_(num_frames) {
+    if (frame_size_ > stride_) {
+      throw std::invalid_argument("Frame size cannot exceed stride.");
+    }
+    if (num_frames_ > 0 &&
+        offset_ + (num_frames_ - 1) * stride_ + frame_size_ > bits.size()) {
+      throw std::out_of_range("Frame view exceeds its buffer.");
+    }
+  }
+
+  size_t frame_size() const { return frame_size_; }
+  size_t num_frames() const { return num_frames_; }
+  size_t stride() const { return stride_; }
+  size_t offset() const { return offset_; }
+  bool empty() const { return num_frames_ == 0; }
+  const PackedFv& bits() const { return *bits_; }
+
+  // Position of a frame's first value in the underlying buffer.
+  size_t FrameStart(size_t frame_num) const {
+    return offset_ + frame_num * stride_;
+  }
+
+  FourValueLogic at(size_t frame_num, size_t bit) const {
+    return bits_->at(FrameStart(frame_num) + bit);
+  }
+
+  // Reads up to 64 values of a frame as PackedFv::PeekBits does: MSB-first,
+  // right-aligned, X and Z as zero.
+  Word PeekBits(size_t frame_num, size_t bit, size_t num_bits) const {
+    return bits_->PeekBits(FrameStart(frame_num) + bit, num_bits);
+  }
+
+  void CopyFrame(size_t frame_num, FourValueLogic* out) const {
+    bits_->CopyValues(FrameStart(frame_num), frame_size_, out);
+  }
+
+  VFrameFv Frame(size_t frame_num) const {
+    VFrameFv frame(frame_size_);
+    CopyFrame(frame_num, frame.data());
+    return frame;
+  }
+
+  // A view of frames [first_frame, first_frame + num_frames).
+  VFrameView Subview(size_t first_frame, size_t num_frames) const {
+    if (first_frame + num_frames > num_frames_) {
+      throw std::out_of_range("Subview exceeds frame view.");
+    }
+    return VFrameView(*bits_, frame_size_, FrameStart(first_frame), stride_,
+                      num_frames);
+  }
+
+  // A view of 'width' values starting at 'bit' in every frame.
+  VFrameView Field(size_t bit, size_t width) const {
+    if (bit + width > frame_size_) {
+      throw std::out_of_range("Field exceeds frame.");
+    }
+    return VFrameView(*bits_, width, offset_ + bit, stride_, num_frames_);
+  }
+
+ private:
+  const PackedFv* bits_;
+  size_t frame_size_;
+  size_t offset_;
+  size_t stride_;
+  size_t num_frames_;
+};
+
+// A frame view whose frame size is fixed at compile time, for the templated
+// FrameFv<FRAME_SIZE> world.
+template <size_t FRAME_SIZE>
+class FrameView {
+ public:
+  typedef PackedFv::Word Word;
+  static const size_t kFrameSize = FRAME_SIZE;
+
+  explicit FrameView(const PackedFv& bits)
+      : FrameView(bits, 0, FRAME_SIZE, bits.size() / FRAME_SIZE) {
+    if (bits.size() % FRAME_SIZE != 0) {
+      throw std::runtime_error("Queue is not a multiple of frame size.");
+    }
+  }
+
+  FrameView(const PackedFv& bits, size_t offset, size_t stride,
+            size_t num_frames)
+      : bits_(&bits), offset_(offset), stride_(stride),
+        num_frames_(num_frames) {
+    if (FRAME_SIZE > stride_) {
+      throw std::invalid_argument("Frame size cannot exceed stride.");
+    }
+    if (num_frames_ > 0 &&
+        offset_ + (num_frames_ - 1) * stride_ + FRAME_SIZE > bits.size()) {
+      throw std::out_of_range("Frame view exceeds its buffer.");
+    }
+  }
+
+  // Narrows a runtime-sized view whose frame size is FRAME_SIZE.
+  explicit FrameView(const VFrameView& view)
+      : FrameView(view.bits(), view.offset(), view.stride(),
+                  view.num_frames()) {
+    if (view.frame_size() != FRAME_SIZE) {
+      throw std::invalid_argument("Frame size mismatch.");
+    }
+  }
+
+  size_t frame_size() const { return FRAME_SIZE; }
+  size_t num_frames() const { return num_frames_; }
+  size_t stride() const { return stride_; }
+  size_t offset() const { return offset_; }
+  bool empty() const { return num_frames_ == 0; }
+  const PackedFv& bits() const { return *bits_; }
+
+  size_t FrameStart(size_t frame_num) const {
+    return offset_ + frame_num * stride_;
+  }
+
+  FourValueLogic at(size_t frame_num, size_t bit) const {
+    return bits_->at(FrameStart(frame_num) + bit);
+  }
+
+  Word PeekBits(size_t frame_num, size_t bit, size_t num_bits) const {
+    return bits_->PeekBits(FrameStart(frame_num) + bit, num_bits);
+  }
+
+  void CopyFrame(size_t frame_num, FourValueLogic* out) const {
+    bits_->CopyValues(FrameStart(frame_num), FRAME_SIZE, out);
+  }
+
+  FrameFv<FRAME_SIZE> Frame(size_t frame_num) const {
+    FrameFv<FRAME_SIZE> frame;
+    CopyFrame(frame_num, frame.data());
+    return frame;
+  }
+
+  FrameView Subview(size_t first_frame, size_t num_frames) const {
+    if (first_frame + num_frames > num_frames_) {
+      throw std::out_of_range("Subview exceeds frame view.");
+    }
+    return FrameView(*bits_, FrameStart(first_frame), stride_, num_frames);
+  }
+
+  operator VFrameView() const {
+    return VFrameView(*bits_, FRAME_SIZE, offset_, stride_, num_frames_);
+  }
+
+ private:
+  const PackedFv* bits_;
+  size_t offset_;
+  size_t stride_;
+  size_t num_frames_;
+};
+
+}  // namespace base
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_BASE_FRAME_VIEW_H_ */
@@ -0,0 +1,417 @@
+/*
+ * packed_fv.h
+ *
+ * A packed container for streams of four-value logic.
+ *
+ * Values are stored as two bit-planes of 64-bit words. The value plane holds
+ * the low bit of the FourValueLogic encoding and the unknown plane holds the
+ * high bit, so ZERO is (0, 0), ONE is (1, 0), X is (0, 1) and Z is (1, 1).
+ * Within a word, values are stored MSB-first: the earliest value occupies
+ * bit 63. Extracting a multi-bit symbol whose first value is its most
+ * significant bit is therefore just a shift.
+ *
+ * The unknown plane is only allocated once an X or Z is stored, so purely
+ * binary streams (memory images, captured buses) cost one bit per value.
+ */
+
+#ifndef SIGNAL_CONTENT_BASE_PACKED_FV_H_
+#define SIGNAL_CONTENT_BASE_PACKED_FV_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "four_value_logic.h"
+#include "four_value_simd.h"
+#include "queue_fv.h"
+
+namespace signal_content {
+namespace base {
+
+class PackedFv {
+ public:
+  typedef uint64_t Word;
+  static const size_t kBitsPerWord = 64;
+
+  PackedFv() {}
+  explicit PackedFv(size_t num_values,
+                    FourValueLogic fill = FourValueLogic::ZERO);
+
+  // PackedFv is move-only, since an accidental copy of a multi-megabit image
+  // is exactly the cost it exists to avoid. Use Clone() for a deep copy.
+  PackedFv(PackedFv&& other) { *this = std::move(other); }
+  PackedFv& operator=(PackedFv&& other);
+  PackedFv(const PackedFv&) = delete;
+  PackedFv& operator=(const PackedFv&) = delete;
+
+  PackedFv Clone() const;
+
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return end_ == begin_; }
+  void clear();
+  void reserve(size_t num_values);
+
+  // True if the unknown plane has been allocated. This is conservative: the
+  // X/Z values that caused the allocation may since have been popped.
+  bool HasUnknownPlane() const { return !unknown_.empty(); }
+
+  // Queue interface, matching QueueFv.
+  FourValueLogic front() const { return at(0); }
+  FourValueLogic back() const { return at(size() - 1); }
+  void push(FourValueLogic value) { push_back(value); }
+  void push_back(FourValueLogic value);
+  void pop() { pop(1); }
+  void pop(size_t num_values);
+
+  // Random access, relative to the front of the queue.
+  FourValueLogic at(size_t index) const;
+  FourValueLogic operator[](size_t index) const { return at(index); }
+  void set(size_t index, FourValueLogic value);
+
+  // Appends the 'num_bits' least significant bits of 'bits' as binary values,
+  // most significant first. 'num_bits' may be at most 64.
+  void PushBits(Word bits, size_t num_bits);
+
+  // As above, but with an explicit unknown plane.
+  void PushBits(Word value_bits, Word unknown_bits, size_t num_bits);
+
+  void PushValues(const FourValueLogic* values, size_t num_values);
+  void Append(const PackedFv& other);
+
+  // Reads 'num_bits' (at most 64) values starting at 'index' as a
+  // right-aligned integer whose most significant bit is the value at 'index'.
+  // X and Z are read as zero.
+  Word PeekBits(size_t index, size_t num_bits) const;
+
+  // Raw bit-plane reads with the same alignment as PeekBits.
+  Word PeekValueBits(size_t index, size_t num_bits) const;
+  Word PeekUnknownBits(size_t index, size_t num_bits) const;
+
+  // Removes 'num_bits' values from the front and returns them as PeekBits
+  // would.
+  Word PopBits(size_t num_bits);
+
+  // Copies 'num_values' values starting at 'index' to 'out'.
+  void CopyValues(size_t index, size_t num_values, FourValueLogic* out) const;
+
+  // Word-level access. Logical word 'w' holds values [64 * w, 64 * w + 64)
+  // MSB-first; the final word is zero-padded. Throws std::out_of_range if 'w'
+  // is not below num_words().
+  size_t num_words() const {
+    return (size() + kBitsPerWord - 1) / kBitsPerWord;
+  }
+  Word ValueWord(size_t w) const;
+  Word UnknownWord(size_t w) const;
+
+ private:
+  static Word ReadPlane(const std::vector<Word>& plane, size_t pos,
+                        size_t num_bits);
+  static void WritePlane(std::vector<Word>* plane, size_t pos, Word bits,
+                         size_t num_bits);
+  static Word LowMask(size_t num_bits) {
+    return (num_bits >= kBitsPerWord) ? ~Word(0) : ((Word(1) << num_bits) - 1);
+  }
+
+  void AllocateUnknownPlane() { unknown_.assign(value_.size(), 0); }
+  void GrowTo(size_t end);
+
+  // Positions in the planes are physical; [begin_, end_) is live. Bits past
+  // end_ are always zero.
+  std::vector<Word> value_;
+  std::vector<Word> unknown_;
+  size_t begin_{0};
+  size_t end_{0};
+};
+
+inline PackedFv::PackedFv(size_t num_values, FourValueLogic fill)
+    : end_(num_values) {
+  const size_t words = (num_values + kBitsPerWord - 1) / kBitsPerWord;
+  const char encoding = static_cast<char>(fill);
+  const size_t tail = num_values % kBitsPerWord;
+  const Word tail_mask = tail ? ~LowMask(kBitsPerWord - tail) : ~Word(0);
+  if (words == 0) {
+    return;
+  }
+  value_.assign(words, (encoding & 0x1) ? ~Word(0) : 0);
+  value_.back() &= tail_mask;
+  if (encoding & 0x2) {
+    unknown_.assign(words, ~Word(0));
+    unknown_.back() &= tail_mask;
+  }
+}
+
+inline PackedFv& PackedFv::operator=(PackedFv&& other) {
+  value_ = std::move(other.value_);
+  unknown_ = std::move(other.unknown_);
+  begin_ = other.begin_;
+  end_ = other.end_;
+  other.clear();
+  return *this;
+}
+
+inline PackedFv PackedFv::Clone() const {
+  PackedFv copy;
+  copy.value_ = value_;
+  copy.unknown_ = unknown_;
+  copy.begin_ = begin_;
+  copy.end_ = end_;
+  return copy;
+}
+
+inline void PackedFv::clear() {
+  value_.clear();
+  unknown_.clear();
+  begin_ = 0;
+  end_ = 0;
+}
+
+inline void PackedFv::reserve(size_t num_values) {
+  const size_t words =
+      (begin_ + num_values + kBitsPerWord - 1) / kBitsPerWord;
+  value_.reserve(words);
+}
+
+inline void PackedFv::GrowTo(size_t end) {
+  const size_t words = (end + kBitsPerWord - 1) / kBitsPerWord;
+  if (words > value_.size()) {
+    value_.resize(words, 0);
+    if (!unknown_.empty()) {
+      unknown_.resize(words, 0);
+    }
+  }
+  end_ = end;
+}
+
+inline void PackedFv::push_back(FourValueLogic value) {
+  const char encoding = static_cast<char>(value);
+  PushBits(encoding & 0x1, (encoding >> 1) & 0x1, 1);
+}
+
+inline void PackedFv::pop(size_t num_values) {
+  if (num_values > size()) {
+    throw std::out_of_range("Cannot pop more values than are stored.");
+  }
+  begin_ += num_values;
+  if (begin_ == end_) {
+    clear();
+  } else if (begin_ >= 1024 * kBitsPerWord &&
+             begin_ / kBitsPerWord > value_.size() / 2) {
+    // Release consumed words once they dominate the storage, so that a
+    // long-lived queue does not grow without bound.
+    const size_t dead_words = begin_ / kBitsPerWord;
+    value_.erase(value_.begin(), value_.begin() + dead_words);
+    if (!unknown_.empty()) {
+      unknown_.erase(unknown_.begin(), unknown_.begin() + dead_words);
+    }
+    begin_ -= dead_words * kBitsPerWord;
+    end_ -= dead_words * kBitsPerWord;
+  }
+}
+
+inline FourValueLogic PackedFv::at(size_t index) const {
+  if (index >= size()) {
+    throw std::out_of_range("PackedFv index out of range.");
+  }
+  const size_t pos = begin_ + index;
+  const size_t shift = kBitsPerWord - 1 - pos % kBitsPerWord;
+  int encoding = (value_[pos / kBitsPerWord] >> shift) & 0x1;
+  if (!unknown_.empty()) {
+    encoding |= ((unknown_[pos / kBitsPerWord] >> shift) & 0x1) << 1;
+  }
+  return static_cast<FourValueLogic>(encoding);
+}
+
+inline void PackedFv::set(size_t index, FourValueLogic value) {
+  if (index >= size()) {
+    throw std::out_of_range("PackedFv index out of range.");
+  }
+  const char encoding = static_cast<char>(value);
+  if ((encoding & 0x2) && unknown_.empty()) {
+    AllocateUnknownPlane();
+  }
+  WritePlane(&value_, begin_ + index, encoding & 0x1, 1);
+  if (!unknown_.empty()) {
+    WritePlane(&unknown_, begin_ + index, (encoding >> 1) & 0x1, 1);
+  }
+}
+
+inline void PackedFv::PushBits(Word bits, size_t num_bits) {
+  PushBits(bits, 0, num_bits);
+}
+
+inline void PackedFv::PushBits(Word value_bits, Word unknown_bits,
+                               size_t num_bits) {
+  if (num_bits == 0) {
+    return;
+  }
+  if (num_bits > kBitsPerWord) {
+    throw std::invalid_argument("Cannot push more than 64 bits at once.");
+  }
+  const Word mask = LowMask(num_bits);
+  const size_t pos = end_;
+  GrowTo(end_ + num_bits);
+  // After growing, so that the plane covers the new words even when the
+  // container was empty.
+  if ((unknown_bits & mask) && unknown_.empty()) {
+    AllocateUnknownPlane();
+  }
+  WritePlane(&value_, pos, value_bits & mask, num_bits);
+  if (!unknown_.empty()) {
+    WritePlane(&unknown_, pos, unknown_bits & mask, num_bits);
+  }
+}
+
+inline void PackedFv::PushValues(const FourValueLogic* values,
+                                 size_t num_values) {
+  reserve(size() + num_values);
+  while (num_values > 0) {
+    const size_t chunk = num_values < kBitsPerWord ? num_values : kBitsPerWord;
+    Word value_bits, unknown_bits;
+    simd::PackFv(values, chunk, &value_bits, &unknown_bits);
+    PushBits(value_bits, unknown_bits, chunk);
+    values += chunk;
+    num_values -= chunk;
+  }
+}
+
+inline void PackedFv::Append(const PackedFv& other) {
+  reserve(size() + other.size());
+  const size_t other_size = other.size();
+  for (size_t index = 0; index < other_size; index += kBitsPerWord) {
+    const size_t chunk = (other_size - index < kBitsPerWord) ?
+        other_size - index : kBitsPerWord;
+    PushBits(other.PeekValueBits(index, chunk),
+             other.PeekUnknownBits(index, chunk), chunk);
+  }
+}
+
+inline PackedFv::Word PackedFv::PeekBits(size_t index, size_t num_bits) const {
+  Word bits = PeekValueBits(index, num_bits);
+  if (!unknown_.empty()) {
+    bits &= ~ReadPlane(unknown_, begin_ + index, num_bits);
+  }
+  return bits;
+}
+
+inline PackedFv::Word PackedFv::PeekValueBits(size_t index,
+                                              size_t num_bits) const {
+  if (index + num_bits > size()) {
+    throw std::out_of_range("PackedFv read out of range.");
+  }
+  return ReadPlane(value_, begin_ + index, num_bits);
+}
+
+inline PackedFv::Word PackedFv::PeekUnknownBits(size_t index,
+                                                size_t num_bits) const {
+  if (index + num_bits > size()) {
+    throw std::out_of_range("PackedFv read out of range.");
+  }
+  return unknown_.empty() ? 0 : ReadPlane(unknown_, begin_ + index, num_bits);
+}
+
+inline PackedFv::Word PackedFv::PopBits(size_t num_bits) {
+  const Word bits = PeekBits(0, num_bits);
+  pop(num_bits);
+  return bits;
+}
+
+inline void PackedFv::CopyValues(size_t index, size_t num_values,
+                                 FourValueLogic* out) const {
+  while (num_values > 0) {
+    const size_t chunk = num_values < kBitsPerWord ? num_values : kBitsPerWord;
+    simd::UnpackFv(PeekValueBits(index, chunk), PeekUnknownBits(index, chunk),
+                   chunk, out);
+    out += chunk;
+    index += chunk;
+    num_values -= chunk;
+  }
+}
+
+inline PackedFv::Word PackedFv::ValueWord(size_t w) const {
+  if (w >= num_words()) {
+    throw std::out_of_range("PackedFv word out of range.");
+  }
+  const size_t index = w * kBitsPerWord;
+  const size_t n =
+      (size() - index < kBitsPerWord) ? size() - index : kBitsPerWord;
+  return PeekValueBits(index, n) << (kBitsPerWord - n);
+}
+
+inline PackedFv::Word PackedFv::UnknownWord(size_t w) const {
+  if (w >= num_words()) {
+    throw std::out_of_range("PackedFv word out of range.");
+  }
+  const size_t index = w * kBitsPerWord;
+  const size_t n =
+      (size() - index < kBitsPerWord) ? size() - index : kBitsPerWord;
+  return PeekUnknownBits(index, n) << (kBitsPerWord - n);
+}
+
+inline PackedFv::Word PackedFv::ReadPlane(const std::vector<Word>& plane,
+                                          size_t pos, size_t num_bits) {
+  if (num_bits == 0) {
+    return 0;
+  }
+  const size_t w = pos / kBitsPerWord;
+  const size_t offset = pos % kBitsPerWord;
+  Word aligned = plane[w] << offset;
+  if (offset + num_bits > kBitsPerWord) {
+    aligned |= plane[w + 1] >> (kBitsPerWord - offset);
+  }
+  return aligned >> (kBitsPerWord - num_bits);
+}
+
+inline void PackedFv::WritePlane(std::vector<Word>* plane, size_t pos,
+                                 Word bits, size_t num_bits) {
+  const size_t w = pos / kBitsPerWord;
+  const size_t offset = pos % kBitsPerWord;
+  const Word aligned_mask = ~Word(0) << (kBitsPerWord - num_bits);
+  const Word aligned_bits = bits << (kBitsPerWord - num_bits);
+  Word& first = (*plane)[w];
+  first = (first & ~(aligned_mask >> offset)) | (aligned_bits >> offset);
+  if (offset + num_bits > kBitsPerWord) {
+    Word& second = (*plane)[w + 1];
+    const size_t spill = kBitsPerWord - offset;
+    second = (second & ~(aligned_mask << spill)) | (aligned_bits << spill);
+  }
+}
+
+// Reverses the order of the 'num_bits' least significant bits of 'bits'.
+inline PackedFv::Word ReverseBits(PackedFv::Word bits, size_t num_bits) {
+  PackedFv::Word reversed = 0;
+  for (size_t i = 0; i < num_bits; ++i) {
+    reversed = (reversed << 1) | (bits & 0x1);
+    bits >>= 1;
+  }
+  return reversed;
+}
+
+// Packed equivalent of QueueFvFromBits: the least significant bit of 'bits'
+// becomes the first value.
+template <typename T, size_t NUM_BITS>
+PackedFv PackedFvFromBits(T bits) {
+  static_assert(NUM_BITS <= PackedFv::kBitsPerWord,
+                "PackedFvFromBits supports at most 64 bits.");
+  PackedFv packed;
+  packed.PushBits(ReverseBits(static_cast<PackedFv::Word>(bits), NUM_BITS),
+                  NUM_BITS);
+  return packed;
+}
+
+// Converts a QueueFv, which is consumed in the process.
+inline PackedFv PackedFvFromQueueFv(QueueFv&& q) {
+  PackedFv packed;
+  packed.reserve(q.size());
+  while (!q.empty()) {
+    packed.push(q.front());
+    q.pop();
+  }
+  return packed;
+}
+
+}  // namespace base
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_BASE_PACKED_FV_H_ */
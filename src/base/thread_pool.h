@@ -0,0 +1,168 @@
+/*
+ * thread_pool.h
+ *
+ * A fixed set of worker threads that take submitted tasks in submission
+ * order. Wait() blocks until every task submitted so far has finished, which
+ * makes a round of tasks followed by Wait() a barrier; the threads are kept
+ * between rounds rather than started for each.
+ *
+ * ParallelFor spreads a range of items over a round of tasks that each take
+ * the next item until none are left, and RunParallel does so on a pool of its
+ * own for callers that are given a thread count rather than a pool.
+ */
+
+#ifndef SIGNAL_CONTENT_BASE_THREAD_POOL_H_
+#define SIGNAL_CONTENT_BASE_THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace signal_content {
+namespace base {
+
+class ThreadPool {
+ public:
+  // Starts 'num_threads' workers (0 means one per hardware thread).
+  explicit ThreadPool(size_t num_threads = 0) {
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t t = 0; t < num_threads; ++t) {
+      workers_.emplace_back([this] () { WorkerLoop(); });
+    }
+  }
+
+  // Runs the tasks still queued, then stops the workers.
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_ready_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t num_threads() const { return workers_.size(); }
+
+  // The workers that 'num_threads' (0 means one per hardware thread) gives
+  // for 'num_items' items: at least one, and no more than there are items.
+  static size_t WorkersFor(size_t num_items, size_t num_threads) {
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return std::max<size_t>(1, std::min(num_threads, num_items));
+  }
+
+  // Calls work(worker, item) for every item in [0, num_items) from
+  // WorkersFor(num_items, num_workers) tasks, and waits for them. 'worker'
+  // numbers the task that took the item from 0, for per-worker partial
+  // results.
+  void ParallelFor(size_t num_items, size_t num_workers,
+                   const std::function<void(size_t, size_t)>& work) {
+    num_workers = WorkersFor(num_items, num_workers);
+    std::atomic<size_t> next_item(0);
+    for (size_t w = 0; w < num_workers; ++w) {
+      Submit([&work, &next_item, num_items, w] () {
+        for (size_t i = next_item++; i < num_items; i = next_item++) {
+          work(w, i);
+        }
+      });
+    }
+    Wait();
+  }
+
+  // As ParallelFor, on a pool of WorkersFor(num_items, num_threads) threads
+  // started for the call. A single worker runs on the calling thread.
+  static void RunParallel(size_t num_items, size_t num_threads,
+                          const std::function<void(size_t, size_t)>& work) {
+    const size_t num_workers = WorkersFor(num_items, num_threads);
+    if (num_workers == 1) {
+      for (size_t i = 0; i < num_items; ++i) {
+        work(0, i);
+      }
+      return;
+    }
+    ThreadPool pool(num_workers);
+    pool.ParallelFor(num_items, num_workers, work);
+  }
+
+  void Submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+      ++unfinished_;
+    }
+    work_ready_.notify_one();
+  }
+
+  // Blocks until every submitted task has finished. If any task threw, the
+  // first exception is rethrown here.
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    all_done_.wait(lock, [this] () { return unfinished_ == 0; });
+    if (error_) {
+      std::exception_ptr error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  void WorkerLoop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_ready_.wait(
+            lock, [this] () { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      std::exception_ptr error;
+      try {
+        task();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error && !error_) {
+        error_ = error;
+      }
+      if (--unfinished_ == 0) {
+        all_done_.notify_all();
+      }
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable all_done_;
+  std::deque<std::function<void()>> tasks_;
+  // Tasks submitted but not yet finished.
+  size_t unfinished_{0};
+  bool stopping_{false};
+  std::exception_ptr error_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace base
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_BASE_THREAD_POOL_H_ */
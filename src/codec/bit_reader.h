@@ -0,0 +1,93 @@
+/*
+ * bit_reader.h
+ *
+ * Reads back a stream written by BitWriter: MSB-first bytes holding a known
+ * number of bits. The bytes are loaded into 64-bit words up front, so a read
+ * of up to 64 bits is two shifts, and a unary code is read a word at a time
+ * by counting leading zeros.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_BIT_READER_H_
+#define SIGNAL_CONTENT_CODEC_BIT_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "bit_writer.h"
+
+namespace signal_content {
+namespace codec {
+
+class BitReader {
+ public:
+  BitReader(const uint8_t* bytes, size_t num_bits)
+      : words_(num_bits / 64 + 2, 0), num_bits_(num_bits) {
+    const size_t num_bytes = BitWriter::BytesForBits(num_bits);
+    for (size_t byte = 0; byte < num_bytes; ++byte) {
+      words_[byte / 8] |= uint64_t(bytes[byte]) << (56 - 8 * (byte % 8));
+    }
+  }
+
+  // Reads 'n' bits, 0 < n <= 64. Throws std::runtime_error past the end.
+  uint64_t Read(size_t n) {
+    if (pos_ + n > num_bits_) {
+      throw std::runtime_error("Truncated bit stream.");
+    }
+    const uint64_t bits = Peek64() >> (64 - n);
+    pos_ += n;
+    return bits;
+  }
+
+  // Reads zeroes up to and including the next one, and returns how many
+  // zeroes there were. Throws std::runtime_error past the end.
+  uint64_t ReadUnary() {
+    uint64_t zeros = 0;
+    while (true) {
+      const uint64_t window = Peek64();
+      if (window != 0) {
+        const size_t n = __builtin_clzll(window);
+        zeros += n;
+        pos_ += n + 1;
+        break;
+      }
+      zeros += 64;
+      pos_ += 64;
+      if (pos_ > num_bits_) {
+        break;
+      }
+    }
+    if (pos_ > num_bits_) {
+      throw std::runtime_error("Truncated bit stream.");
+    }
+    return zeros;
+  }
+
+  // Skips to the next byte boundary.
+  void AlignToByte() { pos_ = (pos_ + 7) & ~size_t(7); }
+
+  size_t position() const { return pos_; }
+  bool done() const { return pos_ == num_bits_; }
+
+ private:
+  uint64_t Peek64() const {
+    const size_t word = pos_ >> 6;
+    const size_t shift = pos_ & 63;
+    uint64_t window = words_[word] << shift;
+    if (shift != 0) {
+      window |= words_[word + 1] >> (64 - shift);
+    }
+    return window;
+  }
+
+  // Padded with a zero word so that Peek64 may read past the last bit.
+  std::vector<uint64_t> words_;
+  size_t num_bits_;
+  size_t pos_{0};
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_BIT_READER_H_ */
@@ -0,0 +1,315 @@
+/*
+ * bit_statistics.cpp
+ */
+
+#include "bit_statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+#include <utility>
+
+#include "../base/thread_pool.h"
+
+using namespace std;
+
+namespace signal_content {
+using base::ThreadPool;
+using base::VFrameView;
+namespace codec {
+
+namespace {
+
+typedef uint64_t Word;
+const size_t kWordBits = 64;
+
+// Frames handed to a worker at a time. A multiple of the 64-frame block.
+const size_t kFramesPerWorkItem = 64 * 1024;
+
+inline uint64_t PopCount(Word w) {
+  return __builtin_popcountll(w);
+}
+
+// The pairwise counts are W * (W + 1) / 2 popcounts per 64 frames, so they
+// are worth a version compiled for the popcnt instruction, chosen at runtime.
+__attribute__((always_inline)) inline void AccumulatePairsImpl(
+    const Word* columns, size_t frame_size, uint64_t* co_ones) {
+  for (size_t a = 0; a < frame_size; ++a) {
+    const Word column_a = columns[a];
+    for (size_t b = a; b < frame_size; ++b) {
+      *co_ones++ += __builtin_popcountll(column_a & columns[b]);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("popcnt"))) void AccumulatePairsPopcnt(
+    const Word* columns, size_t frame_size, uint64_t* co_ones) {
+  AccumulatePairsImpl(columns, frame_size, co_ones);
+}
+#endif
+
+void AccumulatePairsGeneric(const Word* columns, size_t frame_size,
+                            uint64_t* co_ones) {
+  AccumulatePairsImpl(columns, frame_size, co_ones);
+}
+
+void AccumulatePairs(const Word* columns, size_t frame_size,
+                     uint64_t* co_ones) {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool has_popcnt = __builtin_cpu_supports("popcnt");
+  if (has_popcnt) {
+    AccumulatePairsPopcnt(columns, frame_size, co_ones);
+    return;
+  }
+#endif
+  AccumulatePairsGeneric(columns, frame_size, co_ones);
+}
+
+}  // namespace
+
+void Transpose64(uint64_t rows[64]) {
+  // Swap progressively smaller off-diagonal blocks: 32x32, then 16x16, ...
+  Word mask = 0x00000000FFFFFFFFULL;
+  for (size_t j = 32; j != 0; j >>= 1, mask ^= mask << j) {
+    for (size_t k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+      const Word t = (rows[k] ^ (rows[k | j] >> j)) & mask;
+      rows[k] ^= t;
+      rows[k | j] ^= t << j;
+    }
+  }
+}
+
+BitStatistics::BitStatistics(size_t frame_size, bool pairwise)
+    : frame_size_(frame_size), pairwise_(pairwise),
+      ones_(frame_size, 0), toggles_(frame_size, 0),
+      x_count_(frame_size, 0), z_count_(frame_size, 0),
+      one_columns_(frame_size, 0) {
+  if (pairwise_) {
+    co_ones_.assign(frame_size * (frame_size + 1) / 2, 0);
+  }
+}
+
+void BitStatistics::AddFrames(const VFrameView& frames) {
+  if (frames.frame_size() != frame_size_) {
+    throw invalid_argument("Frame size mismatch.");
+  }
+  for (size_t first = 0; first < frames.num_frames(); first += kWordBits) {
+    const size_t remaining = frames.num_frames() - first;
+    AddBlock(frames, first, remaining < kWordBits ? remaining : kWordBits);
+    if (first > 0) {
+      AddTransition(frames, first);
+    }
+  }
+}
+
+void BitStatistics::AddBlock(const VFrameView& frames, size_t first_frame,
+                             size_t num_frames) {
+  const bool has_unknowns = frames.bits().HasUnknownPlane();
+  const Word valid = ~Word(0) << (kWordBits - num_frames);
+  // Frame f sits at bit 63 - f of a column, so a column XORed with itself
+  // shifted left by one holds the toggle from frame f to f + 1 at bit 63 - f.
+  const Word valid_pairs = valid << 1;
+  Word values[kWordBits];
+  Word unknowns[kWordBits];
+
+  for (size_t slice = 0; slice < frame_size_; slice += kWordBits) {
+    const size_t width = (frame_size_ - slice < kWordBits) ?
+        frame_size_ - slice : kWordBits;
+    const base::PackedFv& bits = frames.bits();
+    for (size_t f = 0; f < kWordBits; ++f) {
+      if (f < num_frames) {
+        const size_t start = frames.FrameStart(first_frame + f) + slice;
+        values[f] = bits.PeekValueBits(start, width) << (kWordBits - width);
+        unknowns[f] = has_unknowns ?
+            bits.PeekUnknownBits(start, width) << (kWordBits - width) : 0;
+      } else {
+        values[f] = 0;
+        unknowns[f] = 0;
+      }
+    }
+    Transpose64(values);
+    if (has_unknowns) {
+      Transpose64(unknowns);
+    }
+    for (size_t b = 0; b < width; ++b) {
+      const size_t bit = slice + b;
+      const Word one = values[b] & ~unknowns[b];
+      const Word x = ~values[b] & unknowns[b] & valid;
+      const Word z = values[b] & unknowns[b];
+      ones_[bit] += PopCount(one);
+      x_count_[bit] += PopCount(x);
+      z_count_[bit] += PopCount(z);
+      toggles_[bit] += PopCount((one ^ (one << 1)) & valid_pairs);
+      one_columns_[bit] = one;
+    }
+  }
+
+  if (pairwise_) {
+    AccumulatePairs(one_columns_.data(), frame_size_, co_ones_.data());
+  }
+  num_frames_ += num_frames;
+  num_transitions_ += num_frames - 1;
+}
+
+void BitStatistics::AddTransition(const VFrameView& frames, size_t frame_num) {
+  for (size_t slice = 0; slice < frame_size_; slice += kWordBits) {
+    const size_t width = (frame_size_ - slice < kWordBits) ?
+        frame_size_ - slice : kWordBits;
+    const Word diff = frames.PeekBits(frame_num - 1, slice, width) ^
+                      frames.PeekBits(frame_num, slice, width);
+    for (size_t b = 0; b < width; ++b) {
+      toggles_[slice + b] += (diff >> (width - 1 - b)) & 0x1;
+    }
+  }
+  ++num_transitions_;
+}
+
+void BitStatistics::Merge(const BitStatistics& other) {
+  if (other.frame_size_ != frame_size_ || other.pairwise_ != pairwise_) {
+    throw invalid_argument("Cannot merge mismatched bit statistics.");
+  }
+  num_frames_ += other.num_frames_;
+  num_transitions_ += other.num_transitions_;
+  for (size_t bit = 0; bit < frame_size_; ++bit) {
+    ones_[bit] += other.ones_[bit];
+    toggles_[bit] += other.toggles_[bit];
+    x_count_[bit] += other.x_count_[bit];
+    z_count_[bit] += other.z_count_[bit];
+  }
+  for (size_t i = 0; i < co_ones_.size(); ++i) {
+    co_ones_[i] += other.co_ones_[i];
+  }
+}
+
+size_t BitStatistics::PairIndex(size_t bit_a, size_t bit_b) const {
+  if (bit_a > bit_b) {
+    swap(bit_a, bit_b);
+  }
+  // Rows 0..bit_a-1 hold frame_size_, frame_size_ - 1, ... entries.
+  return bit_a * frame_size_ - bit_a * (bit_a - 1) / 2 + (bit_b - bit_a);
+}
+
+uint64_t BitStatistics::co_ones(size_t bit_a, size_t bit_b) const {
+  if (!pairwise_) {
+    throw logic_error("Pairwise statistics were not collected.");
+  }
+  return co_ones_[PairIndex(bit_a, bit_b)];
+}
+
+double BitStatistics::OneProbability(size_t bit) const {
+  return num_frames_ ? double(ones_[bit]) / num_frames_ : 0.0;
+}
+
+double BitStatistics::ToggleRate(size_t bit) const {
+  return num_transitions_ ? double(toggles_[bit]) / num_transitions_ : 0.0;
+}
+
+double BitStatistics::XRate(size_t bit) const {
+  return num_frames_ ? double(x_count_[bit]) / num_frames_ : 0.0;
+}
+
+double BitStatistics::ZRate(size_t bit) const {
+  return num_frames_ ? double(z_count_[bit]) / num_frames_ : 0.0;
+}
+
+double BitStatistics::Correlation(size_t bit_a, size_t bit_b) const {
+  const double n = double(num_frames_);
+  const double a = double(ones_[bit_a]);
+  const double b = double(ones_[bit_b]);
+  const double denominator = sqrt(a * (n - a) * b * (n - b));
+  if (denominator == 0.0) {
+    return 0.0;
+  }
+  return (n * double(co_ones(bit_a, bit_b)) - a * b) / denominator;
+}
+
+void BitStatistics::PrintReport(ostream& os, const vector<string>& bit_names,
+                                size_t top_pairs) const {
+  os << "Frames: " << num_frames_ << "\n";
+  os << "Frame size: " << frame_size_ << " bits\n";
+  os << setw(10) << "bit" << setw(12) << "P(1)" << setw(12) << "toggle"
+     << setw(12) << "P(X)" << setw(12) << "P(Z)" << "\n";
+  os << fixed << setprecision(6);
+  for (size_t bit = 0; bit < frame_size_; ++bit) {
+    const string name = bit < bit_names.size() ? bit_names[bit] :
+        to_string(bit);
+    os << setw(10) << name << setw(12) << OneProbability(bit)
+       << setw(12) << ToggleRate(bit) << setw(12) << XRate(bit)
+       << setw(12) << ZRate(bit) << "\n";
+  }
+
+  if (pairwise_ && top_pairs > 0 && frame_size_ > 1) {
+    vector<pair<double, pair<size_t, size_t>>> pairs;
+    for (size_t a = 0; a < frame_size_; ++a) {
+      for (size_t b = a + 1; b < frame_size_; ++b) {
+        pairs.push_back(make_pair(Correlation(a, b), make_pair(a, b)));
+      }
+    }
+    const size_t shown = min(top_pairs, pairs.size());
+    partial_sort(pairs.begin(), pairs.begin() + shown, pairs.end(),
+                 [] (const pair<double, pair<size_t, size_t>>& l,
+                     const pair<double, pair<size_t, size_t>>& r) {
+                   return fabs(l.first) > fabs(r.first);
+                 });
+    os << "Most correlated bit pairs:\n";
+    for (size_t i = 0; i < shown; ++i) {
+      const size_t a = pairs[i].second.first;
+      const size_t b = pairs[i].second.second;
+      os << setw(10) << (a < bit_names.size() ? bit_names[a] : to_string(a))
+         << setw(10) << (b < bit_names.size() ? bit_names[b] : to_string(b))
+         << setw(12) << pairs[i].first << "\n";
+    }
+  }
+  os.unsetf(ios::floatfield);
+}
+
+BitStatistics ComputeBitStatistics(const vector<VFrameView>& streams,
+                                   bool pairwise, size_t num_threads) {
+  if (streams.empty()) {
+    throw invalid_argument("No streams to analyse.");
+  }
+  const size_t frame_size = streams.front().frame_size();
+
+  // Work items are (stream, first frame, frame count).
+  struct WorkItem {
+    size_t stream;
+    size_t first_frame;
+    size_t num_frames;
+  };
+  vector<WorkItem> items;
+  for (size_t s = 0; s < streams.size(); ++s) {
+    if (streams[s].frame_size() != frame_size) {
+      throw invalid_argument("Streams must share a frame size.");
+    }
+    for (size_t first = 0; first < streams[s].num_frames();
+         first += kFramesPerWorkItem) {
+      const size_t remaining = streams[s].num_frames() - first;
+      WorkItem item = {s, first, min(remaining, kFramesPerWorkItem)};
+      items.push_back(item);
+    }
+  }
+
+  num_threads = ThreadPool::WorkersFor(items.size(), num_threads);
+
+  vector<BitStatistics> partials(num_threads,
+                                 BitStatistics(frame_size, pairwise));
+  ThreadPool::RunParallel(items.size(), num_threads,
+                          [&] (size_t worker, size_t i) {
+    const VFrameView& stream = streams[items[i].stream];
+    partials[worker].AddFrames(stream.Subview(items[i].first_frame,
+                                              items[i].num_frames));
+    if (items[i].first_frame > 0) {
+      partials[worker].AddTransition(stream, items[i].first_frame);
+    }
+  });
+
+  for (size_t t = 1; t < num_threads; ++t) {
+    partials[0].Merge(partials[t]);
+  }
+  return partials[0];
+}
+
+}  // namespace codec
+}  // namespace signal_content
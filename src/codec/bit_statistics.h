@@ -0,0 +1,107 @@
+/*
+ * bit_statistics.h
+ *
+ * Per-bit-position statistics over streams of frames: the probability of a
+ * one, the toggle rate between consecutive frames, X and Z occurrence, and
+ * the pairwise correlation between bit positions.
+ *
+ * Frames are processed 64 at a time. Each block is bit-transposed so that
+ * one 64-bit word holds a single bit position across 64 frames, after which
+ * every statistic is a popcount over whole words.
+ *
+ * Accumulators are mergeable, and ComputeBitStatistics splits streams over
+ * worker threads with one accumulator each.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_BIT_STATISTICS_H_
+#define SIGNAL_CONTENT_CODEC_BIT_STATISTICS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../base/frame_view.h"
+
+namespace signal_content {
+namespace codec {
+
+class BitStatistics {
+ public:
+  // Pairwise statistics cost O(frame_size^2) per 64 frames, so they are
+  // optional.
+  BitStatistics(size_t frame_size, bool pairwise);
+
+  // Accumulates a run of consecutive frames. Toggles are counted between
+  // consecutive frames of the run, but not against earlier runs.
+  void AddFrames(const base::VFrameView& frames);
+
+  // Counts the toggles between frames 'frame_num' - 1 and 'frame_num' of
+  // 'frames'. Used to stitch together a stream that was split into runs.
+  void AddTransition(const base::VFrameView& frames, size_t frame_num);
+
+  // Adds the counts of an accumulator over the same frame size.
+  void Merge(const BitStatistics& other);
+
+  size_t frame_size() const { return frame_size_; }
+  bool pairwise() const { return pairwise_; }
+  uint64_t num_frames() const { return num_frames_; }
+  uint64_t num_transitions() const { return num_transitions_; }
+  uint64_t ones(size_t bit) const { return ones_[bit]; }
+  uint64_t toggles(size_t bit) const { return toggles_[bit]; }
+  uint64_t x_count(size_t bit) const { return x_count_[bit]; }
+  uint64_t z_count(size_t bit) const { return z_count_[bit]; }
+  // Number of frames in which both bits were ONE.
+  uint64_t co_ones(size_t bit_a, size_t bit_b) const;
+
+  double OneProbability(size_t bit) const;
+  double ToggleRate(size_t bit) const;
+  double XRate(size_t bit) const;
+  double ZRate(size_t bit) const;
+  // Pearson (phi) correlation between two bit positions, treating X and Z as
+  // zero. Constant bits have a correlation of zero with everything.
+  double Correlation(size_t bit_a, size_t bit_b) const;
+
+  // Writes a per-bit table and, if pairwise, the 'top_pairs' most strongly
+  // correlated pairs. 'bit_names' may be empty.
+  void PrintReport(std::ostream& os, const std::vector<std::string>& bit_names,
+                   size_t top_pairs) const;
+
+ private:
+  // Accumulates up to 64 frames starting at 'first_frame'.
+  void AddBlock(const base::VFrameView& frames, size_t first_frame,
+                size_t num_frames);
+
+  size_t PairIndex(size_t bit_a, size_t bit_b) const;
+
+  size_t frame_size_;
+  bool pairwise_;
+  uint64_t num_frames_{0};
+  uint64_t num_transitions_{0};
+  std::vector<uint64_t> ones_;
+  std::vector<uint64_t> toggles_;
+  std::vector<uint64_t> x_count_;
+  std::vector<uint64_t> z_count_;
+  // Upper triangle, including the diagonal, in row-major order.
+  std::vector<uint64_t> co_ones_;
+  // Scratch space for the ONE columns of a transposed block, one word per bit
+  // position.
+  std::vector<uint64_t> one_columns_;
+};
+
+// Transposes a 64x64 bit matrix in place. Row r, column c is bit 63 - c of
+// rows[r] on input and bit 63 - r of rows[c] on output.
+void Transpose64(uint64_t rows[64]);
+
+// Computes statistics over independent streams of equal frame size using
+// 'num_threads' workers (0 means one per hardware thread). Long streams are
+// split between workers without losing the toggles at the split points.
+BitStatistics ComputeBitStatistics(
+    const std::vector<base::VFrameView>& streams, bool pairwise,
+    size_t num_threads);
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_BIT_STATISTICS_H_ */
@@ -0,0 +1,77 @@
+/*
+ * bit_writer.h
+ *
+ * Writes a stream of variable-length codes into a caller-provided byte
+ * buffer. Bits accumulate in a 64-bit register that is stored eight bytes at
+ * a time, so appending a code costs a few shifts rather than a per-bit loop.
+ * The first bit of the stream is bit 7 of the first byte.
+ *
+ * The buffer is not bounds-checked; callers size it from the exact number of
+ * bits they will write.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_BIT_WRITER_H_
+#define SIGNAL_CONTENT_CODEC_BIT_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace signal_content {
+namespace codec {
+
+class BitWriter {
+ public:
+  explicit BitWriter(uint8_t* out) : out_(out) {}
+
+  // Bytes needed to hold 'num_bits' bits.
+  static size_t BytesForBits(size_t num_bits) { return (num_bits + 7) / 8; }
+
+  // Appends the low 'n' bits of 'bits', most significant first. Bits of
+  // 'bits' above the low 'n' must be zero. 0 < n <= 64.
+  void Write(uint64_t bits, size_t n) {
+    const size_t free = 64 - pending_;
+    if (n < free) {
+      buffer_ |= bits << (free - n);
+      pending_ += n;
+      return;
+    }
+    buffer_ |= bits >> (n - free);
+    StoreWord(buffer_);
+    pending_ = n - free;
+    buffer_ = (pending_ == 0) ? 0 : bits << (64 - pending_);
+  }
+
+  // Stores the bits still in the register, zero-padding the last byte. Must
+  // be called once, after the last Write.
+  void Flush() {
+    for (size_t i = 0; i < BytesForBits(pending_); ++i) {
+      *out_++ = static_cast<uint8_t>(buffer_ >> (56 - 8 * i));
+    }
+    bits_written_ += pending_;
+    buffer_ = 0;
+    pending_ = 0;
+  }
+
+  // Bits written so far, including those still in the register.
+  size_t bits_written() const { return bits_written_ + pending_; }
+
+ private:
+  void StoreWord(uint64_t word) {
+    for (int i = 0; i < 8; ++i) {
+      out_[i] = static_cast<uint8_t>(word >> (56 - 8 * i));
+    }
+    out_ += 8;
+    bits_written_ += 64;
+  }
+
+  uint8_t* out_;
+  // Pending bits, left-aligned.
+  uint64_t buffer_{0};
+  size_t pending_{0};
+  size_t bits_written_{0};
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_BIT_WRITER_H_ */
@@ -0,0 +1,418 @@
+/*
+ * context_mixing.cpp
+ */
+
+#include "context_mixing.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../base/thread_pool.h"
+
+using namespace std;
+
+namespace signal_content {
+using base::PackedFv;
+using base::ThreadPool;
+namespace codec {
+
+namespace {
+
+// The number of bits, as a 64-bit big-endian integer.
+const size_t kHeaderBytes = 8;
+// Even at the most extreme probability a bit costs more than 1/65536 of an
+// encoded bit, which bounds the length a header may claim.
+const uint64_t kMaxBitsPerByte = 65536;
+
+// Frames up to this many bits give every prefix of a frame a table entry of
+// its own; larger contexts are hashed into tables of this many entries.
+const int kMaxTableBits = 18;
+const int kNumModels = 2;
+// The models' predictions and a constant bias.
+const int kNumInputs = kNumModels + 1;
+// Bits of the previous-frame model's context besides the position.
+const int kFrameContextBits = 11;
+// Mixer weights are chosen by the position modulo this and the previous
+// frame's bit at the position.
+const size_t kMixerPositions = 1024;
+// Weights are 16.16 fixed point, kept within +-kMaxWeight so that the dot
+// product of kNumInputs 12-bit inputs fits in 32 bits; the bias input starts
+// at zero weight.
+const int kInitialWeight = 1 << 15;
+const int kMaxWeight = 1 << 18;
+// Probabilities adapt at a rate of about 1 / (count + 1.5), and the count
+// stops here, so that old contexts still follow the data.
+const uint32_t kCountLimit = 1023;
+
+// Stretch (the logit, scaled by 256) and squash (its inverse) between 12-bit
+// probabilities and the mixing domain, and the adaptation rates by count.
+struct LogisticTables {
+  LogisticTables() {
+    // Samples of 4096 / (1 + e^-x) at x = -8, -7.5, ..., 8.
+    static const int kSamples[33] = {
+        1, 2, 3, 6, 10, 16, 27, 45, 73, 120, 194, 310, 488, 747, 1101, 1546,
+        2047, 2549, 2994, 3348, 3607, 3785, 3901, 3975, 4022, 4050, 4068,
+        4079, 4085, 4089, 4092, 4093, 4094};
+    for (int d = -2047; d <= 2047; ++d) {
+      const int w = d & 127;
+      const int i = (d >> 7) + 16;
+      squash[d + 2047] = (kSamples[i] * (128 - w) + kSamples[i + 1] * w +
+                          64) >> 7;
+    }
+    int p = 0;
+    for (int d = -2047; d <= 2047; ++d) {
+      for (; p <= squash[d + 2047]; ++p) {
+        stretch[p] = d;
+      }
+    }
+    for (; p < 4096; ++p) {
+      stretch[p] = 2047;
+    }
+    for (uint32_t n = 0; n < 1024; ++n) {
+      rate[n] = 16384 / (n + n + 3);
+    }
+  }
+
+  int Squash(int d) const {
+    return squash[min(max(d, -2047), 2047) + 2047];
+  }
+
+  int squash[4095];
+  int stretch[4096];
+  uint32_t rate[1024];
+};
+
+const LogisticTables kLogistic;
+
+inline uint32_t HashContext(uint32_t position, uint32_t context,
+                            uint32_t model) {
+  uint32_t h = position * 0x9E3779B1u ^ (context + 1) * 0x85EBCA6Bu ^
+               (model + 1) * 0xC2B2AE35u;
+  h ^= h >> 15;
+  h *= 0x2C1B3C6Du;
+  return h ^ (h >> 12);
+}
+
+// Predicts each bit of a stream from the bits before it. The encoder and
+// decoder run identical predictors, calling Code for every bit, from a new
+// or Reset predictor.
+class BitPredictor {
+ public:
+  explicit BitPredictor(size_t frame_size)
+      : frame_size_(frame_size),
+        weights_(min(frame_size, kMixerPositions) * 2 * kNumInputs),
+        current_(frame_size + 4), previous_(frame_size + 4),
+        before_previous_(frame_size + 4) {
+    int position_bits = 0;
+    while ((size_t(1) << position_bits) < frame_size) {
+      ++position_bits;
+    }
+    // The first model's context is the frame so far, with an entry per
+    // prefix: the position's bit above the bits before it.
+    direct_[0] = (frame_size <= size_t(kMaxTableBits));
+    direct_[1] = (position_bits + kFrameContextBits <= kMaxTableBits);
+    const int table_bits[kNumModels] = {
+        direct_[0] ? static_cast<int>(frame_size) : kMaxTableBits,
+        min(position_bits + kFrameContextBits, kMaxTableBits)};
+    for (int m = 0; m < kNumModels; ++m) {
+      tables_[m].resize(size_t(1) << table_bits[m]);
+      masks_[m] = (1u << table_bits[m]) - 1;
+    }
+    Reset();
+  }
+
+  // Forgets everything learned, as if new.
+  void Reset() {
+    for (int m = 0; m < kNumModels; ++m) {
+      // Probability one half, count zero.
+      fill(tables_[m].begin(), tables_[m].end(), 1u << 31);
+    }
+    for (size_t set = 0; set < weights_.size(); set += kNumInputs) {
+      fill(&weights_[set], &weights_[set] + kNumModels, kInitialWeight);
+      weights_[set + kNumModels] = 0;
+    }
+    fill(current_.begin(), current_.end(), 0);
+    fill(previous_.begin(), previous_.end(), 0);
+    fill(before_previous_.begin(), before_previous_.end(), 0);
+    pos_ = 0;
+    history_ = 0;
+  }
+
+  // Predicts the next bit and returns code(p), the bit, where p is the
+  // probability that it is a one in 4096ths, from 1 to 4095; then learns
+  // from it.
+  template <typename CodeFn>
+  int Code(CodeFn code) {
+    const uint8_t* previous = &previous_[pos_ + 2];
+    const uint8_t* before_previous = &before_previous_[pos_ + 2];
+    const uint32_t position = static_cast<uint32_t>(pos_);
+    // The previous frame's bits from two positions before to two after, the
+    // frame before's from one before to one after, and the last 3 bits coded
+    // in the frame.
+    const uint32_t frame_context =
+        uint32_t(previous[-2]) << 10 | previous[-1] << 9 | previous[0] << 8 |
+        previous[1] << 7 | previous[2] << 6 | before_previous[-1] << 5 |
+        before_previous[0] << 4 | before_previous[1] << 3 | (history_ & 0x7);
+    const uint32_t indices[kNumModels] = {
+        direct_[0] ? (1u << position) | history_ :
+                     HashContext(position, history_, 0),
+        direct_[1] ? (position << kFrameContextBits) | frame_context :
+                     HashContext(position, frame_context, 1)};
+    uint32_t* slots[kNumModels];
+    uint32_t states[kNumModels];
+    int inputs[kNumInputs];
+    for (int m = 0; m < kNumModels; ++m) {
+      slots[m] = &tables_[m][indices[m] & masks_[m]];
+      states[m] = *slots[m];
+      inputs[m] = kLogistic.stretch[states[m] >> 20];
+    }
+    inputs[kNumModels] = 256;
+
+    int* mixer = &weights_[((pos_ % kMixerPositions) * 2 + previous[0]) *
+                           kNumInputs];
+    int dot = 0;
+    for (int i = 0; i < kNumInputs; ++i) {
+      dot += inputs[i] * mixer[i];
+    }
+    const int mixed = kLogistic.Squash(dot >> 16);
+    const int bit = code(mixed);
+
+    for (int m = 0; m < kNumModels; ++m) {
+      // The probability is in the high 22 bits and the count in the low 10.
+      const uint32_t count = states[m] & 1023;
+      const int p = static_cast<int>(states[m] >> 10);
+      // Unsigned, so that a step down wraps rather than overflows.
+      *slots[m] = states[m] + ((static_cast<uint32_t>(((bit << 22) - p) >> 3) *
+                           kLogistic.rate[count]) & 0xFFFFFC00u) +
+                  (count < kCountLimit);
+    }
+    const int error = (bit << 12) - mixed;
+    for (int i = 0; i < kNumInputs; ++i) {
+      mixer[i] = min(max(mixer[i] + ((inputs[i] * error) >> 12),
+                         -kMaxWeight), kMaxWeight);
+    }
+
+    current_[pos_ + 2] = static_cast<uint8_t>(bit);
+    history_ = (history_ << 1) | bit;
+    if (++pos_ == frame_size_) {
+      pos_ = 0;
+      history_ = 0;
+      before_previous_.swap(previous_);
+      previous_.swap(current_);
+    }
+    return bit;
+  }
+
+ private:
+  size_t frame_size_;
+  // Per model: whether contexts index the table directly or are hashed, and
+  // the table and its index mask.
+  bool direct_[kNumModels];
+  vector<uint32_t> tables_[kNumModels];
+  uint32_t masks_[kNumModels];
+  vector<int> weights_;
+  // Position in the frame, and the bits coded in the frame so far.
+  size_t pos_{0};
+  uint32_t history_{0};
+  // The bits of the current, previous and next older frames, with two
+  // zeroes either side.
+  vector<uint8_t> current_;
+  vector<uint8_t> previous_;
+  vector<uint8_t> before_previous_;
+};
+
+// Carry-less binary arithmetic coding: the interval [x1, x2] is split in
+// proportion to the probability of a one, and bytes leave from the top as
+// soon as both ends agree on them.
+class ArithmeticEncoder {
+ public:
+  explicit ArithmeticEncoder(vector<uint8_t>* out) : out_(out) {}
+
+  void Encode(int bit, int probability) {
+    const uint32_t mid = x1_ + ((x2_ - x1_) >> 12) * probability;
+    // Selects rather than branches, as the bit is hard to predict.
+    x2_ = bit ? mid : x2_;
+    x1_ = bit ? x1_ : mid + 1;
+    while (((x1_ ^ x2_) & 0xFF000000u) == 0) {
+      out_->push_back(static_cast<uint8_t>(x2_ >> 24));
+      x1_ <<= 8;
+      x2_ = (x2_ << 8) | 0xFF;
+    }
+  }
+
+  void Flush() {
+    for (int i = 0; i < 4; ++i) {
+      out_->push_back(static_cast<uint8_t>(x1_ >> (24 - 8 * i)));
+    }
+  }
+
+ private:
+  vector<uint8_t>* out_;
+  uint32_t x1_{0};
+  uint32_t x2_{0xFFFFFFFFu};
+};
+
+class ArithmeticDecoder {
+ public:
+  ArithmeticDecoder(const uint8_t* bytes, size_t num_bytes)
+      : bytes_(bytes), end_(bytes + num_bytes) {
+    for (int i = 0; i < 4; ++i) {
+      x_ = (x_ << 8) | NextByte();
+    }
+  }
+
+  int Decode(int probability) {
+    const uint32_t mid = x1_ + ((x2_ - x1_) >> 12) * probability;
+    const int bit = (x_ <= mid);
+    x2_ = bit ? mid : x2_;
+    x1_ = bit ? x1_ : mid + 1;
+    while (((x1_ ^ x2_) & 0xFF000000u) == 0) {
+      x1_ <<= 8;
+      x2_ = (x2_ << 8) | 0xFF;
+      x_ = (x_ << 8) | NextByte();
+    }
+    return bit;
+  }
+
+ private:
+  // Zeroes past the end.
+  uint32_t NextByte() { return (bytes_ < end_) ? *bytes_++ : 0; }
+
+  const uint8_t* bytes_;
+  const uint8_t* end_;
+  uint32_t x1_{0};
+  uint32_t x2_{0xFFFFFFFFu};
+  uint32_t x_{0};
+};
+
+// Encodes bits [begin, end) of 'bits' with 'predictor', which must be new or
+// Reset.
+vector<uint8_t> EncodeWith(const PackedFv& bits, size_t begin, size_t end,
+                            BitPredictor* predictor) {
+  const uint64_t num_bits = end - begin;
+  vector<uint8_t> encoded(kHeaderBytes);
+  for (size_t i = 0; i < kHeaderBytes; ++i) {
+    encoded[i] = static_cast<uint8_t>(num_bits >> (56 - 8 * i));
+  }
+  ArithmeticEncoder encoder(&encoded);
+  for (size_t pos = begin; pos < end; pos += 64) {
+    const size_t n = min(size_t(64), end - pos);
+    const uint64_t word = bits.PeekBits(pos, n);
+    for (size_t i = n; i-- > 0;) {
+      const int bit = static_cast<int>((word >> i) & 1);
+      predictor->Code([&encoder, bit] (int probability) {
+        encoder.Encode(bit, probability);
+        return bit;
+      });
+    }
+  }
+  encoder.Flush();
+  return encoded;
+}
+
+// Decodes 'encoded' with 'predictor', which must be new or Reset.
+PackedFv DecodeWith(const vector<uint8_t>& encoded, BitPredictor* predictor) {
+  if (encoded.size() < kHeaderBytes) {
+    throw runtime_error("Truncated context mixing header.");
+  }
+  uint64_t num_bits = 0;
+  for (size_t i = 0; i < kHeaderBytes; ++i) {
+    num_bits = (num_bits << 8) | encoded[i];
+  }
+  const size_t payload_bytes = encoded.size() - kHeaderBytes;
+  if (num_bits / kMaxBitsPerByte > payload_bytes) {
+    throw runtime_error("Bit count exceeds the data.");
+  }
+  ArithmeticDecoder decoder(encoded.data() + kHeaderBytes, payload_bytes);
+  PackedFv bits;
+  bits.reserve(num_bits);
+  for (uint64_t pos = 0; pos < num_bits; pos += 64) {
+    const size_t n = static_cast<size_t>(min<uint64_t>(64, num_bits - pos));
+    uint64_t word = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const int bit = predictor->Code([&decoder] (int probability) {
+        return decoder.Decode(probability);
+      });
+      word = (word << 1) | bit;
+    }
+    bits.PushBits(word, n);
+  }
+  return bits;
+}
+
+}  // namespace
+
+size_t ContextMixingBlocks::TotalBytes() const {
+  size_t total = 0;
+  for (const vector<uint8_t>& block : blocks) {
+    total += block.size();
+  }
+  return total;
+}
+
+ContextMixingCodec::ContextMixingCodec(size_t frame_size)
+    : frame_size_(frame_size) {
+  if (frame_size == 0) {
+    throw invalid_argument("Frame size must be positive.");
+  }
+}
+
+vector<uint8_t> ContextMixingCodec::Encode(const PackedFv& bits) const {
+  BitPredictor predictor(frame_size_);
+  return EncodeWith(bits, 0, bits.size(), &predictor);
+}
+
+PackedFv ContextMixingCodec::Decode(const vector<uint8_t>& encoded) const {
+  BitPredictor predictor(frame_size_);
+  return DecodeWith(encoded, &predictor);
+}
+
+ContextMixingBlocks ContextMixingCodec::EncodeBlocks(
+    const PackedFv& bits, size_t frames_per_block, size_t num_threads) const {
+  if (frames_per_block == 0) {
+    throw invalid_argument("Blocks must hold at least one frame.");
+  }
+  ContextMixingBlocks blocks;
+  blocks.frames_per_block = frames_per_block;
+  const size_t block_bits = frames_per_block * frame_size_;
+  blocks.blocks.resize((bits.size() + block_bits - 1) / block_bits);
+  num_threads = ThreadPool::WorkersFor(blocks.num_blocks(), num_threads);
+
+  // One predictor per worker, reset between its blocks.
+  vector<BitPredictor> predictors(num_threads, BitPredictor(frame_size_));
+  ThreadPool::RunParallel(blocks.num_blocks(), num_threads,
+                          [&] (size_t worker, size_t block) {
+    BitPredictor& predictor = predictors[worker];
+    predictor.Reset();
+    const size_t begin = block * block_bits;
+    blocks.blocks[block] = EncodeWith(
+        bits, begin, min(bits.size(), begin + block_bits), &predictor);
+  });
+  return blocks;
+}
+
+PackedFv ContextMixingCodec::DecodeBlocks(const ContextMixingBlocks& blocks,
+                                          size_t num_threads) const {
+  vector<PackedFv> decoded(blocks.num_blocks());
+  num_threads = ThreadPool::WorkersFor(blocks.num_blocks(), num_threads);
+  vector<BitPredictor> predictors(num_threads, BitPredictor(frame_size_));
+  ThreadPool::RunParallel(blocks.num_blocks(), num_threads,
+                          [&] (size_t worker, size_t block) {
+    BitPredictor& predictor = predictors[worker];
+    predictor.Reset();
+    decoded[block] = DecodeWith(blocks.blocks[block], &predictor);
+  });
+  // Every block but the last is whole, or the stream would not line up.
+  const size_t block_bits = blocks.frames_per_block * frame_size_;
+  PackedFv bits;
+  for (size_t block = 0; block < decoded.size(); ++block) {
+    if (block + 1 < decoded.size() && decoded[block].size() != block_bits) {
+      throw runtime_error("Context mixing block has the wrong length.");
+    }
+    bits.Append(decoded[block]);
+  }
+  return bits;
+}
+
+}  // namespace codec
+}  // namespace signal_content
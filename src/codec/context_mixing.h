@@ -0,0 +1,94 @@
+/*
+ * context_mixing.h
+ *
+ * Adaptive binary arithmetic coding of a bit stream cut into frames of a
+ * fixed size, such as memory images or bus captures. Every bit is coded with
+ * a probability that two models predict from what came before, so that
+ * correlations between the bits of a frame, which a symbol-wise code cannot
+ * see, are exploited. It needs no training and serves as a near-best ratio
+ * to judge the other codecs against.
+ *
+ * Each model maps a context to an adaptive probability. Both contexts
+ * include the position of the bit in its frame, and add:
+ *
+ *   - the bits coded in the frame so far, so that every prefix of a frame
+ *     up to 18 bits has a probability of its own, and
+ *   - the previous frame's bits from two positions before to two after, the
+ *     frame before's from one before to one after, and the last 3 bits coded
+ *     in the frame.
+ *
+ * The predictions are combined by logistic mixing: a weighted sum in the
+ * stretched (logit) domain, in 32-bit integers with clamped weights chosen
+ * by the position and the previous frame's bit and trained online to reduce
+ * coding cost. The arithmetic coder is carry-less with 32-bit state and
+ * 12-bit probabilities.
+ *
+ * Contexts that fit index tables of up to 2^18 entries directly; larger
+ * ones are hashed into them. X and Z are treated as zeroes, as by the other
+ * entropy coders.
+ *
+ * Coding is serial within a stream, each bit depending on every bit before
+ * it, and costs some 15 to 25 ns a bit on a current x86 core: 4 to 7 MB/s,
+ * of which the arithmetic coder alone takes about a third. The codec is a
+ * ratio reference, not a line-rate coder. EncodeBlocks instead cuts the
+ * stream into blocks of whole frames that are coded independently, so that
+ * blocks code and decode in parallel and any one decodes on its own; each
+ * worker reuses one predictor, reset between blocks, and each block pays for
+ * learning its statistics afresh.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_CONTEXT_MIXING_H_
+#define SIGNAL_CONTENT_CODEC_CONTEXT_MIXING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../base/packed_fv.h"
+
+namespace signal_content {
+namespace codec {
+
+// A stream coded as independent blocks. Each block is an encoding as
+// returned by ContextMixingCodec::Encode.
+struct ContextMixingBlocks {
+  size_t num_blocks() const { return blocks.size(); }
+  // Encoded size, including each block's length header.
+  size_t TotalBytes() const;
+
+  size_t frames_per_block;
+  std::vector<std::vector<uint8_t>> blocks;
+};
+
+class ContextMixingCodec {
+ public:
+  // Frames of 'frame_size' bits; throws std::invalid_argument if it is zero.
+  explicit ContextMixingCodec(size_t frame_size);
+
+  size_t frame_size() const { return frame_size_; }
+
+  // The stream need not be a whole number of frames. The encoding holds its
+  // length, so it decodes on its own.
+  std::vector<uint8_t> Encode(const base::PackedFv& bits) const;
+  // Throws std::runtime_error if 'encoded' is malformed.
+  base::PackedFv Decode(const std::vector<uint8_t>& encoded) const;
+
+  // Encodes 'bits' as blocks of 'frames_per_block' frames, the last possibly
+  // shorter, using 'num_threads' workers (0 means one per hardware thread).
+  // Throws std::invalid_argument if 'frames_per_block' is zero.
+  ContextMixingBlocks EncodeBlocks(const base::PackedFv& bits,
+                                   size_t frames_per_block,
+                                   size_t num_threads = 0) const;
+  // Decodes all blocks in parallel. Throws std::runtime_error if a block is
+  // malformed.
+  base::PackedFv DecodeBlocks(const ContextMixingBlocks& blocks,
+                              size_t num_threads = 0) const;
+
+ private:
+  size_t frame_size_;
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_CONTEXT_MIXING_H_ */
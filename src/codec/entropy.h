@@ -5,82 +5,394 @@
  *      Author: gregerso
  */
 
-// Functions for computing the entropy of strings of four-value logic.
+// Entropy estimates for streams of integer words, such as the symbols of a
+// signal capture: counters for single words and blocks of words, and for
+// pairs of a word and its context.
+//
+// ShannonEntropyAccumulator counts a stream of integer words and reports its
+// order-0 entropy, the entropy of blocks of consecutive words (n-grams) and
+// the conditional entropy of a word given the ones before it, which bounds
+// what any coder that looks back that far can achieve.
+//
+// Words in [0, 2^kDenseWordBits) are counted in a flat array and others in a
+// hash table. Counts are 64-bit. Accumulators over the same block length
+// merge exactly, so a large capture can be counted by one accumulator per
+// thread.
+//
+// Blocks longer than one word are counted by 64-bit fingerprint rather than
+// by value. Distinct blocks collide with probability about 2^-64 per pair,
+// which is far below anything that would show in an entropy estimate.
+// FingerprintCounts is the table that holds them.
+//
+// JointEntropyAccumulator counts pairs of a word and its context, for mutual
+// information and conditional entropy.
 
 #ifndef ENTROPY_H_
 #define ENTROPY_H_
 
-#include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 
-#include <iostream>
-#include <map>
-#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
-#include "../base/four_value_logic.h"
-
 namespace signal_content {
 namespace codec {
 
+// Entropy in bits of a distribution given the sum over its counts c of
+// c * log2(c) and the total count N: H = log2(N) - sum / N. Summing counts
+// and normalizing once avoids a division and a logarithm of a probability
+// per distinct word.
+inline double EntropyFromCountLogSum(double count_log_sum, uint64_t total) {
+  if (total == 0) {
+    return 0.0;
+  }
+  const double n = static_cast<double>(total);
+  return std::log2(n) - count_log_sum / n;
+}
+
+// The splitmix64 finalizer. It is a bijection, so mixed keys collide only if
+// the keys do.
+inline uint64_t MixKey(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+inline double CountLogCount(uint64_t count) {
+  return (count == 0) ? 0.0 : count * std::log2(static_cast<double>(count));
+}
+
+// Counts of 64-bit keys in one open-addressing table with linear probing,
+// kept at most half full. Keys must be well mixed, e.g. fingerprints.
+class FingerprintCounts {
+ public:
+  FingerprintCounts() : keys_(16, uint64_t(kEmpty)), counts_(16, 0) {}
+
+  void Add(uint64_t key, uint64_t count = 1) {
+    // The key that doubles as the empty marker is counted on its own.
+    if (key == kEmpty) {
+      empty_key_count_ += count;
+      return;
+    }
+    size_t slot = Slot(key);
+    while (keys_[slot] != key) {
+      if (keys_[slot] == kEmpty) {
+        if (2 * (size_ + 1) > keys_.size()) {
+          Grow();
+          Add(key, count);
+          return;
+        }
+        keys_[slot] = key;
+        ++size_;
+        break;
+      }
+      slot = (slot + 1) & (keys_.size() - 1);
+    }
+    counts_[slot] += count;
+  }
+
+  bool Contains(uint64_t key) const {
+    if (key == kEmpty) {
+      return empty_key_count_ != 0;
+    }
+    for (size_t slot = Slot(key); keys_[slot] != kEmpty;
+         slot = (slot + 1) & (keys_.size() - 1)) {
+      if (keys_[slot] == key) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Merge(const FingerprintCounts& other) {
+    empty_key_count_ += other.empty_key_count_;
+    for (size_t slot = 0; slot < other.keys_.size(); ++slot) {
+      if (other.keys_[slot] != kEmpty) {
+        Add(other.keys_[slot], other.counts_[slot]);
+      }
+    }
+  }
+
+  // Sum over the counts c of c * log2(c).
+  double CountLogSum() const {
+    double sum = CountLogCount(empty_key_count_);
+    for (size_t slot = 0; slot < keys_.size(); ++slot) {
+      sum += CountLogCount(counts_[slot]);
+    }
+    return sum;
+  }
+
+  // Distinct keys counted.
+  size_t size() const { return size_ + (empty_key_count_ != 0); }
+  size_t memory_bytes() const {
+    return keys_.size() * (sizeof(uint64_t) + sizeof(uint64_t));
+  }
+
+  void Clear() {
+    keys_.assign(16, uint64_t(kEmpty));
+    counts_.assign(16, 0);
+    size_ = 0;
+    empty_key_count_ = 0;
+  }
+
+ private:
+  static const uint64_t kEmpty = 0;
+
+  // Keys are well mixed, so their high bits serve as the slot.
+  size_t Slot(uint64_t key) const {
+    return static_cast<size_t>(key >> 32) & (keys_.size() - 1);
+  }
+
+  void Grow() {
+    std::vector<uint64_t> keys(keys_.size() * 2, uint64_t(kEmpty));
+    std::vector<uint64_t> counts(counts_.size() * 2, 0);
+    keys.swap(keys_);
+    counts.swap(counts_);
+    size_ = 0;
+    for (size_t slot = 0; slot < keys.size(); ++slot) {
+      if (keys[slot] != kEmpty) {
+        Add(keys[slot], counts[slot]);
+      }
+    }
+  }
+
+  std::vector<uint64_t> keys_;
+  std::vector<uint64_t> counts_;
+  size_t size_{0};
+  uint64_t empty_key_count_{0};
+};
+
 template <typename WordType>
 class ShannonEntropyAccumulator {
  public:
+  static_assert(std::is_integral<WordType>::value,
+                "Entropy is accumulated over integer words.");
+  // Words below 2^kDenseWordBits are counted in a flat array, which grows in
+  // powers of two from 2^kMinDenseWordBits to cover the largest such word
+  // seen, so narrow fields keep it small.
+  static const size_t kDenseWordBits = 16;
+  static const size_t kMinDenseWordBits = 8;
 
-  ShannonEntropyAccumulator() {}
-  ~ShannonEntropyAccumulator() {}
+  // Counts blocks of up to 'max_block_length' consecutive words in addition
+  // to single words.
+  explicit ShannonEntropyAccumulator(size_t max_block_length = 1)
+      : block_counts_(max_block_length), block_totals_(max_block_length, 0) {
+    if (max_block_length == 0) {
+      throw std::invalid_argument("Block length must be at least 1.");
+    }
+  }
 
   void AddSample(WordType word) {
-    auto it = word_counts_.find(word);
-    if (it == word_counts_.end()) {
-      word_counts_.insert(std::make_pair(word, 1));
+    const uint64_t key = static_cast<uint64_t>(word);
+    if (key < dense_counts_.size()) {
+      ++dense_counts_[key];
+    } else if (key < (uint64_t(1) << kDenseWordBits)) {
+      GrowDenseCounts(static_cast<size_t>(key) + 1);
+      ++dense_counts_[key];
     } else {
-      it->second = it->second + 1;
+      ++sparse_counts_[word];
     }
     ++total_words_;
+    if (block_counts_.size() > 1) {
+      AddToBlocks(key);
+    }
+  }
+
+  void AddSamples(const WordType* words, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      AddSample(words[i]);
+    }
   }
 
-  double GetEntropy() {
-    double entropy = 0.0;
-    for (auto word_freq_pair : word_counts_) {
-      entropy += GetWordEntropy(word_freq_pair.first);
+  // Starts an unrelated sequence: no block spans the words before and after
+  // this call. Use it between the streams of different signals.
+  void StartNewSequence() { history_.clear(); }
+
+  // Adds the counts of 'other', whose words are taken as a separate sequence.
+  void Merge(const ShannonEntropyAccumulator& other) {
+    if (other.block_counts_.size() != block_counts_.size()) {
+      throw std::invalid_argument("Merging accumulators of different block "
+                                  "lengths.");
+    }
+    GrowDenseCounts(other.dense_counts_.size());
+    for (size_t i = 0; i < other.dense_counts_.size(); ++i) {
+      dense_counts_[i] += other.dense_counts_[i];
+    }
+    for (const auto& p : other.sparse_counts_) {
+      sparse_counts_[p.first] += p.second;
+    }
+    total_words_ += other.total_words_;
+    for (size_t length = 2; length <= block_counts_.size(); ++length) {
+      block_counts_[length - 1].Merge(other.block_counts_[length - 1]);
+      block_totals_[length - 1] += other.block_totals_[length - 1];
     }
-    return entropy;
   }
 
-  double GetWordEntropy(WordType word) {
-    if (total_words_ <= 0) {
+  uint64_t total() const { return total_words_; }
+  size_t max_block_length() const { return block_counts_.size(); }
+
+  // Order-0 entropy in bits per word.
+  double GetEntropy() const {
+    double sum = 0.0;
+    for (uint64_t count : dense_counts_) {
+      sum += CountLogCount(count);
+    }
+    for (const auto& p : sparse_counts_) {
+      sum += CountLogCount(p.second);
+    }
+    return EntropyFromCountLogSum(sum, total_words_);
+  }
+
+  // The contribution -p * log2(p) of 'word' to GetEntropy().
+  double GetWordEntropy(WordType word) const {
+    const uint64_t count = Count(word);
+    if (total_words_ == 0 || count == 0) {
       return 0.0;
-    } else {
-      int count = word_counts_[word];
-      double probability = ((double)count)/((double)total_words_);
-      std::cout << word << " " << probability << " probability\n";
-      return ComputeShannonWordEntropy(probability);
     }
+    const double probability = static_cast<double>(count) / total_words_;
+    return -probability * std::log2(probability);
+  }
+
+  uint64_t Count(WordType word) const {
+    const uint64_t key = static_cast<uint64_t>(word);
+    if (key < dense_counts_.size()) {
+      return dense_counts_[key];
+    }
+    auto it = sparse_counts_.find(word);
+    return (it == sparse_counts_.end()) ? 0 : it->second;
+  }
+
+  // Entropy in bits of a block of 'length' consecutive words, H(X1..Xn).
+  double GetBlockEntropy(size_t length) const {
+    CheckBlockLength(length);
+    if (length == 1) {
+      return GetEntropy();
+    }
+    return EntropyFromCountLogSum(block_counts_[length - 1].CountLogSum(),
+                                  block_totals_[length - 1]);
+  }
+
+  // Entropy in bits of a word given the 'length' - 1 words before it,
+  // H(Xn | X1..Xn-1) = H(X1..Xn) - H(X1..Xn-1). Decreases towards the
+  // entropy rate of the stream as 'length' grows, provided there is enough
+  // data to populate the blocks.
+  double GetConditionalEntropy(size_t length) const {
+    CheckBlockLength(length);
+    if (length == 1) {
+      return GetEntropy();
+    }
+    return GetBlockEntropy(length) - GetBlockEntropy(length - 1);
   }
 
   void Reset() {
+    std::fill(dense_counts_.begin(), dense_counts_.end(), 0);
+    sparse_counts_.clear();
     total_words_ = 0;
-    word_counts_.clear();
+    for (FingerprintCounts& counts : block_counts_) {
+      counts.Clear();
+    }
+    std::fill(block_totals_.begin(), block_totals_.end(), 0);
+    history_.clear();
   }
 
  private:
-  double ComputeShannonWordEntropy(double probability) {
-    if (probability <= 0) {
-      return 0.0;
-    } else {
-      return -probability * log2(probability);
+  static uint64_t ExtendFingerprint(uint64_t hash, uint64_t word) {
+    return MixKey(hash ^ (word + 0x9E3779B97F4A7C15ULL));
+  }
+
+  // Grows the flat array to cover words below 'num_words'.
+  void GrowDenseCounts(size_t num_words) {
+    if (num_words <= dense_counts_.size()) {
+      return;
+    }
+    size_t size = size_t(1) << kMinDenseWordBits;
+    while (size < num_words) {
+      size *= 2;
     }
+    dense_counts_.resize(size, 0);
   }
 
-  int total_words_{0};
-  std::map<WordType, int> word_counts_;
+  // Counts every block that ends with 'word'.
+  void AddToBlocks(uint64_t word) {
+    const size_t max_length = block_counts_.size();
+    // Fingerprint the blocks from the newest word back.
+    uint64_t hash = ExtendFingerprint(0, word);
+    for (size_t length = 2; length <= history_.size() + 1; ++length) {
+      hash = ExtendFingerprint(hash, history_[history_.size() + 1 - length]);
+      block_counts_[length - 1].Add(hash);
+      ++block_totals_[length - 1];
+    }
+    if (history_.size() + 1 == max_length) {
+      history_.erase(history_.begin());
+    }
+    history_.push_back(word);
+  }
+
+  void CheckBlockLength(size_t length) const {
+    if (length == 0 || length > block_counts_.size()) {
+      throw std::out_of_range("Block length was not accumulated.");
+    }
+  }
+
+  std::vector<uint64_t> dense_counts_;
+  std::unordered_map<WordType, uint64_t> sparse_counts_;
+  uint64_t total_words_{0};
+  // Counts of blocks of length l + 1 by fingerprint; entry 0 is unused.
+  std::vector<FingerprintCounts> block_counts_;
+  std::vector<uint64_t> block_totals_;
+  // The last max_block_length - 1 words of the current sequence, oldest
+  // first.
+  std::vector<uint64_t> history_;
 };
-}
-}
 
+// Joint counts of pairs (x, y) of 32-bit values, from which follow the
+// mutual information I(X;Y) and the conditional entropy H(X|Y): how much
+// knowing a context Y, such as a neighbouring signal or the previous value,
+// tells about X. Only pairs that occur are stored. Accumulators merge, so
+// pairs can be counted by one accumulator per thread.
+class JointEntropyAccumulator {
+ public:
+  void Add(uint32_t x, uint32_t y) {
+    x_.AddSample(x);
+    y_.AddSample(y);
+    // The mix is a bijection, so pairs are counted exactly.
+    pairs_.Add(MixKey((uint64_t(x) << 32) | y));
+  }
+
+  void Merge(const JointEntropyAccumulator& other) {
+    x_.Merge(other.x_);
+    y_.Merge(other.y_);
+    pairs_.Merge(other.pairs_);
+  }
+
+  uint64_t total() const { return x_.total(); }
+  // Distinct pairs seen.
+  size_t num_pairs() const { return pairs_.size(); }
 
+  double EntropyX() const { return x_.GetEntropy(); }
+  double EntropyY() const { return y_.GetEntropy(); }
+  double JointEntropy() const {
+    return EntropyFromCountLogSum(pairs_.CountLogSum(), total());
+  }
+  // H(X|Y) = H(X,Y) - H(Y).
+  double ConditionalEntropy() const { return JointEntropy() - EntropyY(); }
+  // I(X;Y) = H(X) + H(Y) - H(X,Y).
+  double MutualInformation() const {
+    return EntropyX() + EntropyY() - JointEntropy();
+  }
 
+ private:
+  ShannonEntropyAccumulator<uint32_t> x_;
+  ShannonEntropyAccumulator<uint32_t> y_;
+  FingerprintCounts pairs_;
+};
 
+}  // namespace codec
+}  // namespace signal_content
 
 #endif /* ENTROPY_H_ */
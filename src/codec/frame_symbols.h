@@ -0,0 +1,126 @@
+/*
+ * frame_symbols.h
+ *
+ * Splitting frames into multi-bit integer symbols, as the entropy coders see
+ * them. A frame of F bits with S-bit symbols yields ceil(F / S) symbols; the
+ * first bit of each symbol is its most significant bit, the last symbol of a
+ * frame may be short, and X and Z are treated as zeroes.
+ *
+ * ForEachFrameSymbols dispatches the frame size to a fixed-size path (see
+ * base/frame_dispatch.h), which loads each frame into registers once and
+ * carves symbols out with shifts, writing into a stack buffer.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_FRAME_SYMBOLS_H_
+#define SIGNAL_CONTENT_CODEC_FRAME_SYMBOLS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "../base/frame_dispatch.h"
+#include "../base/frame_view.h"
+#include "../base/packed_fv.h"
+
+namespace signal_content {
+namespace codec {
+
+inline size_t SymbolsPerFrame(size_t frame_size, size_t symbol_bits) {
+  return (frame_size + symbol_bits - 1) / symbol_bits;
+}
+
+// Extracts the symbols of one frame of a runtime-sized view into 'symbols',
+// which must hold SymbolsPerFrame() entries.
+inline void ExtractFrameSymbols(const base::VFrameView& frames,
+                                size_t frame_num, size_t symbol_bits,
+                                int* symbols) {
+  const size_t frame_size = frames.frame_size();
+  for (size_t bit = 0; bit < frame_size; bit += symbol_bits) {
+    const size_t bits_left_in_frame = frame_size - bit;
+    *symbols++ = static_cast<int>(frames.PeekBits(
+        frame_num, bit,
+        bits_left_in_frame < symbol_bits ? bits_left_in_frame : symbol_bits));
+  }
+}
+
+// Fixed-size version: the frame is loaded into ceil(FRAME_SIZE / 64)
+// left-aligned words, and every loop bound but the symbol width is constant.
+template <size_t FRAME_SIZE>
+inline void ExtractFrameSymbols(const base::FrameView<FRAME_SIZE>& frames,
+                                size_t frame_num, size_t symbol_bits,
+                                int* symbols) {
+  typedef base::PackedFv::Word Word;
+  static const size_t kWordBits = base::PackedFv::kBitsPerWord;
+  static const size_t kNumWords = (FRAME_SIZE + kWordBits - 1) / kWordBits;
+  Word words[kNumWords + 1];
+  for (size_t w = 0; w < kNumWords; ++w) {
+    const size_t n = (FRAME_SIZE - w * kWordBits < kWordBits) ?
+        FRAME_SIZE - w * kWordBits : kWordBits;
+    words[w] = frames.PeekBits(frame_num, w * kWordBits, n) << (kWordBits - n);
+  }
+  words[kNumWords] = 0;
+  for (size_t bit = 0; bit < FRAME_SIZE; bit += symbol_bits) {
+    const size_t n = (FRAME_SIZE - bit < symbol_bits) ?
+        FRAME_SIZE - bit : symbol_bits;
+    const size_t w = bit / kWordBits;
+    const size_t offset = bit % kWordBits;
+    Word aligned = words[w] << offset;
+    if (offset != 0) {
+      aligned |= words[w + 1] >> (kWordBits - offset);
+    }
+    *symbols++ = static_cast<int>(aligned >> (kWordBits - n));
+  }
+}
+
+namespace internal {
+
+// Dispatch target for ForEachFrameSymbols.
+template <typename Visitor>
+struct ForEachFrameSymbolsOp {
+  typedef void result_type;
+
+  template <size_t FRAME_SIZE>
+  void Run() {
+    const base::FrameView<FRAME_SIZE> fixed(frames);
+    // Enough room for 1-bit symbols.
+    int symbols[FRAME_SIZE];
+    const size_t count = SymbolsPerFrame(FRAME_SIZE, symbol_bits);
+    for (size_t frame_num = 0; frame_num < fixed.num_frames(); ++frame_num) {
+      ExtractFrameSymbols(fixed, frame_num, symbol_bits, symbols);
+      (*visitor)(symbols, count);
+    }
+  }
+
+  void RunGeneric() {
+    std::vector<int> symbols(
+        SymbolsPerFrame(frames.frame_size(), symbol_bits));
+    for (size_t frame_num = 0; frame_num < frames.num_frames(); ++frame_num) {
+      ExtractFrameSymbols(frames, frame_num, symbol_bits, symbols.data());
+      (*visitor)(symbols.data(), symbols.size());
+    }
+  }
+
+  const base::VFrameView& frames;
+  size_t symbol_bits;
+  Visitor* visitor;
+};
+
+}  // namespace internal
+
+// Calls (*visitor)(const int* symbols, size_t count) once per frame of
+// 'frames', in order.
+template <typename Visitor>
+void ForEachFrameSymbols(const base::VFrameView& frames, size_t symbol_bits,
+                         Visitor* visitor) {
+  if (symbol_bits == 0 || symbol_bits > 32) {
+    throw std::invalid_argument("Symbol size must be between 1 and 32 bits.");
+  }
+  internal::ForEachFrameSymbolsOp<Visitor> op = {frames, symbol_bits, visitor};
+  base::DispatchFrameSize(frames.frame_size(), op);
+}
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_FRAME_SYMBOLS_H_ */
@@ -0,0 +1,252 @@
+/*
+ * frame_transform.cpp
+ */
+
+#include "frame_transform.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+using namespace std;
+
+namespace signal_content {
+using base::PackedFv;
+namespace codec {
+
+namespace {
+
+typedef FrameTransform::Word Word;
+
+// Sum and difference of every field in a unit modulo 2^width, where 'high'
+// marks the most significant bit of each field. Carries and borrows are kept
+// out of the next field by working on the low bits of each field and fixing
+// the top bit with XOR.
+inline Word FieldAdd(Word x, Word y, Word high) {
+  return ((x & ~high) + (y & ~high)) ^ ((x ^ y) & high);
+}
+
+inline Word FieldSubtract(Word x, Word y, Word high) {
+  return ((x | high) - (y & ~high)) ^ ((x ^ ~y) & high);
+}
+
+// The prediction of the unit at 'x' from the same unit in the previous two
+// frames, 'm' and 2 * m units back.
+template <bool kLinear>
+inline Word Predict(const Word* x, size_t m, Word high) {
+  if (!kLinear) {
+    return x[-ptrdiff_t(m)];
+  }
+  const Word previous = x[-ptrdiff_t(m)];
+  return FieldAdd(previous,
+                  FieldSubtract(previous, x[-2 * ptrdiff_t(m)], high), high);
+}
+
+// Writes the residuals of the 'count' units at 'x', which start a frame of
+// 'm' units, to 'out'.
+template <bool kLinear>
+void ComputeResiduals(const Word* x, size_t count, size_t m,
+                      const Word* high, bool xor_residual, Word* out) {
+  for (size_t i = 0, j = 0; i < count; ++i) {
+    const Word prediction = Predict<kLinear>(x + i, m, high[j]);
+    out[i] = xor_residual ? x[i] ^ prediction
+                          : FieldSubtract(x[i], prediction, high[j]);
+    j = (j + 1 == m) ? 0 : j + 1;
+  }
+}
+
+// Replaces the 'count' residuals at 'x' by the units they came from, in
+// order, so that each prediction uses units already rebuilt.
+template <bool kLinear>
+void RebuildUnits(Word* x, size_t count, size_t m, const Word* high,
+                  bool xor_residual) {
+  for (size_t i = 0, j = 0; i < count; ++i) {
+    const Word prediction = Predict<kLinear>(x + i, m, high[j]);
+    x[i] = xor_residual ? x[i] ^ prediction
+                        : FieldAdd(x[i], prediction, high[j]);
+    j = (j + 1 == m) ? 0 : j + 1;
+  }
+}
+
+vector<size_t> UniformFields(size_t frame_size, size_t field_bits) {
+  if (field_bits == 0) {
+    throw invalid_argument("Field size must be positive.");
+  }
+  vector<size_t> fields;
+  for (size_t bit = 0; bit < frame_size; bit += field_bits) {
+    fields.push_back(min(field_bits, frame_size - bit));
+  }
+  return fields;
+}
+
+}  // namespace
+
+FrameTransform::FrameTransform(size_t frame_size,
+                               const vector<size_t>& field_bits,
+                               Residual residual, Predictor predictor)
+    : frame_size_(frame_size), residual_(residual), predictor_(predictor) {
+  size_t total_bits = 0;
+  for (size_t bits : field_bits) {
+    if (bits == 0 || bits > PackedFv::kBitsPerWord) {
+      throw invalid_argument("Fields must be between 1 and 64 bits.");
+    }
+    total_bits += bits;
+  }
+  if (frame_size == 0 || total_bits != frame_size) {
+    throw invalid_argument("Fields must add up to the frame size.");
+  }
+
+  const size_t kWordBits = PackedFv::kBitsPerWord;
+  const bool equal_fields =
+      all_of(field_bits.begin(), field_bits.end(),
+             [&field_bits] (size_t bits) { return bits == field_bits[0]; });
+  if (residual == Residual::kXor && predictor == Predictor::kPreviousFrame) {
+    // Field boundaries do not matter; whole words.
+    for (size_t bit = 0; bit < frame_size; bit += kWordBits) {
+      unit_bits_.push_back(min(kWordBits, frame_size - bit));
+      unit_high_bits_.push_back(0);
+    }
+  } else if (frame_size % kWordBits == 0 && equal_fields &&
+             kWordBits % field_bits[0] == 0) {
+    // Every word holds the same whole fields.
+    Word high = 0;
+    for (size_t bit = 0; bit < kWordBits; bit += field_bits[0]) {
+      high |= Word(1) << (bit + field_bits[0] - 1);
+    }
+    unit_bits_.assign(frame_size / kWordBits, kWordBits);
+    unit_high_bits_.assign(frame_size / kWordBits, high);
+  } else {
+    for (size_t bits : field_bits) {
+      unit_bits_.push_back(bits);
+      unit_high_bits_.push_back(Word(1) << (bits - 1));
+    }
+  }
+  Reset();
+}
+
+FrameTransform::FrameTransform(size_t frame_size, size_t field_bits,
+                               Residual residual, Predictor predictor)
+    : FrameTransform(frame_size, UniformFields(frame_size, field_bits),
+                     residual, predictor) {}
+
+string FrameTransform::name() const {
+  return string(residual_ == Residual::kXor ? "xor" : "delta") +
+         (predictor_ == Predictor::kPreviousFrame ? "_prev" : "_linear");
+}
+
+void FrameTransform::Forward(const PackedFv& frames, PackedFv* residuals) {
+  LoadUnits(frames);
+  const size_t m = unit_bits_.size();
+  const size_t num_frames = units_.size() / m - 2;
+  const size_t count = num_frames * m;
+  const size_t simple = PreviousFramePredictedUnits(num_frames);
+  const Word* x = &units_[2 * m];
+  const bool xor_residual = (residual_ == Residual::kXor);
+  vector<Word> out(count);
+  ComputeResiduals<false>(x, simple, m, unit_high_bits_.data(), xor_residual,
+                          out.data());
+  ComputeResiduals<true>(x + simple, count - simple, m,
+                         unit_high_bits_.data(), xor_residual,
+                         out.data() + simple);
+  StoreUnits(out.data(), num_frames, residuals);
+  KeepHistory(num_frames);
+}
+
+void FrameTransform::Inverse(const PackedFv& residuals, PackedFv* frames) {
+  LoadUnits(residuals);
+  const size_t m = unit_bits_.size();
+  const size_t num_frames = units_.size() / m - 2;
+  const size_t count = num_frames * m;
+  const size_t simple = PreviousFramePredictedUnits(num_frames);
+  Word* x = &units_[2 * m];
+  const bool xor_residual = (residual_ == Residual::kXor);
+  RebuildUnits<false>(x, simple, m, unit_high_bits_.data(), xor_residual);
+  RebuildUnits<true>(x + simple, count - simple, m, unit_high_bits_.data(),
+                     xor_residual);
+  StoreUnits(x, num_frames, frames);
+  KeepHistory(num_frames);
+}
+
+size_t FrameTransform::PreviousFramePredictedUnits(size_t num_frames) const {
+  if (predictor_ == Predictor::kPreviousFrame) {
+    return num_frames * unit_bits_.size();
+  }
+  // Linear prediction needs two frames before it.
+  const uint64_t waiting = (frames_seen_ < 2) ? 2 - frames_seen_ : 0;
+  return min<uint64_t>(waiting, num_frames) * unit_bits_.size();
+}
+
+void FrameTransform::Reset() {
+  units_.assign(2 * unit_bits_.size(), 0);
+  frames_seen_ = 0;
+}
+
+void FrameTransform::LoadUnits(const PackedFv& bits) {
+  if (bits.size() % frame_size_ != 0) {
+    throw invalid_argument("Chunk is not a whole number of frames.");
+  }
+  const size_t kWordBits = PackedFv::kBitsPerWord;
+  // The chunk's words, with X and Z cleared and a zero word after the last,
+  // so that units are cut out with two shifts and no bounds checks.
+  vector<Word> words(bits.num_words() + 1, 0);
+  for (size_t w = 0; w < bits.num_words(); ++w) {
+    words[w] = bits.ValueWord(w);
+    if (bits.HasUnknownPlane()) {
+      words[w] &= ~bits.UnknownWord(w);
+    }
+  }
+  const size_t m = unit_bits_.size();
+  const size_t num_frames = bits.size() / frame_size_;
+  units_.resize((num_frames + 2) * m);
+  Word* unit = &units_[2 * m];
+  size_t pos = 0;
+  for (size_t f = 0; f < num_frames; ++f) {
+    for (size_t j = 0; j < m; ++j) {
+      const size_t offset = pos % kWordBits;
+      Word aligned = words[pos / kWordBits] << offset;
+      if (offset != 0) {
+        aligned |= words[pos / kWordBits + 1] >> (kWordBits - offset);
+      }
+      *unit++ = (unit_bits_[j] == kWordBits) ?
+          aligned : aligned >> (kWordBits - unit_bits_[j]);
+      pos += unit_bits_[j];
+    }
+  }
+}
+
+void FrameTransform::StoreUnits(const Word* units, size_t num_frames,
+                                PackedFv* out) const {
+  const size_t kWordBits = PackedFv::kBitsPerWord;
+  const size_t m = unit_bits_.size();
+  out->reserve(out->size() + num_frames * frame_size_);
+  // Units are gathered into whole words before they are appended.
+  Word pending = 0;
+  size_t pending_bits = 0;
+  for (size_t f = 0; f < num_frames; ++f) {
+    for (size_t j = 0; j < m; ++j) {
+      const Word unit = *units++;
+      const size_t n = unit_bits_[j];
+      const size_t room = kWordBits - pending_bits;
+      if (n < room) {
+        pending = (pending << n) | unit;
+        pending_bits += n;
+      } else {
+        const size_t rest = n - room;
+        out->PushBits((room == kWordBits) ? unit >> rest :
+                      (pending << room) | (unit >> rest), kWordBits);
+        pending = (rest == 0) ? 0 : unit & ((Word(1) << rest) - 1);
+        pending_bits = rest;
+      }
+    }
+  }
+  out->PushBits(pending, pending_bits);
+}
+
+void FrameTransform::KeepHistory(size_t num_frames) {
+  units_.erase(units_.begin(),
+               units_.begin() + num_frames * unit_bits_.size());
+  frames_seen_ += num_frames;
+}
+
+}  // namespace codec
+}  // namespace signal_content
@@ -0,0 +1,97 @@
+/*
+ * frame_transform.h
+ *
+ * A reversible transform that replaces each frame of a stream by its
+ * residual against a prediction from the frames before it, field by field.
+ * Signals that change little from cycle to cycle turn into residuals that are
+ * mostly zero, which the entropy coders then code in a fraction of the bits.
+ *
+ * A frame is split into fields, most significant first, whose widths sum to
+ * the frame size. Each field is predicted either by the same field of the
+ * previous frame or by linear extrapolation from the two previous frames
+ * (2 * prev - prev2), and the residual is either the XOR of the field with
+ * its prediction or their difference modulo 2^width. Frames before the
+ * stream starts count as zero, and linear prediction falls back to the
+ * previous frame until there are two.
+ *
+ * The transform is stateful, so a stream may be transformed in chunks of
+ * whole frames. X and Z are treated as zeroes, as by the entropy coders.
+ *
+ * The work is done on 64-bit units. XOR residuals ignore field boundaries,
+ * so a frame is cut into whole words. Differences of frames that are a whole
+ * number of words, with equal fields that divide a word, are taken on all
+ * the fields in a word at once with carry-free (SWAR) arithmetic. Otherwise
+ * each field is a unit of its own.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_FRAME_TRANSFORM_H_
+#define SIGNAL_CONTENT_CODEC_FRAME_TRANSFORM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../base/packed_fv.h"
+
+namespace signal_content {
+namespace codec {
+
+class FrameTransform {
+ public:
+  typedef base::PackedFv::Word Word;
+
+  enum class Residual { kXor, kDifference };
+  enum class Predictor { kPreviousFrame, kLinear };
+
+  // Fields of the given widths, which must each be between 1 and 64 bits and
+  // sum to 'frame_size'. Throws std::invalid_argument otherwise.
+  FrameTransform(size_t frame_size, const std::vector<size_t>& field_bits,
+                 Residual residual, Predictor predictor);
+  // Fields of 'field_bits' bits each; the last may be short.
+  FrameTransform(size_t frame_size, size_t field_bits, Residual residual,
+                 Predictor predictor);
+
+  // "xor_prev", "delta_prev", "xor_linear" or "delta_linear".
+  std::string name() const;
+  size_t frame_size() const { return frame_size_; }
+
+  // Appends the residuals of 'frames' to 'residuals'. 'frames' must be a
+  // whole number of frames; throws std::invalid_argument otherwise.
+  void Forward(const base::PackedFv& frames, base::PackedFv* residuals);
+  // Undoes Forward, given the residuals in the same order and chunks.
+  void Inverse(const base::PackedFv& residuals, base::PackedFv* frames);
+
+  // Forgets the frames seen, to start a new stream.
+  void Reset();
+
+ private:
+  // Loads the units of every frame of 'bits' after the two frames of history
+  // in units_.
+  void LoadUnits(const base::PackedFv& bits);
+  // How many of the first units of a chunk of 'num_frames' frames are
+  // predicted from the previous frame alone.
+  size_t PreviousFramePredictedUnits(size_t num_frames) const;
+  void StoreUnits(const Word* units, size_t num_frames,
+                  base::PackedFv* out) const;
+  // Drops all but the last two frames of units_, the history for the next
+  // chunk.
+  void KeepHistory(size_t num_frames);
+
+  size_t frame_size_;
+  Residual residual_;
+  Predictor predictor_;
+  // The units a frame is cut into, and for each the mask of the most
+  // significant bit of every field within it.
+  std::vector<size_t> unit_bits_;
+  std::vector<Word> unit_high_bits_;
+  // Units of the two frames before the current chunk followed by those of
+  // the chunk.
+  std::vector<Word> units_;
+  uint64_t frames_seen_{0};
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_FRAME_TRANSFORM_H_ */
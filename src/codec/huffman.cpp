@@ -9,75 +9,227 @@ namespace codec {
 
 #include "huffman.h"
 
+#include <algorithm>
+
 #include "../base/macros.h"
+#include "../base/thread_pool.h"
+#include "bit_writer.h"
+#include "frame_symbols.h"
 
 using namespace std;
 
 namespace signal_content {
 using base::FourValueLogic;
+using base::PackedFv;
+using base::ThreadPool;
 using base::VFrameDeque;
 using base::VFrameFv;
+using base::VFrameView;
 namespace codec {
 
-HuffmanCodec::HuffmanCodec(
-    const VFrameDeque& frame_deque, size_t symbol_bits)
-    : symbol_bits_(symbol_bits) {
-  frame_size_ = frame_deque.front().size();
+// Frame visitors for ForEachFrameSymbols.
+struct HuffmanCodec::SymbolEncoder {
+  void operator()(const int* symbols, size_t count) {
+    codec->AppendCodewords(symbols, count, encoded);
+  }
+  const HuffmanCodec* codec;
+  vector<bool>* encoded;
+};
+
+struct HuffmanCodec::BitCounter {
+  void operator()(const int* symbols, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      num_bits += codec->CodeFor(symbols[i]).length;
+    }
+  }
+  const HuffmanCodec* codec;
+  size_t num_bits;
+};
+
+struct HuffmanCodec::BitWriterEncoder {
+  void operator()(const int* symbols, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      const HuffmanCode& code = codec->CodeFor(symbols[i]);
+      writer->Write(code.code, code.length);
+    }
+  }
+  const HuffmanCodec* codec;
+  BitWriter* writer;
+};
+
+namespace {
+
+void CheckSymbolBits(size_t symbol_bits) {
   if (symbol_bits > 32) {
     throw runtime_error("Symbol size cannot exceed 32 bits.");
   }
+}
+
+// Little-endian fixed-width integers for the serialized code table.
+void PutUint32(uint32_t value, vector<uint8_t>* out) {
+  for (int i = 0; i < 4; ++i) {
+    out->push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+uint32_t GetUint32(const vector<uint8_t>& in, size_t* pos) {
+  if (*pos + 4 > in.size()) {
+    throw runtime_error("Truncated Huffman code table.");
+  }
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= uint32_t(in[(*pos)++]) << (8 * i);
+  }
+  return value;
+}
+
+uint8_t GetUint8(const vector<uint8_t>& in, size_t* pos) {
+  if (*pos >= in.size()) {
+    throw runtime_error("Truncated Huffman code table.");
+  }
+  return in[(*pos)++];
+}
+
+// Serialized code table formats: a length for every symbol value, or
+// (symbol, length) pairs for the symbols in use.
+const uint8_t kDenseCodeTable = 0;
+const uint8_t kSparseCodeTable = 1;
+
+}  // namespace
+
+HuffmanCodec::HuffmanCodec(
+    const VFrameDeque& frame_deque, size_t symbol_bits,
+    size_t max_code_length)
+    : symbol_bits_(symbol_bits), max_code_length_(max_code_length) {
+  frame_size_ = frame_deque.front().size();
+  CheckSymbolBits(symbol_bits);
 
   // Build frequency table.
+  SymbolHistogram histogram(symbol_bits_);
   for (size_t frame_num = 0; frame_num < frame_deque.size(); ++frame_num) {
-    const VFrameFv& frame = frame_deque.at(frame_num);
-    vector<int> symbols = FrameToSymbols(frame);
-    for (int symbol : symbols) {
-      auto it = symbol_to_freq_.find(symbol);
-      if (it == symbol_to_freq_.end()) {
-        symbol_to_freq_.insert(std::make_pair(symbol, 1));
-      } else {
-        it->second = it->second + 1;
+    vector<int> symbols = FrameToSymbols(frame_deque.at(frame_num));
+    histogram.Add(symbols.data(), symbols.size());
+  }
+  symbol_to_freq_ = histogram.Counts();
+  BuildCodeTree();
+}
+
+HuffmanCodec::HuffmanCodec(const VFrameView& frames, size_t symbol_bits,
+                           size_t max_code_length, size_t num_threads)
+    : frame_size_(frames.frame_size()), symbol_bits_(symbol_bits),
+      max_code_length_(max_code_length) {
+  CheckSymbolBits(symbol_bits);
+
+  // Build frequency table.
+  symbol_to_freq_ =
+      ComputeSymbolHistogram(frames, symbol_bits_, num_threads).Counts();
+  BuildCodeTree();
+}
+
+HuffmanCodec::HuffmanCodec(
+    const PackedFv& bits, size_t frame_size, size_t symbol_bits,
+    size_t max_code_length, size_t num_threads)
+    : HuffmanCodec(VFrameView(bits, frame_size), symbol_bits,
+                   max_code_length, num_threads) {}
+
+HuffmanCodec::HuffmanCodec(const SymbolHistogram& histogram,
+                           size_t frame_size, size_t max_code_length)
+    : frame_size_(frame_size), symbol_bits_(histogram.symbol_bits()),
+      max_code_length_(max_code_length) {
+  CheckSymbolBits(symbol_bits_);
+  symbol_to_freq_ = histogram.Counts();
+  BuildCodeTree();
+}
+
+HuffmanCodec::HuffmanCodec(const vector<uint8_t>& code_table) {
+  size_t pos = 0;
+  frame_size_ = GetUint32(code_table, &pos);
+  symbol_bits_ = GetUint8(code_table, &pos);
+  CheckSymbolBits(symbol_bits_);
+  const uint8_t format = GetUint8(code_table, &pos);
+  if (format == kDenseCodeTable) {
+    if (symbol_bits_ > kMaxDenseSymbolBits) {
+      throw runtime_error("Dense Huffman code table is too large.");
+    }
+    for (size_t symbol = 0; symbol < (size_t(1) << symbol_bits_); ++symbol) {
+      const uint8_t length = GetUint8(code_table, &pos);
+      if (length != 0) {
+        HuffmanCodeword codeword = {static_cast<int>(symbol), {0, length}};
+        codewords_.push_back(codeword);
       }
     }
+  } else if (format == kSparseCodeTable) {
+    const uint32_t num_symbols = GetUint32(code_table, &pos);
+    for (uint32_t i = 0; i < num_symbols; ++i) {
+      const int symbol = static_cast<int>(GetUint32(code_table, &pos));
+      HuffmanCodeword codeword = {symbol, {0, GetUint8(code_table, &pos)}};
+      codewords_.push_back(codeword);
+    }
+  } else {
+    throw runtime_error("Unknown Huffman code table format.");
   }
+  AssignCanonicalCodes(&codewords_);
+  BuildCodeTables();
+}
 
-  // Build the decoding tree. Start by creating all leaf nodes, then build the
-  // tree from the bottom up.
-  std::priority_queue<HuffmanNode*, std::vector<HuffmanNode*>,
-                      HuffmanNodePointerGreater> freq_sorted_nodes;
-  for (std::pair<int, size_t> p : symbol_to_freq_) {
-    // Add all symbols as leaf nodes.
-    freq_sorted_nodes.push(
-        new HuffmanNode(true, p.second, p.first, nullptr, nullptr, nullptr));
+void HuffmanCodec::BuildCodeTree() {
+  // Only the code lengths are taken from the Huffman tree; the codewords are
+  // reassigned canonically.
+  codewords_ = HuffmanCodeLengths(symbol_to_freq_);
+  size_t longest = 0;
+  for (const HuffmanCodeword& codeword : codewords_) {
+    unlimited_training_bits_ +=
+        symbol_to_freq_.at(codeword.symbol) * codeword.code.length;
+    longest = max<size_t>(longest, codeword.code.length);
   }
-
-  // Build parent nodes from leaves.
-  while (freq_sorted_nodes.size() > 1) {
-    HuffmanNode* n1 = freq_sorted_nodes.top();
-    freq_sorted_nodes.pop();
-    HuffmanNode* n2 = freq_sorted_nodes.top();
-    freq_sorted_nodes.pop();
-    HuffmanNode* parent = new HuffmanNode(
-        false, n1->frequency + n2->frequency, 0, n1, n2, nullptr);
-    n1->parent = parent;
-    n2->parent = parent;
-    freq_sorted_nodes.push(parent);
+  if (max_code_length_ != 0 && longest > max_code_length_) {
+    codewords_ =
+        LengthLimitedHuffmanCodeLengths(symbol_to_freq_, max_code_length_);
   }
-  assert(freq_sorted_nodes.size() == 1);
+  AssignCanonicalCodes(&codewords_);
+  BuildCodeTables();
+}
 
-  // Ownership of all nodes in the tree is transferred to the root. Nodes will
-  // be deleted when root is destroyed.
-  code_tree_root_ = freq_sorted_nodes.top();
-  freq_sorted_nodes.pop();
+size_t HuffmanCodec::LongestCodeLength() const {
+  // Canonical order ends with the longest codeword.
+  return codewords_.empty() ? 0 : codewords_.back().code.length;
+}
 
-  // Build the code table.
-  std::vector<bool> empty;
-  BuildCodeTableRecursive(code_tree_root_, &empty, &symbol_to_codeword_);
+size_t HuffmanCodec::TrainingEncodedBits() const {
+  size_t num_bits = 0;
+  for (const auto& p : symbol_to_freq_) {
+    num_bits += p.second * CodeFor(p.first).length;
+  }
+  return num_bits;
 }
 
-HuffmanCodec::~HuffmanCodec() {
-  if (code_tree_root_ != nullptr) {
-    delete code_tree_root_;
+void HuffmanCodec::BuildCodeTables() {
+  dense_codes_.clear();
+  sparse_codes_.clear();
+  if (symbol_bits_ <= kMaxDenseSymbolBits) {
+    const HuffmanCode unused = {0, 0};
+    dense_codes_.assign(size_t(1) << symbol_bits_, unused);
+    for (const HuffmanCodeword& codeword : codewords_) {
+      if (static_cast<size_t>(codeword.symbol) >= dense_codes_.size()) {
+        throw runtime_error("Symbol exceeds the symbol size.");
+      }
+      dense_codes_[codeword.symbol] = codeword.code;
+    }
+  } else {
+    for (const HuffmanCodeword& codeword : codewords_) {
+      sparse_codes_.insert(make_pair(codeword.symbol, codeword.code));
+    }
+  }
+  decode_table_ = HuffmanDecodeTable(codewords_);
+}
+
+void HuffmanCodec::AppendCodewords(const int* symbols, size_t count,
+                                   vector<bool>* encoded) const {
+  for (size_t i = 0; i < count; ++i) {
+    const HuffmanCode& code = CodeFor(symbols[i]);
+    for (uint32_t bit = code.length; bit > 0; --bit) {
+      encoded->push_back((code.code >> (bit - 1)) & 0x1);
+    }
   }
 }
 
@@ -88,51 +240,180 @@ vector<bool> HuffmanCodec::Encode(const VFrameDeque& frame_deque) {
     CHECK_EQ(frame_size_, frame.size()) << "Frame size mismatch: "
                                         << frame.size() << " " << frame_size_;
     vector<int> symbols = FrameToSymbols(frame);
-    for (int symbol : symbols) {
-      const vector<bool>& codeword = symbol_to_codeword_.at(symbol);
-      encoded.insert(encoded.end(), codeword.begin(), codeword.end());
-    }
+    AppendCodewords(symbols.data(), symbols.size(), &encoded);
   }
   return encoded;
 }
 
+vector<bool> HuffmanCodec::Encode(const VFrameView& frames) {
+  CHECK_EQ(frame_size_, frames.frame_size())
+      << "Frame size mismatch: " << frames.frame_size() << " " << frame_size_;
+  vector<bool> encoded;
+  SymbolEncoder encoder = {this, &encoded};
+  ForEachFrameSymbols(frames, symbol_bits_, &encoder);
+  return encoded;
+}
+
+vector<bool> HuffmanCodec::Encode(const PackedFv& bits) {
+  return Encode(VFrameView(bits, frame_size_));
+}
+
 vector<bool> HuffmanCodec::EncodeFrame(const VFrameFv& frame) {
   vector<bool> encoded;
   CHECK_EQ(frame_size_, frame.size()) << "Frame size mismatch: "
                                       << frame.size() << " " << frame_size_;
   vector<int> symbols = FrameToSymbols(frame);
-  for (int symbol : symbols) {
-    const vector<bool>& codeword = symbol_to_codeword_.at(symbol);
-    encoded.insert(encoded.end(), codeword.begin(), codeword.end());
-  }
+  AppendCodewords(symbols.data(), symbols.size(), &encoded);
   return encoded;
 }
 
+size_t HuffmanCodec::EncodedBits(const VFrameView& frames) const {
+  CHECK_EQ(frame_size_, frames.frame_size())
+      << "Frame size mismatch: " << frames.frame_size() << " " << frame_size_;
+  BitCounter counter = {this, 0};
+  ForEachFrameSymbols(frames, symbol_bits_, &counter);
+  return counter.num_bits;
+}
+
+size_t HuffmanCodec::Encode(const VFrameView& frames, uint8_t* out) const {
+  CHECK_EQ(frame_size_, frames.frame_size())
+      << "Frame size mismatch: " << frames.frame_size() << " " << frame_size_;
+  BitWriter writer(out);
+  BitWriterEncoder encoder = {this, &writer};
+  ForEachFrameSymbols(frames, symbol_bits_, &encoder);
+  writer.Flush();
+  return writer.bits_written();
+}
+
 vector<int> HuffmanCodec::Decode(const vector<bool>& bits) {
   vector<int> decoded;
-  HuffmanNode* current_node = CHECK_NOTNULL(code_tree_root_);
-  for (bool bit : bits) {
-    current_node = bit ? current_node->right : current_node->left;
-    if (current_node->is_leaf_node) {
-      decoded.push_back(current_node->symbol);
-      current_node = code_tree_root_;
-    }
+  const vector<uint64_t> words = HuffmanDecodeTable::PackBits(bits);
+  CHECK(decode_table_.Decode(words.data(), bits.size(), &decoded))
+      << "Bits did not end on leaf.";
+  return decoded;
+}
+
+vector<int> HuffmanCodec::Decode(const uint8_t* bytes, size_t num_bits) const {
+  vector<int> decoded;
+  const vector<uint64_t> words = HuffmanDecodeTable::PackBytes(bytes, num_bits);
+  CHECK(decode_table_.Decode(words.data(), num_bits, &decoded))
+      << "Bits did not end on leaf.";
+  return decoded;
+}
+
+HuffmanBlocks HuffmanCodec::EncodeBlocks(const VFrameView& frames,
+                                         size_t frames_per_block,
+                                         size_t num_threads) const {
+  CHECK_EQ(frame_size_, frames.frame_size())
+      << "Frame size mismatch: " << frames.frame_size() << " " << frame_size_;
+  if (frames_per_block == 0) {
+    throw invalid_argument("Blocks must hold at least one frame.");
+  }
+  HuffmanBlocks blocks;
+  blocks.frames_per_block = frames_per_block;
+  blocks.num_frames = frames.num_frames();
+  const size_t num_blocks =
+      (frames.num_frames() + frames_per_block - 1) / frames_per_block;
+
+  // Size every block first, so that each can be written straight to its
+  // place in the output.
+  vector<size_t> block_bits(num_blocks);
+  ThreadPool::RunParallel(num_blocks, num_threads, [&] (size_t, size_t block) {
+    block_bits[block] = EncodedBits(frames.Subview(
+        block * frames_per_block, blocks.BlockFrames(block)));
+  });
+  size_t start = 0;
+  for (size_t block = 0; block < num_blocks; ++block) {
+    blocks.block_end_bits.push_back(start + block_bits[block]);
+    start = blocks.BlockStartBit(block + 1);
+  }
+  blocks.bytes.resize(start / 8);
+
+  ThreadPool::RunParallel(num_blocks, num_threads, [&] (size_t, size_t block) {
+    Encode(frames.Subview(block * frames_per_block, blocks.BlockFrames(block)),
+           blocks.bytes.data() + blocks.BlockStartBit(block) / 8);
+  });
+  return blocks;
+}
+
+vector<int> HuffmanCodec::DecodeBlock(const HuffmanBlocks& blocks,
+                                      size_t block) const {
+  const size_t start = blocks.BlockStartBit(block);
+  const size_t num_bits = blocks.block_end_bits[block] - start;
+  vector<int> decoded = Decode(blocks.bytes.data() + start / 8, num_bits);
+  CHECK_EQ(decoded.size(), blocks.BlockFrames(block) *
+                           SymbolsPerFrame(frame_size_, symbol_bits_))
+      << "Block holds the wrong number of symbols.";
+  return decoded;
+}
+
+vector<int> HuffmanCodec::DecodeBlocks(const HuffmanBlocks& blocks,
+                                       size_t num_threads) const {
+  const size_t symbols_per_frame = SymbolsPerFrame(frame_size_, symbol_bits_);
+  vector<int> decoded(blocks.num_frames * symbols_per_frame);
+  ThreadPool::RunParallel(blocks.num_blocks(), num_threads,
+                          [&] (size_t, size_t block) {
+    const vector<int> symbols = DecodeBlock(blocks, block);
+    copy(symbols.begin(), symbols.end(), decoded.begin() +
+         block * blocks.frames_per_block * symbols_per_frame);
+  });
+  return decoded;
+}
+
+vector<int> HuffmanCodec::DecodeFrames(const HuffmanBlocks& blocks,
+                                       size_t first_frame,
+                                       size_t num_frames) const {
+  if (first_frame + num_frames > blocks.num_frames) {
+    throw out_of_range("Frames exceed the encoded stream.");
+  }
+  const size_t symbols_per_frame = SymbolsPerFrame(frame_size_, symbol_bits_);
+  vector<int> decoded;
+  size_t frame = first_frame;
+  const size_t end_frame = first_frame + num_frames;
+  while (frame < end_frame) {
+    const size_t block = frame / blocks.frames_per_block;
+    const size_t block_first = block * blocks.frames_per_block;
+    const size_t block_end =
+        min(end_frame, block_first + blocks.BlockFrames(block));
+    const vector<int> symbols = DecodeBlock(blocks, block);
+    decoded.insert(decoded.end(),
+                   symbols.begin() + (frame - block_first) * symbols_per_frame,
+                   symbols.begin() + (block_end - block_first) *
+                                         symbols_per_frame);
+    frame = block_end;
   }
-  CHECK_EQ(code_tree_root_, current_node) << "Bits did not end on leaf.";
   return decoded;
 }
 
-int HuffmanCodec::FourValueBitsToSymbol(
-    const FourValueLogic* fv_array, size_t num_bits) const {
-  int encoded = 0;
-  for (size_t bit = 0; bit < num_bits; ++bit) {
-    encoded = encoded << 1;
-    // Treat X, Z as zeroes.
-    if (fv_array[bit] == FourValueLogic::ONE) {
-      encoded |= 1;
+vector<uint8_t> HuffmanCodec::SerializeCodeTable() const {
+  vector<uint8_t> table;
+  PutUint32(static_cast<uint32_t>(frame_size_), &table);
+  table.push_back(static_cast<uint8_t>(symbol_bits_));
+  // Use whichever format is smaller.
+  const size_t sparse_bytes = 4 + 5 * codewords_.size();
+  if (symbol_bits_ <= kMaxDenseSymbolBits &&
+      (size_t(1) << symbol_bits_) <= sparse_bytes) {
+    table.push_back(kDenseCodeTable);
+    for (const HuffmanCode& code : dense_codes_) {
+      table.push_back(static_cast<uint8_t>(code.length));
+    }
+  } else {
+    table.push_back(kSparseCodeTable);
+    PutUint32(static_cast<uint32_t>(codewords_.size()), &table);
+    for (const HuffmanCodeword& codeword : codewords_) {
+      PutUint32(static_cast<uint32_t>(codeword.symbol), &table);
+      table.push_back(static_cast<uint8_t>(codeword.code.length));
     }
   }
-  return encoded;
+  return table;
+}
+
+int HuffmanCodec::FourValueBitsToSymbol(
+    const FourValueLogic* fv_array, size_t num_bits) const {
+  // Pack to bit-planes; X and Z are treated as zeroes.
+  base::simd::Word value, unknown;
+  base::simd::PackFv(fv_array, num_bits, &value, &unknown);
+  return static_cast<int>(value & ~unknown);
 }
 
 vector<int> HuffmanCodec::FrameToSymbols(const base::VFrameFv& frame) {
@@ -147,22 +428,6 @@ vector<int> HuffmanCodec::FrameToSymbols(const base::VFrameFv& frame) {
   return symbols;
 }
 
-void HuffmanCodec::BuildCodeTableRecursive(
-    const HuffmanNode* node,
-    std::vector<bool>* code,
-    std::unordered_map<int, std::vector<bool>>* table) {
-  if (CHECK_NOTNULL(node)->is_leaf_node) {
-    table->insert(std::make_pair(node->symbol, *code));
-  } else {
-    code->push_back(false);
-    BuildCodeTableRecursive(node->left, code, table);
-    code->pop_back();
-    code->push_back(true);
-    BuildCodeTableRecursive(node->right, code, table);
-    code->pop_back();
-  }
-}
-
 void HuffmanCodec::PrintCodeTable() const {
   cout << "Symbol Frequencies:\n";
   for (const auto&p : symbol_to_freq_) {
@@ -170,10 +435,10 @@ void HuffmanCodec::PrintCodeTable() const {
   }
   cout << endl;
   cout << "Huffman Code Table\n";
-  for (const auto& p : symbol_to_codeword_) {
-    cout << p.first << " ";
-    for (bool b : p.second) {
-      if (b) {
+  for (const HuffmanCodeword& codeword : codewords_) {
+    cout << codeword.symbol << " ";
+    for (uint32_t bit = codeword.code.length; bit > 0; --bit) {
+      if ((codeword.code.code >> (bit - 1)) & 0x1) {
         cout << "1";
       } else {
         cout << "0";
@@ -189,14 +454,20 @@ void HuffmanCodec::PrintCompressionData() const {
     orig_size += p.second;
   }
   orig_size *= symbol_bits_;
-  unsigned long long compressed_size = 0;
-  for (const auto& p : symbol_to_freq_) {
-    compressed_size += (p.second * symbol_to_codeword_.at(p.first).size());
-  }
+  unsigned long long compressed_size = TrainingEncodedBits();
   double compression_ratio = double(compressed_size) / orig_size;
   cout << "Original bits: " << orig_size << endl;
   cout << "Compressed bits: " << compressed_size << endl;
   cout << "Ratio: " << compression_ratio << endl;
+  cout << "Longest codeword: " << LongestCodeLength() << endl;
+  if (max_code_length_ != 0) {
+    const double unlimited_ratio =
+        double(unlimited_training_bits_) / orig_size;
+    cout << "Codeword length limit: " << max_code_length_ << endl;
+    cout << "Unlimited compressed bits: " << unlimited_training_bits_ << endl;
+    cout << "Ratio lost to length limit: "
+         << compression_ratio - unlimited_ratio << endl;
+  }
 }
 
 }  // namespace codec
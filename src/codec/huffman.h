@@ -8,33 +8,141 @@
 #ifndef SIGNAL_CONTENT_CODEC_HUFFMAN_H_
 #define SIGNAL_CONTENT_CODEC_HUFFMAN_H_
 
-#include <queue>
+#include <algorithm>
+#include <cstdint>
 #include <map>
 #include <stdexcept>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "../base/four_value_logic.h"
 #include "../base/frame_fv.h"
+#include "../base/frame_view.h"
 #include "../base/macros.h"
+#include "../base/packed_fv.h"
+#include "huffman_code.h"
+#include "huffman_decode_table.h"
+#include "symbol_histogram.h"
 
 namespace signal_content {
 namespace codec {
 
-struct HuffmanNode;
+// A stream encoded as independent blocks of 'frames_per_block' frames (the
+// last block may be short). Each block starts on a byte boundary, and
+// 'block_end_bits' holds the bit offset just past the data of each block, so
+// the start of any block is known without decoding anything before it. The
+// index costs 64 bits and the alignment at most 7 bits per block.
+struct HuffmanBlocks {
+  size_t num_blocks() const { return block_end_bits.size(); }
+  size_t BlockStartBit(size_t block) const {
+    return (block == 0) ? 0 : (block_end_bits[block - 1] + 7) / 8 * 8;
+  }
+  size_t BlockFrames(size_t block) const {
+    return std::min(frames_per_block, num_frames - block * frames_per_block);
+  }
+  // Encoded size including the index.
+  size_t TotalBits() const { return bytes.size() * 8 + 64 * num_blocks(); }
+
+  size_t frames_per_block;
+  size_t num_frames;
+  std::vector<uint64_t> block_end_bits;
+  std::vector<uint8_t> bytes;
+};
 
 class HuffmanCodec {
  public:
-  HuffmanCodec(const base::VFrameDeque& frame_deque, size_t symbol_bits);
-  ~HuffmanCodec();
+  // Codes are stored in a table indexed by symbol value for symbols of up to
+  // this many bits, and in a hash table for wider symbols.
+  static const size_t kMaxDenseSymbolBits = 20;
+
+  // A nonzero 'max_code_length' limits the codeword length, e.g. to bound the
+  // depth of a hardware decoder, at some cost in compression. The code stays
+  // optimal among codes that respect the limit.
+  HuffmanCodec(const base::VFrameDeque& frame_deque, size_t symbol_bits,
+               size_t max_code_length = 0);
+  // Symbols are counted with 'num_threads' workers (0 means one per hardware
+  // thread).
+  HuffmanCodec(const base::VFrameView& frames, size_t symbol_bits,
+               size_t max_code_length = 0, size_t num_threads = 0);
+  // Trains on a packed stream that is split into frames of 'frame_size' bits.
+  HuffmanCodec(const base::PackedFv& bits, size_t frame_size,
+               size_t symbol_bits, size_t max_code_length = 0,
+               size_t num_threads = 0);
+  // Builds the code from symbol counts gathered elsewhere, e.g. over a stream
+  // that arrives in chunks.
+  HuffmanCodec(const SymbolHistogram& histogram, size_t frame_size,
+               size_t max_code_length = 0);
+  // Restores a codec from the output of SerializeCodeTable. The restored
+  // codec encodes and decodes, but has no symbol frequencies.
+  explicit HuffmanCodec(const std::vector<uint8_t>& code_table);
 
   std::vector<bool> Encode(const base::VFrameDeque& frames);
+  std::vector<bool> Encode(const base::VFrameView& frames);
+  std::vector<bool> Encode(const base::PackedFv& bits);
   std::vector<bool> EncodeFrame(const base::VFrameFv& frame);
+
+  // Exact size in bits of the encoding of 'frames'.
+  size_t EncodedBits(const base::VFrameView& frames) const;
+  // Encodes 'frames' into 'out', which must hold
+  // BitWriter::BytesForBits(EncodedBits(frames)) bytes. Returns the number of
+  // bits written.
+  size_t Encode(const base::VFrameView& frames, uint8_t* out) const;
+
   std::vector<int> Decode(const std::vector<bool>& bits);
+  // Decodes the first 'num_bits' bits of 'bytes', as written by Encode.
+  std::vector<int> Decode(const uint8_t* bytes, size_t num_bits) const;
+
+  // Encodes 'frames' as independent blocks, using 'num_threads' workers (0
+  // means one per hardware thread).
+  HuffmanBlocks EncodeBlocks(const base::VFrameView& frames,
+                             size_t frames_per_block,
+                             size_t num_threads = 0) const;
+  // Decodes all blocks in parallel.
+  std::vector<int> DecodeBlocks(const HuffmanBlocks& blocks,
+                                size_t num_threads = 0) const;
+  // Decodes the symbols of 'num_frames' frames starting at 'first_frame',
+  // decoding only the blocks that hold them.
+  std::vector<int> DecodeFrames(const HuffmanBlocks& blocks,
+                                size_t first_frame, size_t num_frames) const;
+
+  // Serializes the code as frame size, symbol size and the codeword length of
+  // each symbol; the codewords themselves follow from the canonical order.
+  std::vector<uint8_t> SerializeCodeTable() const;
+
+  const HuffmanCode& CodeFor(int symbol) const {
+    if (!dense_codes_.empty()) {
+      if (static_cast<size_t>(symbol) < dense_codes_.size() &&
+          dense_codes_[symbol].length != 0) {
+        return dense_codes_[symbol];
+      }
+    } else {
+      auto it = sparse_codes_.find(symbol);
+      if (it != sparse_codes_.end()) {
+        return it->second;
+      }
+    }
+    throw std::out_of_range("Symbol is not in the code table.");
+  }
+
+  // Length of the longest codeword.
+  size_t LongestCodeLength() const;
+
+  // Compressed size of the training data, and what it would have been
+  // without the codeword length limit.
+  size_t TrainingEncodedBits() const;
+  size_t UnlimitedTrainingEncodedBits() const {
+    return unlimited_training_bits_;
+  }
+
   void PrintCodeTable() const;
   void PrintCompressionData() const;
 
  private:
+  struct SymbolEncoder;
+  struct BitCounter;
+  struct BitWriterEncoder;
+
   // Represent a series of four-value bits as a multi-bit symbol.
   int FourValueBitsToSymbol(
       const base::FourValueLogic* fv_array, size_t num_bits) const;
@@ -42,45 +150,32 @@ class HuffmanCodec {
   // Extract integer symbols for an entire frame.
   std::vector<int> FrameToSymbols(const base::VFrameFv& frame);
 
-  void BuildCodeTableRecursive(
-      const HuffmanNode* node,
-      std::vector<bool>* code,
-      std::unordered_map<int, std::vector<bool>>* table);
+  // Appends the codewords of 'symbols' to 'encoded'.
+  void AppendCodewords(const int* symbols, size_t count,
+                       std::vector<bool>* encoded) const;
 
-  size_t frame_size_;
-  size_t symbol_bits_;
-  std::unordered_map<int, std::vector<bool>> symbol_to_codeword_;
-  std::unordered_map<int, size_t> symbol_to_freq_;
-  HuffmanNode* code_tree_root_{nullptr};
-};
+  // Decodes one block, checking that it holds the expected symbols.
+  std::vector<int> DecodeBlock(const HuffmanBlocks& blocks,
+                               size_t block) const;
 
-struct HuffmanNode {
-  HuffmanNode(bool leaf, int freq, int sym, HuffmanNode* l, HuffmanNode* r,
-              HuffmanNode* p)
-      : is_leaf_node(leaf), frequency(freq), symbol(sym), left(l), right(r),
-        parent(p) {}
-  ~HuffmanNode() {
-    if (left != nullptr) {
-      delete left;
-    }
-    if (right != nullptr) {
-      delete right;
-    }
-  }
+  // Builds the canonical code from symbol_to_freq_.
+  void BuildCodeTree();
 
-  bool is_leaf_node{true};
-  int frequency{0};
-  int symbol{0};
-  HuffmanNode* left{nullptr};
-  HuffmanNode* right{nullptr};
-  HuffmanNode* parent{nullptr};
-};
+  // Builds the symbol-indexed tables and the decode table from codewords_,
+  // which must be in canonical order.
+  void BuildCodeTables();
 
-// Functor for priority queue.
-struct HuffmanNodePointerGreater {
-  bool operator() (const HuffmanNode* a, const HuffmanNode* b) {
-    return CHECK_NOTNULL(a)->frequency > CHECK_NOTNULL(b)->frequency;
-  }
+  size_t frame_size_;
+  size_t symbol_bits_;
+  size_t max_code_length_{0};
+  size_t unlimited_training_bits_{0};
+  // Codewords in canonical order.
+  std::vector<HuffmanCodeword> codewords_;
+  // Codes indexed by symbol value. Unused symbols have a length of zero.
+  std::vector<HuffmanCode> dense_codes_;
+  std::unordered_map<int, HuffmanCode> sparse_codes_;
+  std::unordered_map<int, size_t> symbol_to_freq_;
+  HuffmanDecodeTable decode_table_;
 };
 
 }  // codec
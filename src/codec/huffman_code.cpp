@@ -0,0 +1,192 @@
+/*
+ * huffman_code.cpp
+ */
+
+#include "huffman_code.h"
+
+#include <algorithm>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace signal_content {
+namespace codec {
+
+namespace {
+
+bool CanonicalOrder(const HuffmanCodeword& a, const HuffmanCodeword& b) {
+  if (a.code.length != b.code.length) {
+    return a.code.length < b.code.length;
+  }
+  return a.symbol < b.symbol;
+}
+
+// An entry of a package-merge list: either a symbol, or a package of two
+// consecutive entries of the list for the next longer length.
+struct Coin {
+  size_t weight;
+  // Index of the symbol, or -1 for a package.
+  int symbol_index;
+};
+
+}  // namespace
+
+vector<HuffmanCodeword> HuffmanCodeLengths(
+    const unordered_map<int, size_t>& symbol_to_freq) {
+  vector<HuffmanCodeword> codewords;
+  if (symbol_to_freq.size() == 1) {
+    HuffmanCodeword lone = {symbol_to_freq.begin()->first, {0, 1}};
+    codewords.push_back(lone);
+    return codewords;
+  }
+  if (symbol_to_freq.empty()) {
+    return codewords;
+  }
+
+  // Build the code tree. Start by creating all leaf nodes, then build the
+  // tree from the bottom up.
+  priority_queue<HuffmanNode*, vector<HuffmanNode*>,
+                 HuffmanNodePointerGreater> freq_sorted_nodes;
+  for (const auto& p : symbol_to_freq) {
+    freq_sorted_nodes.push(
+        new HuffmanNode(true, p.second, p.first, nullptr, nullptr, nullptr));
+  }
+  while (freq_sorted_nodes.size() > 1) {
+    HuffmanNode* n1 = freq_sorted_nodes.top();
+    freq_sorted_nodes.pop();
+    HuffmanNode* n2 = freq_sorted_nodes.top();
+    freq_sorted_nodes.pop();
+    HuffmanNode* parent = new HuffmanNode(
+        false, n1->frequency + n2->frequency, 0, n1, n2, nullptr);
+    n1->parent = parent;
+    n2->parent = parent;
+    freq_sorted_nodes.push(parent);
+  }
+  // Ownership of all nodes in the tree is transferred to the root.
+  unique_ptr<HuffmanNode> root(freq_sorted_nodes.top());
+
+  // The code length of each symbol is the depth of its leaf.
+  vector<pair<const HuffmanNode*, uint32_t>> stack;
+  stack.push_back(make_pair(root.get(), 0));
+  while (!stack.empty()) {
+    const HuffmanNode* node = stack.back().first;
+    const uint32_t depth = stack.back().second;
+    stack.pop_back();
+    if (node->is_leaf_node) {
+      if (depth > kMaxHuffmanCodeLength) {
+        throw runtime_error("Huffman codeword exceeds 64 bits.");
+      }
+      HuffmanCodeword codeword = {node->symbol, {0, depth}};
+      codewords.push_back(codeword);
+    } else {
+      stack.push_back(make_pair(node->left, depth + 1));
+      stack.push_back(make_pair(node->right, depth + 1));
+    }
+  }
+  return codewords;
+}
+
+vector<HuffmanCodeword> LengthLimitedHuffmanCodeLengths(
+    const unordered_map<int, size_t>& symbol_to_freq, size_t max_length) {
+  const size_t num_symbols = symbol_to_freq.size();
+  if (max_length == 0 || max_length > kMaxHuffmanCodeLength ||
+      (max_length < 64 && (size_t(1) << max_length) < num_symbols)) {
+    throw invalid_argument("Maximum code length cannot hold the alphabet.");
+  }
+  if (num_symbols <= 1) {
+    return HuffmanCodeLengths(symbol_to_freq);
+  }
+
+  // Symbols in increasing order of frequency.
+  vector<pair<size_t, int>> sorted_symbols;
+  for (const auto& p : symbol_to_freq) {
+    sorted_symbols.push_back(make_pair(p.second, p.first));
+  }
+  sort(sorted_symbols.begin(), sorted_symbols.end());
+  vector<Coin> leaves;
+  for (size_t i = 0; i < num_symbols; ++i) {
+    const Coin leaf = {sorted_symbols[i].first, static_cast<int>(i)};
+    leaves.push_back(leaf);
+  }
+
+  // lists[0] holds the coins for the longest length. Each shorter length
+  // merges the symbols with the pairwise packages of the list before it.
+  vector<vector<Coin>> lists(max_length);
+  lists[0] = leaves;
+  for (size_t level = 1; level < max_length; ++level) {
+    const vector<Coin>& previous = lists[level - 1];
+    vector<Coin>& list = lists[level];
+    list.reserve(num_symbols + previous.size() / 2);
+    size_t leaf = 0;
+    size_t package = 0;
+    const size_t num_packages = previous.size() / 2;
+    while (leaf < num_symbols || package < num_packages) {
+      const size_t package_weight = (package < num_packages) ?
+          previous[2 * package].weight + previous[2 * package + 1].weight : 0;
+      // Symbols go first on ties, which favors shallower packages.
+      if (package == num_packages ||
+          (leaf < num_symbols && leaves[leaf].weight <= package_weight)) {
+        list.push_back(leaves[leaf++]);
+      } else {
+        const Coin coin = {package_weight, -1};
+        list.push_back(coin);
+        ++package;
+      }
+    }
+  }
+
+  // Select the 2n - 2 cheapest coins of the shortest length. The packages
+  // among them expand into a prefix of the list below, and so on; every
+  // selected symbol coin adds one to that symbol's length.
+  vector<uint32_t> lengths(num_symbols, 0);
+  size_t active = 2 * num_symbols - 2;
+  for (size_t level = max_length; level-- > 0;) {
+    size_t packages = 0;
+    for (size_t i = 0; i < active; ++i) {
+      const Coin& coin = lists[level][i];
+      if (coin.symbol_index >= 0) {
+        ++lengths[coin.symbol_index];
+      } else {
+        ++packages;
+      }
+    }
+    active = 2 * packages;
+  }
+
+  vector<HuffmanCodeword> codewords;
+  for (size_t i = 0; i < num_symbols; ++i) {
+    HuffmanCodeword codeword = {sorted_symbols[i].second, {0, lengths[i]}};
+    codewords.push_back(codeword);
+  }
+  return codewords;
+}
+
+void AssignCanonicalCodes(vector<HuffmanCodeword>* codewords) {
+  sort(codewords->begin(), codewords->end(), CanonicalOrder);
+  uint64_t code = 0;
+  uint32_t length = 0;
+  bool exhausted = false;
+  for (HuffmanCodeword& codeword : *codewords) {
+    if (codeword.code.length == 0 ||
+        codeword.code.length > kMaxHuffmanCodeLength) {
+      throw invalid_argument("Invalid Huffman code length.");
+    }
+    // Every codeword of the current length is taken.
+    if (exhausted || (length > 0 && length < 64 && (code >> length) != 0)) {
+      throw invalid_argument("Huffman code lengths are oversubscribed.");
+    }
+    if (code != 0) {
+      code <<= codeword.code.length - length;
+    }
+    length = codeword.code.length;
+    codeword.code.code = code;
+    ++code;
+    exhausted = (code == 0);
+  }
+}
+
+}  // namespace codec
+}  // namespace signal_content
@@ -0,0 +1,91 @@
+/*
+ * huffman_code.h
+ *
+ * Construction of Huffman code lengths from symbol frequencies, and canonical
+ * codeword assignment. A canonical code is fully determined by the length of
+ * each symbol's codeword: symbols are ordered by (length, symbol) and given
+ * consecutive codes, shifting left whenever the length grows. Only the
+ * lengths need to be stored or transmitted.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_HUFFMAN_CODE_H_
+#define SIGNAL_CONTENT_CODEC_HUFFMAN_CODE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../base/macros.h"
+
+namespace signal_content {
+namespace codec {
+
+// Codewords are limited to the width of a bit-writer register.
+const size_t kMaxHuffmanCodeLength = 64;
+
+// A codeword, right-aligned in 'code'; its first bit is bit 'length' - 1.
+struct HuffmanCode {
+  uint64_t code;
+  uint32_t length;
+};
+
+struct HuffmanCodeword {
+  int symbol;
+  HuffmanCode code;
+};
+
+// Computes optimal (unlimited) code lengths for every symbol with a nonzero
+// frequency. A lone symbol gets a length of one so that it stays decodable.
+// Throws std::runtime_error if a codeword would exceed kMaxHuffmanCodeLength.
+// The codes of the result are not assigned.
+std::vector<HuffmanCodeword> HuffmanCodeLengths(
+    const std::unordered_map<int, size_t>& symbol_to_freq);
+
+// Computes optimal code lengths subject to a maximum codeword length, using
+// package-merge. Symbols are taken as coins of width 2^-l for each length l
+// up to 'max_length'; the cheapest set of coins of total width n - 1 gives
+// each symbol a length equal to the number of its coins in the set. Takes
+// O(n * max_length) time. Throws std::invalid_argument if 'max_length' cannot
+// hold the alphabet.
+std::vector<HuffmanCodeword> LengthLimitedHuffmanCodeLengths(
+    const std::unordered_map<int, size_t>& symbol_to_freq, size_t max_length);
+
+// Sorts 'codewords' into canonical order and assigns their codes from their
+// lengths. Throws std::invalid_argument if the lengths violate the Kraft
+// inequality.
+void AssignCanonicalCodes(std::vector<HuffmanCodeword>* codewords);
+
+struct HuffmanNode {
+  HuffmanNode(bool leaf, size_t freq, int sym, HuffmanNode* l, HuffmanNode* r,
+              HuffmanNode* p)
+      : is_leaf_node(leaf), frequency(freq), symbol(sym), left(l), right(r),
+        parent(p) {}
+  ~HuffmanNode() {
+    if (left != nullptr) {
+      delete left;
+    }
+    if (right != nullptr) {
+      delete right;
+    }
+  }
+
+  bool is_leaf_node{true};
+  size_t frequency{0};
+  int symbol{0};
+  HuffmanNode* left{nullptr};
+  HuffmanNode* right{nullptr};
+  HuffmanNode* parent{nullptr};
+};
+
+// Functor for priority queue.
+struct HuffmanNodePointerGreater {
+  bool operator() (const HuffmanNode* a, const HuffmanNode* b) {
+    return CHECK_NOTNULL(a)->frequency > CHECK_NOTNULL(b)->frequency;
+  }
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_HUFFMAN_CODE_H_ */
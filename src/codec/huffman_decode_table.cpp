@@ -0,0 +1,163 @@
+/*
+ * huffman_decode_table.cpp
+ */
+
+#include "huffman_decode_table.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+namespace signal_content {
+namespace codec {
+
+HuffmanDecodeTable::HuffmanDecodeTable(
+    const vector<HuffmanCodeword>& codewords) {
+  if (!codewords.empty()) {
+    BuildTable(codewords, 0, kPrimaryBits, &root_bits_);
+  }
+}
+
+size_t HuffmanDecodeTable::BuildTable(
+    const vector<HuffmanCodeword>& codewords, size_t consumed,
+    size_t max_bits, size_t* table_bits) {
+  size_t longest = 0;
+  for (const HuffmanCodeword& codeword : codewords) {
+    longest = max<size_t>(longest, codeword.code.length - consumed);
+  }
+  const size_t bits = min(longest, max_bits);
+  const size_t offset = entries_.size();
+  const Entry unused = {0, 0, 0};
+  entries_.resize(offset + (size_t(1) << bits), unused);
+
+  // Codewords that end in this table fill every entry they prefix; longer
+  // ones are grouped by their index here and get a table of their own.
+  map<size_t, vector<HuffmanCodeword>> overflow;
+  for (const HuffmanCodeword& codeword : codewords) {
+    const size_t remaining = codeword.code.length - consumed;
+    const size_t used = min(remaining, bits);
+    // The 'used' bits following the first 'consumed' bits of the codeword.
+    const uint64_t tail = (remaining == 64) ? codeword.code.code :
+        codeword.code.code & ((uint64_t(1) << remaining) - 1);
+    size_t index = static_cast<size_t>(tail >> (remaining - used));
+    index <<= bits - used;
+    if (remaining <= bits) {
+      const Entry leaf = {codeword.symbol, static_cast<uint8_t>(remaining), 0};
+      fill(entries_.begin() + offset + index,
+           entries_.begin() + offset + index + (size_t(1) << (bits - used)),
+           leaf);
+    } else {
+      overflow[index].push_back(codeword);
+    }
+  }
+
+  for (const auto& p : overflow) {
+    size_t sub_bits;
+    const size_t sub_offset =
+        BuildTable(p.second, consumed + bits, kSecondaryBits, &sub_bits);
+    // Entries may have moved while the subtable was built.
+    Entry& link = entries_[offset + p.first];
+    link.value = static_cast<int32_t>(sub_offset);
+    link.length = 0;
+    link.sub_bits = static_cast<uint8_t>(sub_bits);
+  }
+  *table_bits = bits;
+  return offset;
+}
+
+bool HuffmanDecodeTable::Decode(const uint64_t* words, size_t num_bits,
+                                vector<int>* symbols) const {
+  if (entries_.empty()) {
+    return num_bits == 0;
+  }
+  const Entry* const entries = entries_.data();
+  const size_t root_shift = 64 - root_bits_;
+  size_t pos = 0;
+  while (pos < num_bits) {
+    // Fast path: resolve primary-table codewords from a 64-bit window, so the
+    // loop-carried dependency is just a lookup and a shift.
+    uint64_t window = PeekBits(words, pos, 64);
+    size_t available = 64;
+    int decoded[64];
+    size_t num_decoded = 0;
+    while (available >= root_bits_ && pos < num_bits) {
+      const Entry& entry = entries[window >> root_shift];
+      if (entry.sub_bits != 0 || entry.length == 0) {
+        break;
+      }
+      if (pos + entry.length > num_bits) {
+        return false;
+      }
+      window <<= entry.length;
+      available -= entry.length;
+      pos += entry.length;
+      decoded[num_decoded++] = entry.value;
+    }
+    symbols->insert(symbols->end(), decoded, decoded + num_decoded);
+    if (pos >= num_bits || available < root_bits_) {
+      continue;
+    }
+
+    // Long codeword; walk the secondary tables.
+    const Entry* entry = entries + (window >> root_shift);
+    size_t consumed = root_bits_;
+    while (entry->sub_bits != 0) {
+      if (pos + consumed >= num_bits) {
+        return false;
+      }
+      const size_t sub_bits = entry->sub_bits;
+      entry = entries + entry->value +
+              PeekBits(words, pos + consumed, sub_bits);
+      if (entry->sub_bits != 0) {
+        consumed += sub_bits;
+      }
+    }
+    if (entry->length == 0 || pos + consumed + entry->length > num_bits) {
+      return false;
+    }
+    pos += consumed + entry->length;
+    symbols->push_back(entry->value);
+  }
+  return true;
+}
+
+vector<uint64_t> HuffmanDecodeTable::PackBits(const vector<bool>& bits) {
+  vector<uint64_t> words(bits.size() / 64 + 2, 0);
+  const size_t full_words = bits.size() / 64;
+  vector<bool>::const_iterator it = bits.begin();
+  for (size_t word = 0; word < full_words; ++word) {
+    uint64_t packed = 0;
+    for (int i = 0; i < 64; ++i, ++it) {
+      packed = (packed << 1) | uint64_t(*it);
+    }
+    words[word] = packed;
+  }
+  uint64_t packed = 0;
+  const size_t tail = bits.size() % 64;
+  for (size_t i = 0; i < tail; ++i, ++it) {
+    packed = (packed << 1) | uint64_t(*it);
+  }
+  if (tail != 0) {
+    words[full_words] = packed << (64 - tail);
+  }
+  return words;
+}
+
+vector<uint64_t> HuffmanDecodeTable::PackBytes(const uint8_t* bytes,
+                                               size_t num_bits) {
+  vector<uint64_t> words(num_bits / 64 + 2, 0);
+  const size_t num_bytes = (num_bits + 7) / 8;
+  for (size_t byte = 0; byte < num_bytes; ++byte) {
+    words[byte / 8] |= uint64_t(bytes[byte]) << (56 - 8 * (byte % 8));
+  }
+  // Clear any bits past the end of the stream in the last byte.
+  if (num_bits % 64 != 0) {
+    words[num_bits / 64] &= ~uint64_t(0) << (64 - num_bits % 64);
+  }
+  return words;
+}
+
+}  // namespace codec
+}  // namespace signal_content
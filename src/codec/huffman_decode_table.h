@@ -0,0 +1,115 @@
+/*
+ * huffman_decode_table.h
+ *
+ * Table-driven decoding of a prefix code. The next kPrimaryBits of input
+ * index a primary table whose entries either resolve a codeword directly or
+ * link to a secondary table for the remaining bits of longer codewords, so a
+ * typical symbol is decoded with one lookup instead of one branch per bit.
+ *
+ * The input is a stream of 64-bit words with the first bit in bit 63.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_HUFFMAN_DECODE_TABLE_H_
+#define SIGNAL_CONTENT_CODEC_HUFFMAN_DECODE_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "huffman_code.h"
+
+namespace signal_content {
+namespace codec {
+
+class HuffmanDecodeTable {
+ public:
+  static const size_t kPrimaryBits = 10;
+  static const size_t kSecondaryBits = 6;
+
+  HuffmanDecodeTable() {}
+  // 'codewords' must form a prefix code.
+  explicit HuffmanDecodeTable(const std::vector<HuffmanCodeword>& codewords);
+
+  // Decodes 'num_bits' bits from 'words', which must be followed by one
+  // readable padding word, and appends the symbols to 'symbols'. Returns
+  // false if the bits do not end on a codeword boundary or contain a bit
+  // sequence that is not a codeword.
+  bool Decode(const uint64_t* words, size_t num_bits,
+              std::vector<int>* symbols) const;
+
+  // Decodes the one codeword starting at bit '*pos' into 'symbol' and
+  // advances '*pos' past it. Returns false if the bits there are not a
+  // codeword that ends within 'num_bits'.
+  bool DecodeSymbol(const uint64_t* words, size_t num_bits, size_t* pos,
+                    int* symbol) const {
+    if (entries_.empty() || *pos >= num_bits) {
+      return false;
+    }
+    const Entry* entry = &entries_[PeekBits(words, *pos, root_bits_)];
+    size_t consumed = 0;
+    if (entry->sub_bits != 0) {
+      consumed = root_bits_;
+      while (true) {
+        if (*pos + consumed >= num_bits) {
+          return false;
+        }
+        const size_t sub_bits = entry->sub_bits;
+        entry = &entries_[entry->value +
+                          PeekBits(words, *pos + consumed, sub_bits)];
+        if (entry->sub_bits == 0) {
+          break;
+        }
+        consumed += sub_bits;
+      }
+    }
+    if (entry->length == 0 || *pos + consumed + entry->length > num_bits) {
+      return false;
+    }
+    *pos += consumed + entry->length;
+    *symbol = entry->value;
+    return true;
+  }
+
+  // Pack a bit vector, or the first 'num_bits' bits of a byte buffer with
+  // the first bit in bit 7, into words for Decode, including the padding
+  // word.
+  static std::vector<uint64_t> PackBits(const std::vector<bool>& bits);
+  static std::vector<uint64_t> PackBytes(const uint8_t* bytes,
+                                         size_t num_bits);
+
+ private:
+  // A leaf entry has 'sub_bits' == 0 and holds a symbol whose codeword ends
+  // 'length' bits into this table's index. A link entry holds the offset of a
+  // table indexed by the next 'sub_bits' bits. An entry with neither is not
+  // part of any codeword.
+  struct Entry {
+    int32_t value;
+    uint8_t length;
+    uint8_t sub_bits;
+  };
+
+  // Builds a table for 'codewords', which all share their first 'consumed'
+  // bits, and returns its offset in entries_. Stores its index width in
+  // 'table_bits'.
+  size_t BuildTable(const std::vector<HuffmanCodeword>& codewords,
+                    size_t consumed, size_t max_bits, size_t* table_bits);
+
+  // Returns the 'n' bits starting at bit 'pos', right-aligned.
+  static uint64_t PeekBits(const uint64_t* words, size_t pos, size_t n) {
+    const size_t word = pos >> 6;
+    const size_t shift = pos & 63;
+    uint64_t window = words[word] << shift;
+    if (shift != 0) {
+      window |= words[word + 1] >> (64 - shift);
+    }
+    return window >> (64 - n);
+  }
+
+  std::vector<Entry> entries_;
+  size_t root_bits_{0};
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_HUFFMAN_DECODE_TABLE_H_ */
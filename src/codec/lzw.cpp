@@ -9,6 +9,7 @@
 
 #include <cassert>
 
+#include <algorithm>
 #include <stdexcept>
 
 #include "../base/frame_fv.h"
@@ -18,55 +19,103 @@
 using namespace std;
 
 namespace signal_content {
+using base::PackedFv;
 using base::QueueFv;
 using base::VFrameDeque;
 
 namespace codec {
 
+LzwHashDictionary::LzwHashDictionary(size_t max_entries) {
+  size_t num_slots = 16;
+  hash_shift_ = 28;
+  while (num_slots < 2 * max_entries) {
+    num_slots *= 2;
+    --hash_shift_;
+  }
+  const Slot empty = {0, -1};
+  slots_.assign(num_slots, empty);
+  mask_ = static_cast<uint32_t>(num_slots - 1);
+}
+
+void LzwHashDictionary::Clear() {
+  const Slot empty = {0, -1};
+  fill(slots_.begin(), slots_.end(), empty);
+}
+
+LzwCodec::LzwCodec()
+    : dictionary_(kNumCodewords), codeword_offset_(kNumCodewords),
+      codeword_length_(kNumCodewords) {}
+
+size_t LzwCodec::DictionaryBytes() const {
+  return dictionary_.MemoryBytes() + symbol_arena_.size() +
+         (codeword_offset_.size() + codeword_length_.size()) *
+         sizeof(uint32_t);
+}
+
 vector<int> LzwCodec::Encode(const QueueFv& bit_stream) {
+  QueueFv copy = bit_stream;
+  return Encode(base::PackedFvFromQueueFv(std::move(copy)));
+}
+
+vector<int> LzwCodec::Encode(const PackedFv& bit_stream) {
   assert(next_codeword_slot_ > 255); // Check that dictionary has been populated.
   vector<int> encoded;
-  QueueFv qfv = bit_stream;
-  while (!qfv.empty()) {
-    encoded.push_back(GetCodeword256(&qfv));
+  size_t pos = 0;
+  while (pos < bit_stream.size()) {
+    encoded.push_back(GetCodeword256(bit_stream, &pos));
   }
   return encoded;
 }
 
 vector<bool> LzwCodec::Decode(const std::vector<int>& codewords) {
   vector<bool> decoded;
-  vector<unsigned char> symbols;
   for (int codeword : codewords) {
-    symbols.insert(symbols.end(),
-                   codeword_to_symbol_.at(codeword).begin(),
-                   codeword_to_symbol_.at(codeword).end());
-  }
-  for (unsigned char symbol : symbols) {
-    for (int mask = 0x0800; mask != 0; mask = mask >> 1) {
-      decoded.push_back(symbol & mask);
+    if (codeword < 0 || codeword >= next_codeword_slot_) {
+      throw out_of_range("Codeword is not in the dictionary.");
+    }
+    const unsigned char* symbol = &symbol_arena_[codeword_offset_[codeword]];
+    const unsigned char* end = symbol + codeword_length_[codeword];
+    for (; symbol != end; ++symbol) {
+      for (int mask = 0x80; mask != 0; mask = mask >> 1) {
+        decoded.push_back(*symbol & mask);
+      }
     }
   }
   return decoded;
 }
 
+void LzwCodec::PopulateDictionary(const QueueFv& queue_fv) {
+  QueueFv copy = queue_fv;
+  PopulateDictionary(base::PackedFvFromQueueFv(std::move(copy)));
+}
+
 // Currently only works for 256-ary nodes.
-void LzwCodec::PopulateDictionary(const base::QueueFv& queue_fv) {
+void LzwCodec::PopulateDictionary(const PackedFv& bits) {
   PopulateInitialMappings();
-  Node256Ary* n256 = code_tree_root_.get();
-  vector<unsigned char> symbol_string;
-  base::QueueFv qfv_copy = queue_fv;
-  while (!qfv_copy.empty() && next_codeword_slot_ < 4096) {
-    unsigned char symbol = Get8Bits(&qfv_copy);
-    symbol_string.push_back(symbol);
-    Node256Ary* next = n256->children.at(symbol).get();
-    if (next != nullptr) {
-      n256 = next;
+  // The codeword of the string matched so far, or -1 at the root.
+  int prefix = -1;
+  size_t pos = 0;
+  while (pos < bits.size() && next_codeword_slot_ < kNumCodewords) {
+    size_t num_bits;
+    unsigned char symbol = Peek8Bits(bits, pos, &num_bits);
+    pos += num_bits;
+    const int next = (prefix < 0) ? symbol : dictionary_.Find(prefix, symbol);
+    if (next >= 0) {
+      prefix = next;
     } else {
-      // Add new mapping between symbol string and codeword.
-      codeword_to_symbol_.at(next_codeword_slot_) = symbol_string;
-      symbol_string.clear();
-      n256->children.at(symbol).reset(new Node256Ary(next_codeword_slot_++));
-      n256 = code_tree_root_.get();
+      // Add new mapping between symbol string and codeword. The new string
+      // is the prefix's string plus 'symbol', appended to the arena.
+      const uint32_t offset = static_cast<uint32_t>(symbol_arena_.size());
+      const uint32_t prefix_length = codeword_length_[prefix];
+      symbol_arena_.resize(offset + prefix_length + 1);
+      copy(symbol_arena_.begin() + codeword_offset_[prefix],
+           symbol_arena_.begin() + codeword_offset_[prefix] + prefix_length,
+           symbol_arena_.begin() + offset);
+      symbol_arena_.back() = symbol;
+      codeword_offset_[next_codeword_slot_] = offset;
+      codeword_length_[next_codeword_slot_] = prefix_length + 1;
+      dictionary_.Insert(prefix, symbol, next_codeword_slot_++);
+      prefix = -1;
     }
   }
 }
@@ -75,43 +124,40 @@ void LzwCodec::PopulateInitialMappings() {
   // Add all 8-bit symbols
   assert(next_codeword_slot_ == 0);
   for (int symbol = 0; symbol < 256; ++symbol) {
-    codeword_to_symbol_.at(symbol).push_back(short(symbol));
-    // Will add to symbol codeword tree, since not yet present.
-    QueueFv q = base::QueueFvFromBits<int, 8>(symbol);
-
-    code_tree_root_->children.at(symbol).reset(
-        new Node256Ary(next_codeword_slot_));
+    codeword_offset_[symbol] = static_cast<uint32_t>(symbol_arena_.size());
+    codeword_length_[symbol] = 1;
+    symbol_arena_.push_back(static_cast<unsigned char>(symbol));
     next_codeword_slot_++;
   }
 }
 
-int LzwCodec::GetCodeword256(QueueFv* bit_queue) {
-  if (CHECK_NOTNULL(bit_queue)->size() < 8) {
+int LzwCodec::GetCodeword256(const PackedFv& bits, size_t* pos) const {
+  if (bits.size() - *CHECK_NOTNULL(pos) < 8) {
     throw std::runtime_error("Binary stream contained less than minimum "
                              "number of symbol bits");
   }
-  Node256Ary* node = CHECK_NOTNULL(code_tree_root_.get());
-  while (!bit_queue->empty()) {
-    unsigned char symbol = Get8Bits(bit_queue);
-    Node256Ary* next_node = node->children.at(symbol).get();
-    if (next_node == nullptr) {
-      return node->codeword;
-    } else {
-      node = next_node;
+  // Every single symbol is in the dictionary, so at least one is consumed.
+  int codeword = -1;
+  while (*pos < bits.size()) {
+    size_t num_bits;
+    unsigned char symbol = Peek8Bits(bits, *pos, &num_bits);
+    const int next =
+        (codeword < 0) ? symbol : dictionary_.Find(codeword, symbol);
+    if (next < 0) {
+      // The symbol is left in the stream to start the next codeword.
+      return codeword;
     }
+    codeword = next;
+    *pos += num_bits;
   }
-  return node->codeword;
+  return codeword;
 }
 
-unsigned char LzwCodec::Get8Bits(QueueFv* bit_queue) {
-  unsigned char ret = 0;
-  for (int i = 0; i < 8 && !bit_queue->empty(); ++i) {
-    base::FourValueLogic fvl_bit = bit_queue->front();
-    bit_queue->pop();
-    bool bit = fvl_bit == base::FourValueLogic::ONE ? 1 : 0;
-    ret = (ret << 1) | bit;
-  }
-  return ret;
+unsigned char LzwCodec::Peek8Bits(const PackedFv& bits, size_t pos,
+                                  size_t* num_bits) {
+  const size_t remaining = bits.size() - pos;
+  *num_bits = remaining < 8 ? remaining : 8;
+  return static_cast<unsigned char>(bits.PeekBits(pos, *num_bits));
 }
 
 }  // namespace codec
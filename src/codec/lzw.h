@@ -5,9 +5,13 @@
  *      Author: gregerso
  */
 
-#include <array>
-#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
 
+#include "../base/packed_fv.h"
 #include "../base/queue_fv.h"
 
 #ifndef LZW_H_
@@ -16,45 +20,374 @@
 namespace signal_content {
 namespace codec {
 
+// Maps (prefix codeword, symbol) pairs to the codeword of the extended
+// string, using open addressing with linear probing in one flat table. Both
+// halves of a pair are at most 16 bits wide. The table is kept at most half
+// full, so a lookup usually touches one slot.
+class LzwHashDictionary {
+ public:
+  explicit LzwHashDictionary(size_t max_entries);
+
+  // Returns the codeword for 'prefix' extended by 'symbol', or -1.
+  int Find(uint32_t prefix, uint32_t symbol) const {
+    const uint32_t key = Key(prefix, symbol);
+    for (uint32_t slot = Hash(key); ; slot = (slot + 1) & mask_) {
+      const Slot& s = slots_[slot];
+      if (s.codeword < 0 || s.key == key) {
+        return s.codeword;
+      }
+    }
+  }
+
+  // 'prefix' extended by 'symbol' must not already be present.
+  void Insert(uint32_t prefix, uint32_t symbol, int codeword) {
+    const uint32_t key = Key(prefix, symbol);
+    uint32_t slot = Hash(key);
+    while (slots_[slot].codeword >= 0) {
+      slot = (slot + 1) & mask_;
+    }
+    slots_[slot].key = key;
+    slots_[slot].codeword = codeword;
+  }
+
+  // Removes every entry.
+  void Clear();
+
+  size_t MemoryBytes() const { return slots_.size() * sizeof(Slot); }
+
+ private:
+  struct Slot {
+    uint32_t key;
+    // Negative if the slot is empty.
+    int32_t codeword;
+  };
+
+  static uint32_t Key(uint32_t prefix, uint32_t symbol) {
+    return (prefix << 16) | symbol;
+  }
+  // Fibonacci hashing: the slot is taken from the high bits of the product,
+  // which depend on every bit of the key.
+  uint32_t Hash(uint32_t key) const {
+    return (key * 2654435769u) >> hash_shift_;
+  }
+
+  std::vector<Slot> slots_;
+  uint32_t mask_;
+  uint32_t hash_shift_;
+};
+
 class LzwCodec {
  public:
-  LzwCodec() : code_tree_root_(new Node256Ary(-1)) {}
+  static const int kNumCodewords = 4096;
+
+  LzwCodec();
 
   // Assigns sequences of symbols from 'queue_fv' to codewords in the
   // the dictionary. Symbols are considered to be 8 bits, and codewords are
   // 12 bits.
   void PopulateDictionary(const base::QueueFv& queue_fv);
+  void PopulateDictionary(const base::PackedFv& bits);
 
   std::vector<int> Encode(const base::QueueFv& bits);
+  std::vector<int> Encode(const base::PackedFv& bits);
   std::vector<bool> Decode(const std::vector<int>& bits);
 
- private:
-  struct Node256Ary {
-    Node256Ary(int cw) : codeword(cw) {}
-    int codeword{-1};
-    // Initializes all to nullptr.
-    std::array<std::unique_ptr<Node256Ary>, 256> children;
-  };
+  // Bytes held by the encoding and decoding dictionaries.
+  size_t DictionaryBytes() const;
 
+ private:
   // Populates dictionaries with single symbol to codeword mappings.
   void PopulateInitialMappings();
 
-  // Peels off as many bits as possible until a codeword is found.
-  // Note that the number of bits removed will be a multiple of 8.
+  // Consumes symbols starting at '*pos' for as long as they extend a string in
+  // the dictionary, and returns that string's codeword. Note that the number
+  // of bits consumed will be a multiple of 8, except at the end of the stream.
   // This method is meant to be called after the dictionary is finalized. It
   // does not insert into the dictionary.
-  int GetCodeword256(base::QueueFv* queue_fv);
+  int GetCodeword256(const base::PackedFv& bits, size_t* pos) const;
 
-  // Peels off 8 bits from queue (or all remaining bits if less than 8).
-  unsigned char Get8Bits(base::QueueFv* queue_fv);
+  // Reads 8 bits starting at 'pos' (or all remaining bits if less than 8),
+  // and returns how many were read in '*num_bits'.
+  static unsigned char Peek8Bits(const base::PackedFv& bits, size_t pos,
+                                 size_t* num_bits);
 
-  // Code tree for encoding symbol stream to codewords.
-  std::unique_ptr<Node256Ary> code_tree_root_;
-  // Dictionary for decoding codewords.
-  std::array<std::vector<unsigned char>, 4096> codeword_to_symbol_;
+  // Codewords of multi-symbol strings, keyed by the codeword of the string
+  // minus its last symbol. Single symbols are their own codewords.
+  LzwHashDictionary dictionary_;
+  // The symbol string of codeword c is codeword_length_[c] symbols of
+  // symbol_arena_ starting at codeword_offset_[c].
+  std::vector<unsigned char> symbol_arena_;
+  std::vector<uint32_t> codeword_offset_;
+  std::vector<uint32_t> codeword_length_;
   int next_codeword_slot_{0};
 };
 
+// Single-pass LZW over a stream of SYMBOL_BITS-bit symbols. The dictionary
+// is built on the fly, and codes start at SYMBOL_BITS + 1 bits and grow by
+// one bit each time the dictionary outgrows them, up to MAX_CODE_BITS. When
+// the dictionary is full the encoder emits a clear code and starts over, so
+// memory stays bounded however long the stream is.
+//
+// Codes below 2^SYMBOL_BITS are single symbols; the next two are the clear
+// and end codes. Codes are packed most significant bit first, and the end
+// code is followed by zero padding to a byte boundary.
+template <size_t SYMBOL_BITS = 8, size_t MAX_CODE_BITS = 16>
+struct LzwStreamFormat {
+  static_assert(SYMBOL_BITS >= 1 && SYMBOL_BITS < MAX_CODE_BITS &&
+                MAX_CODE_BITS <= 16,
+                "Symbols must be narrower than codes, which are at most 16 "
+                "bits.");
+  static const uint32_t kNumSymbols = uint32_t(1) << SYMBOL_BITS;
+  static const uint32_t kClearCode = kNumSymbols;
+  static const uint32_t kEndCode = kNumSymbols + 1;
+  static const uint32_t kFirstFreeCode = kNumSymbols + 2;
+  static const uint32_t kMaxCodes = uint32_t(1) << MAX_CODE_BITS;
+
+  // Width of the next code when the dictionary holds 'next_code' codes.
+  static size_t CodeBits(uint32_t next_code) {
+    size_t bits = SYMBOL_BITS + 1;
+    while ((uint32_t(1) << bits) < next_code) {
+      ++bits;
+    }
+    return bits;
+  }
+};
+
+template <size_t SYMBOL_BITS = 8, size_t MAX_CODE_BITS = 16>
+class LzwStreamEncoder {
+ public:
+  typedef LzwStreamFormat<SYMBOL_BITS, MAX_CODE_BITS> Format;
+
+  LzwStreamEncoder() : dictionary_(Format::kMaxCodes) {}
+
+  // Appends one symbol, whose bits above SYMBOL_BITS must be zero.
+  void Push(uint32_t symbol) {
+    if (prefix_ < 0) {
+      prefix_ = static_cast<int>(symbol);
+      return;
+    }
+    const int next = dictionary_.Find(prefix_, symbol);
+    if (next >= 0) {
+      prefix_ = next;
+      return;
+    }
+    WriteCode(prefix_);
+    if (next_code_ < Format::kMaxCodes) {
+      dictionary_.Insert(prefix_, symbol, next_code_);
+      AdvanceNextCode();
+    } else {
+      WriteCode(Format::kClearCode);
+      ResetDictionary();
+    }
+    prefix_ = static_cast<int>(symbol);
+  }
+
+  // Appends 'bits' as a run of symbols, first bit most significant. Bits that
+  // do not fill a symbol are carried over to the next call.
+  void Push(const base::PackedFv& bits) {
+    size_t pos = 0;
+    while (pos < bits.size()) {
+      const size_t remaining = bits.size() - pos;
+      if (carry_bits_ == 0 && remaining >= SYMBOL_BITS) {
+        Push(static_cast<uint32_t>(bits.PeekBits(pos, SYMBOL_BITS)));
+        pos += SYMBOL_BITS;
+        continue;
+      }
+      const size_t n = std::min(SYMBOL_BITS - carry_bits_, remaining);
+      carry_ = (carry_ << n) | static_cast<uint32_t>(bits.PeekBits(pos, n));
+      carry_bits_ += n;
+      pos += n;
+      if (carry_bits_ == SYMBOL_BITS) {
+        Push(carry_);
+        carry_ = 0;
+        carry_bits_ = 0;
+      }
+    }
+  }
+
+  // Starts a new dictionary, e.g. at a point where the statistics of the
+  // stream change. This also happens whenever the dictionary fills.
+  void Clear() {
+    FlushPrefix();
+    WriteCode(Format::kClearCode);
+    ResetDictionary();
+  }
+
+  // Ends the stream. Carried-over bits are zero-padded into a last symbol.
+  void Finish() {
+    if (carry_bits_ != 0) {
+      Push(carry_ << (SYMBOL_BITS - carry_bits_));
+      carry_ = 0;
+      carry_bits_ = 0;
+    }
+    FlushPrefix();
+    WriteCode(Format::kEndCode);
+    if (pending_bits_ != 0) {
+      bytes_.push_back(static_cast<uint8_t>(pending_ << (8 - pending_bits_)));
+      pending_bits_ = 0;
+    }
+  }
+
+  // Moves the completed output bytes to the end of 'out'.
+  void TakeOutput(std::vector<uint8_t>* out) {
+    out->insert(out->end(), bytes_.begin(), bytes_.end());
+    bytes_taken_ += bytes_.size();
+    bytes_.clear();
+  }
+
+  // Bytes produced so far, including bytes already taken.
+  size_t bytes_written() const { return bytes_taken_ + bytes_.size(); }
+
+ private:
+  // Writes the code of the pending symbols, if any.
+  void FlushPrefix() {
+    if (prefix_ < 0) {
+      return;
+    }
+    WriteCode(prefix_);
+    prefix_ = -1;
+    // The decoder adds a dictionary entry on every code after the first, so
+    // it sizes the next code as if one had been added here.
+    if (next_code_ < Format::kMaxCodes) {
+      AdvanceNextCode();
+    }
+  }
+
+  void ResetDictionary() {
+    dictionary_.Clear();
+    next_code_ = Format::kFirstFreeCode;
+    code_bits_ = Format::CodeBits(next_code_);
+  }
+
+  void AdvanceNextCode() {
+    ++next_code_;
+    code_bits_ = Format::CodeBits(next_code_);
+  }
+
+  void WriteCode(uint32_t code) {
+    pending_ = (pending_ << code_bits_) | code;
+    pending_bits_ += code_bits_;
+    while (pending_bits_ >= 8) {
+      pending_bits_ -= 8;
+      bytes_.push_back(static_cast<uint8_t>(pending_ >> pending_bits_));
+    }
+  }
+
+  LzwHashDictionary dictionary_;
+  uint32_t next_code_{Format::kFirstFreeCode};
+  size_t code_bits_{Format::CodeBits(Format::kFirstFreeCode)};
+  // The code of the longest dictionary string matching the pending symbols,
+  // or -1 if there are none.
+  int prefix_{-1};
+  uint32_t carry_{0};
+  size_t carry_bits_{0};
+  // Output bits not yet in a whole byte, right-aligned.
+  uint64_t pending_{0};
+  size_t pending_bits_{0};
+  std::vector<uint8_t> bytes_;
+  size_t bytes_taken_{0};
+};
+
+template <size_t SYMBOL_BITS = 8, size_t MAX_CODE_BITS = 16>
+class LzwStreamDecoder {
+ public:
+  typedef LzwStreamFormat<SYMBOL_BITS, MAX_CODE_BITS> Format;
+
+  LzwStreamDecoder()
+      : prefix_(Format::kMaxCodes), suffix_(Format::kMaxCodes),
+        length_(Format::kMaxCodes) {
+    std::fill(length_.begin(), length_.begin() + Format::kNumSymbols, 1);
+    Clear();
+  }
+
+  // Decodes the codes completed by 'num_bytes' more bytes of the stream and
+  // appends their symbols to 'symbols'. Input may be split at any byte.
+  // Returns true once the end code has been read; bytes after it are
+  // ignored. Throws std::runtime_error on an invalid code.
+  bool Decode(const uint8_t* bytes, size_t num_bytes,
+              std::vector<uint32_t>* symbols) {
+    for (size_t i = 0; i < num_bytes && !finished_; ++i) {
+      pending_ = (pending_ << 8) | bytes[i];
+      pending_bits_ += 8;
+      while (pending_bits_ >= code_bits_ && !finished_) {
+        pending_bits_ -= code_bits_;
+        const uint32_t code = static_cast<uint32_t>(
+            pending_ >> pending_bits_) & ((uint32_t(1) << code_bits_) - 1);
+        DecodeCode(code, symbols);
+      }
+    }
+    return finished_;
+  }
+
+  bool finished() const { return finished_; }
+
+ private:
+  void Clear() {
+    next_code_ = Format::kFirstFreeCode;
+    previous_ = -1;
+    code_bits_ = Format::CodeBits(next_code_);
+  }
+
+  void DecodeCode(uint32_t code, std::vector<uint32_t>* symbols) {
+    if (code == Format::kClearCode) {
+      Clear();
+      return;
+    }
+    if (code == Format::kEndCode) {
+      finished_ = true;
+      return;
+    }
+    const bool add_entry = previous_ >= 0 && next_code_ < Format::kMaxCodes;
+    if (code > next_code_ || (code == next_code_ && !add_entry)) {
+      throw std::runtime_error("Invalid LZW code.");
+    }
+    const bool self_defined = code == next_code_;
+    if (self_defined) {
+      // The string being defined by this very code: the previous string
+      // followed by its own first symbol.
+      AddEntry(previous_first_);
+    }
+    // Strings are stored as (prefix code, last symbol), so they are written
+    // back to front.
+    const size_t start = symbols->size();
+    symbols->resize(start + length_[code]);
+    uint32_t* out = symbols->data() + symbols->size();
+    uint32_t c = code;
+    for (; c >= Format::kFirstFreeCode; c = prefix_[c]) {
+      *--out = suffix_[c];
+    }
+    *--out = c;
+    const uint32_t first = (*symbols)[start];
+    if (add_entry && !self_defined) {
+      AddEntry(first);
+    }
+    previous_ = static_cast<int>(code);
+    previous_first_ = first;
+    code_bits_ = Format::CodeBits(
+        next_code_ + (next_code_ < Format::kMaxCodes ? 1 : 0));
+  }
+
+  void AddEntry(uint32_t symbol) {
+    prefix_[next_code_] = static_cast<uint16_t>(previous_);
+    suffix_[next_code_] = static_cast<uint16_t>(symbol);
+    length_[next_code_] = length_[previous_] + 1;
+    ++next_code_;
+  }
+
+  // Entry c is the string of code prefix_[c] followed by suffix_[c], and is
+  // length_[c] symbols long.
+  std::vector<uint16_t> prefix_;
+  std::vector<uint16_t> suffix_;
+  std::vector<uint32_t> length_;
+  uint32_t next_code_;
+  int previous_{-1};
+  uint32_t previous_first_{0};
+  size_t code_bits_;
+  bool finished_{false};
+  uint64_t pending_{0};
+  size_t pending_bits_{0};
+};
+
 }  // namespace codec
 }  // namespace signal_content
 
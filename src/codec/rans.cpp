@@ -0,0 +1,368 @@
+/*
+ * rans.cpp
+ */
+
+#include "rans.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include "frame_symbols.h"
+#include "symbol_histogram.h"
+
+using namespace std;
+
+namespace signal_content {
+using base::PackedFv;
+using base::VFrameView;
+namespace codec {
+
+namespace {
+
+const uint32_t kProbScale = uint32_t(1) << RansCodec::kProbBits;
+const uint32_t kProbMask = kProbScale - 1;
+// States live in [kRansL, kRansL << 16).
+const uint32_t kRansL = uint32_t(1) << 16;
+// Symbols are coded by value through a flat table up to this width.
+const size_t kMaxDenseSymbolBits = 16;
+// Decoded symbols reserved up front per byte of payload, as if each cost half
+// a bit. Cheaper symbols grow the output as they decode.
+const uint64_t kReservedSymbolsPerByte = 16;
+
+// Encodes the range (cum, freq) into 'state', spilling 16-bit words to
+// 'words'.
+inline void RansPut(uint32_t* state, uint32_t cum, uint32_t freq,
+                    vector<uint16_t>* words) {
+  const uint64_t x_max = uint64_t((kRansL >> RansCodec::kProbBits) << 16) *
+                         freq;
+  uint32_t x = *state;
+  while (x >= x_max) {
+    words->push_back(static_cast<uint16_t>(x));
+    x >>= 16;
+  }
+  *state = ((x / freq) << RansCodec::kProbBits) + (x % freq) + cum;
+}
+
+// Reads 16-bit little-endian words from the encoding.
+class WordReader {
+ public:
+  WordReader(const uint8_t* begin, const uint8_t* end)
+      : pos_(begin), end_(end) {}
+
+  uint32_t Read() {
+    if (pos_ + 2 > end_) {
+      throw runtime_error("Truncated rANS stream.");
+    }
+    const uint32_t word = pos_[0] | (uint32_t(pos_[1]) << 8);
+    pos_ += 2;
+    return word;
+  }
+
+  void Renormalize(uint32_t* state) {
+    if (*state < kRansL) {
+      *state = (*state << 16) | Read();
+    }
+  }
+
+  bool done() const { return pos_ == end_; }
+
+ private:
+  const uint8_t* pos_;
+  const uint8_t* end_;
+};
+
+struct SymbolCollector {
+  void operator()(const int* symbols, size_t count) {
+    out->insert(out->end(), symbols, symbols + count);
+  }
+  vector<int>* out;
+};
+
+}  // namespace
+
+RansCodec::RansCodec(const VFrameView& frames, size_t symbol_bits,
+                     size_t num_threads)
+    : frame_size_(frames.frame_size()), symbol_bits_(symbol_bits) {
+  if (symbol_bits > 32) {
+    throw runtime_error("Symbol size cannot exceed 32 bits.");
+  }
+  symbol_to_freq_ =
+      ComputeSymbolHistogram(frames, symbol_bits_, num_threads).Counts();
+  BuildModel();
+}
+
+RansCodec::RansCodec(const PackedFv& bits, size_t frame_size,
+                     size_t symbol_bits, size_t num_threads)
+    : RansCodec(VFrameView(bits, frame_size), symbol_bits, num_threads) {}
+
+RansCodec::RansCodec(const SymbolHistogram& histogram, size_t frame_size)
+    : frame_size_(frame_size), symbol_bits_(histogram.symbol_bits()) {
+  if (symbol_bits_ > 32) {
+    throw runtime_error("Symbol size cannot exceed 32 bits.");
+  }
+  symbol_to_freq_ = histogram.Counts();
+  BuildModel();
+}
+
+void RansCodec::BuildModel() {
+  // The most frequent symbols are coded directly, the rest escaped.
+  vector<pair<size_t, int>> by_count;
+  size_t total = 0;
+  for (const auto& p : symbol_to_freq_) {
+    by_count.push_back(make_pair(p.second, p.first));
+    total += p.second;
+  }
+  sort(by_count.begin(), by_count.end(),
+       [] (const pair<size_t, int>& a, const pair<size_t, int>& b) {
+         return a.first != b.first ? a.first > b.first : a.second < b.second;
+       });
+  const size_t num_coded = min(by_count.size(), size_t(kMaxAlphabetSize));
+  size_t escaped_count = 0;
+  for (size_t i = num_coded; i < by_count.size(); ++i) {
+    escaped_count += by_count[i].first;
+  }
+
+  // Quantize to a total of kProbScale, keeping every present symbol (and the
+  // escape, if used) at a frequency of at least one. Counts are in
+  // decreasing order, so the rounding error is settled on the most frequent
+  // entries, where it costs the least.
+  vector<size_t> counts;
+  for (size_t i = 0; i < num_coded; ++i) {
+    counts.push_back(by_count[i].first);
+  }
+  if (escaped_count > 0) {
+    counts.push_back(escaped_count);
+  }
+  vector<uint32_t> freqs(counts.size());
+  int64_t sum = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    const double scaled = double(counts[i]) * kProbScale / total;
+    freqs[i] = max<uint32_t>(1, static_cast<uint32_t>(llround(scaled)));
+    sum += freqs[i];
+  }
+  int64_t excess = sum - kProbScale;
+  if (excess < 0 && !freqs.empty()) {
+    freqs[0] += static_cast<uint32_t>(-excess);
+  }
+  for (size_t i = 0; excess > 0 && i < freqs.size(); ++i) {
+    const int64_t take = min<int64_t>(excess, freqs[i] - 1);
+    freqs[i] -= static_cast<uint32_t>(take);
+    excess -= take;
+  }
+
+  // Assign cumulative ranges, with the escape on top.
+  dense_ranges_.clear();
+  sparse_ranges_.clear();
+  if (symbol_bits_ <= kMaxDenseSymbolBits) {
+    const SymbolRange unused = {0, 0};
+    dense_ranges_.assign(size_t(1) << symbol_bits_, unused);
+  }
+  const DecodeEntry unused_entry = {0, 0, 0};
+  decode_table_.assign(kProbScale, unused_entry);
+  uint32_t cum = 0;
+  for (size_t i = 0; i < num_coded; ++i) {
+    const SymbolRange range = {freqs[i], cum};
+    const int symbol = by_count[i].second;
+    if (!dense_ranges_.empty()) {
+      dense_ranges_[symbol] = range;
+    } else {
+      sparse_ranges_.insert(make_pair(symbol, range));
+    }
+    const DecodeEntry entry = {static_cast<uint16_t>(freqs[i]),
+                               static_cast<uint16_t>(cum), symbol};
+    fill(decode_table_.begin() + cum, decode_table_.begin() + cum + freqs[i],
+         entry);
+    cum += freqs[i];
+  }
+  escape_cum_ = cum;
+  escape_range_.cum = cum;
+  escape_range_.freq = kProbScale - cum;
+  if (escaped_count > 0) {
+    const DecodeEntry entry = {static_cast<uint16_t>(escape_range_.freq),
+                               static_cast<uint16_t>(cum), 0};
+    fill(decode_table_.begin() + cum, decode_table_.end(), entry);
+  }
+}
+
+vector<uint8_t> RansCodec::Encode(const VFrameView& frames) const {
+  if (frames.frame_size() != frame_size_) {
+    throw invalid_argument("Frame size mismatch.");
+  }
+  vector<int> symbols;
+  symbols.reserve(frames.num_frames() *
+                  SymbolsPerFrame(frame_size_, symbol_bits_));
+  SymbolCollector collector = {&symbols};
+  ForEachFrameSymbols(frames, symbol_bits_, &collector);
+  return Encode(symbols);
+}
+
+vector<uint8_t> RansCodec::Encode(const vector<int>& symbols) const {
+  // rANS is last-in first-out, so symbols are encoded in reverse and the
+  // words reversed at the end.
+  vector<uint16_t> words;
+  words.reserve(symbols.size() / 4 + 16);
+  uint32_t states[kNumStates];
+  fill(states, states + kNumStates, kRansL);
+  const size_t chunks = EscapeChunks();
+  for (size_t i = symbols.size(); i-- > 0;) {
+    uint32_t* state = &states[i % kNumStates];
+    const SymbolRange* range = RangeFor(symbols[i]);
+    if (range != nullptr) {
+      RansPut(state, range->cum, range->freq, &words);
+      continue;
+    }
+    if (escape_range_.freq == 0) {
+      throw out_of_range("Symbol is not in the model.");
+    }
+    // The value follows the escape, least significant chunk first. A chunk
+    // of w bits is coded uniformly at a frequency of 2^(kProbBits - w), so it
+    // costs exactly w bits.
+    const uint32_t value = static_cast<uint32_t>(symbols[i]);
+    for (size_t chunk = chunks; chunk-- > 0;) {
+      const size_t shift = kProbBits - EscapeChunkBits(chunk);
+      const uint32_t chunk_value =
+          (value >> (chunk * kProbBits)) & (kProbMask >> shift);
+      RansPut(state, chunk_value << shift, uint32_t(1) << shift, &words);
+    }
+    RansPut(state, escape_range_.cum, escape_range_.freq, &words);
+  }
+  for (size_t i = kNumStates; i-- > 0;) {
+    words.push_back(static_cast<uint16_t>(states[i]));
+    words.push_back(static_cast<uint16_t>(states[i] >> 16));
+  }
+
+  vector<uint8_t> encoded;
+  encoded.reserve(8 + 2 * words.size());
+  const uint64_t num_symbols = symbols.size();
+  for (int i = 0; i < 8; ++i) {
+    encoded.push_back(static_cast<uint8_t>(num_symbols >> (8 * i)));
+  }
+  for (size_t i = words.size(); i-- > 0;) {
+    encoded.push_back(static_cast<uint8_t>(words[i]));
+    encoded.push_back(static_cast<uint8_t>(words[i] >> 8));
+  }
+  return encoded;
+}
+
+vector<int> RansCodec::Decode(const vector<uint8_t>& encoded) const {
+  if (encoded.size() < 8 || encoded.size() % 2 != 0) {
+    throw runtime_error("Malformed rANS stream.");
+  }
+  uint64_t num_symbols = 0;
+  for (int i = 0; i < 8; ++i) {
+    num_symbols |= uint64_t(encoded[i]) << (8 * i);
+  }
+  // A certain symbol costs no bits at all, so the stream length does not
+  // bound the symbol count; only reject counts that cannot be allocated.
+  if (num_symbols > (uint64_t(1) << 40)) {
+    throw runtime_error("Malformed rANS stream.");
+  }
+  WordReader reader(encoded.data() + 8, encoded.data() + encoded.size());
+  uint32_t states[kNumStates];
+  for (size_t i = 0; i < kNumStates; ++i) {
+    states[i] = reader.Read() << 16;
+    states[i] |= reader.Read();
+  }
+
+  // The count is only trusted as far as the payload could plausibly hold
+  // it; past that the output grows as symbols decode, so a truncated stream
+  // fails in the reader rather than in one huge allocation.
+  vector<int> decoded;
+  decoded.reserve(static_cast<size_t>(min<uint64_t>(
+      num_symbols, kReservedSymbolsPerByte * (encoded.size() - 8))));
+  const DecodeEntry* const table = decode_table_.data();
+  const size_t chunks = EscapeChunks();
+  auto decode_one = [&] (uint32_t* state) -> int {
+    const uint32_t slot = *state & kProbMask;
+    const DecodeEntry& entry = table[slot];
+    *state = entry.freq * (*state >> kProbBits) + slot - entry.cum;
+    reader.Renormalize(state);
+    if (slot < escape_cum_) {
+      return entry.symbol;
+    }
+    uint32_t value = 0;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+      const size_t shift = kProbBits - EscapeChunkBits(chunk);
+      const uint32_t chunk_slot = *state & kProbMask;
+      value |= (chunk_slot >> shift) << (chunk * kProbBits);
+      *state = ((*state >> kProbBits) << shift) +
+               (chunk_slot & ((uint32_t(1) << shift) - 1));
+      reader.Renormalize(state);
+    }
+    return static_cast<int>(value);
+  };
+
+  // Four symbols per iteration, one from each state.
+  size_t i = 0;
+  for (; i + kNumStates <= num_symbols; i += kNumStates) {
+    decoded.push_back(decode_one(&states[0]));
+    decoded.push_back(decode_one(&states[1]));
+    decoded.push_back(decode_one(&states[2]));
+    decoded.push_back(decode_one(&states[3]));
+  }
+  for (; i < num_symbols; ++i) {
+    decoded.push_back(decode_one(&states[i % kNumStates]));
+  }
+
+  // A well-formed stream unwinds every state to its initial value.
+  for (size_t s = 0; s < kNumStates; ++s) {
+    if (states[s] != kRansL) {
+      throw runtime_error("Corrupt rANS stream.");
+    }
+  }
+  if (!reader.done()) {
+    throw runtime_error("Trailing data in rANS stream.");
+  }
+  return decoded;
+}
+
+double RansCodec::EntropyBitsPerSymbol() const {
+  size_t total = 0;
+  for (const auto& p : symbol_to_freq_) {
+    total += p.second;
+  }
+  double bits = 0.0;
+  for (const auto& p : symbol_to_freq_) {
+    const double probability = double(p.second) / total;
+    bits -= probability * log2(probability);
+  }
+  return bits;
+}
+
+double RansCodec::ModelBitsPerSymbol() const {
+  size_t total = 0;
+  double bits = 0.0;
+  for (const auto& p : symbol_to_freq_) {
+    total += p.second;
+    const SymbolRange* range = RangeFor(p.first);
+    if (range != nullptr) {
+      bits += p.second * (kProbBits - log2(double(range->freq)));
+    } else {
+      bits += p.second * (kProbBits - log2(double(escape_range_.freq)) +
+                          symbol_bits_);
+    }
+  }
+  return total ? bits / total : 0.0;
+}
+
+void RansCodec::PrintCompressionData() const {
+  size_t total = 0;
+  for (const auto& p : symbol_to_freq_) {
+    total += p.second;
+  }
+  const double orig_size = double(total) * symbol_bits_;
+  const double model_size = ModelBitsPerSymbol() * total;
+  const double entropy_size = EntropyBitsPerSymbol() * total;
+  cout << "Original bits: " << orig_size << endl;
+  cout << "Compressed bits (model): " << model_size << endl;
+  cout << "Entropy bound bits: " << entropy_size << endl;
+  cout << "Ratio: " << model_size / orig_size << endl;
+  cout << "Excess over entropy: "
+       << (entropy_size > 0 ? model_size / entropy_size - 1.0 : 0.0) << endl;
+}
+
+}  // namespace codec
+}  // namespace signal_content
@@ -0,0 +1,121 @@
+/*
+ * rans.h
+ *
+ * Static range asymmetric numeral systems (rANS) codec over the same
+ * frame/symbol inputs as HuffmanCodec. Unlike Huffman, rANS spends a
+ * fractional number of bits per symbol, so a symbol with a probability of
+ * 0.999 costs about 0.0015 bits rather than a whole bit.
+ *
+ * Symbol frequencies are quantized to a total of 2^kProbBits. The state is
+ * 32 bits wide and renormalized 16 bits at a time. kNumStates states are
+ * interleaved round-robin over the symbols so that the decoder's per-symbol
+ * dependency chains overlap. The kMaxAlphabetSize most frequent symbols are
+ * coded directly; any others are coded as an escape followed by their value in
+ * uniformly coded chunks of at most kProbBits bits.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_RANS_H_
+#define SIGNAL_CONTENT_CODEC_RANS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../base/frame_view.h"
+#include "../base/packed_fv.h"
+#include "symbol_histogram.h"
+
+namespace signal_content {
+namespace codec {
+
+class RansCodec {
+ public:
+  static const size_t kProbBits = 15;
+  static const size_t kMaxAlphabetSize = 4096;
+  static const size_t kNumStates = 4;
+
+  // Symbols are counted with 'num_threads' workers (0 means one per hardware
+  // thread).
+  RansCodec(const base::VFrameView& frames, size_t symbol_bits,
+            size_t num_threads = 0);
+  // Trains on a packed stream that is split into frames of 'frame_size' bits.
+  RansCodec(const base::PackedFv& bits, size_t frame_size, size_t symbol_bits,
+            size_t num_threads = 0);
+  // Builds the model from symbol counts gathered elsewhere.
+  RansCodec(const SymbolHistogram& histogram, size_t frame_size);
+
+  // The encoding holds the symbol count, so it decodes on its own.
+  std::vector<uint8_t> Encode(const base::VFrameView& frames) const;
+  std::vector<uint8_t> Encode(const std::vector<int>& symbols) const;
+  // Throws std::runtime_error if 'encoded' is malformed.
+  std::vector<int> Decode(const std::vector<uint8_t>& encoded) const;
+
+  // Shannon entropy of the training symbols, the lower bound for any static
+  // symbol-wise code.
+  double EntropyBitsPerSymbol() const;
+  // Expected cost of the training symbols under the quantized frequencies,
+  // including escapes.
+  double ModelBitsPerSymbol() const;
+
+  void PrintCompressionData() const;
+
+ private:
+  // The quantized frequency and cumulative frequency of a coded symbol.
+  struct SymbolRange {
+    uint32_t freq;
+    uint32_t cum;
+  };
+
+  // Decoder lookup, indexed by the low kProbBits bits of the state.
+  struct DecodeEntry {
+    uint16_t freq;
+    uint16_t cum;
+    int32_t symbol;
+  };
+
+  // Builds the quantized model from symbol_to_freq_.
+  void BuildModel();
+
+  // Number of uniform chunks an escaped symbol is sent in.
+  size_t EscapeChunks() const {
+    return (symbol_bits_ + kProbBits - 1) / kProbBits;
+  }
+  // Width of chunk 'chunk', counting from the least significant. Only the
+  // most significant chunk may be narrower than kProbBits.
+  size_t EscapeChunkBits(size_t chunk) const {
+    return std::min(size_t(kProbBits), symbol_bits_ - chunk * kProbBits);
+  }
+
+  // Returns the coded range of 'symbol', or nullptr if it is escaped.
+  const SymbolRange* RangeFor(int symbol) const {
+    if (!dense_ranges_.empty()) {
+      const uint32_t index = static_cast<uint32_t>(symbol);
+      if (index >= dense_ranges_.size() || dense_ranges_[index].freq == 0) {
+        return nullptr;
+      }
+      return &dense_ranges_[index];
+    }
+    auto it = sparse_ranges_.find(symbol);
+    return it != sparse_ranges_.end() ? &it->second : nullptr;
+  }
+
+  size_t frame_size_;
+  size_t symbol_bits_;
+  std::unordered_map<int, size_t> symbol_to_freq_;
+  // Coded symbols are indexed by value when symbols are at most 16 bits wide.
+  std::vector<SymbolRange> dense_ranges_;
+  std::unordered_map<int, SymbolRange> sparse_ranges_;
+  // The escape occupies the top of the cumulative range, so a decoded slot at
+  // or above escape_cum_ is an escape. Equal to 2^kProbBits when no symbols
+  // are escaped.
+  uint32_t escape_cum_;
+  SymbolRange escape_range_;
+  std::vector<DecodeEntry> decode_table_;
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_RANS_H_ */
@@ -0,0 +1,335 @@
+/*
+ * robdd.cpp
+ */
+
+#include "robdd.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace signal_content {
+using base::PackedFv;
+namespace codec {
+
+namespace {
+
+inline uint64_t LowMask(size_t width) {
+  return (width >= 64) ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+}
+
+inline uint32_t HashNode(uint32_t lo, uint32_t hi) {
+  uint32_t h = lo * 0x85EBCA77u;
+  h ^= hi * 0xC2B2AE3Du;
+  return h ^ (h >> 15);
+}
+
+inline uint32_t HashWord(uint64_t word) {
+  word *= 0x9E3779B97F4A7C15ULL;
+  return static_cast<uint32_t>(word >> 32);
+}
+
+// Smallest power of two that is at least 'n'.
+inline size_t CeilPowerOfTwo(size_t n) {
+  size_t size = 1;
+  while (size < n) {
+    size *= 2;
+  }
+  return size;
+}
+
+}  // namespace
+
+Robdd::Robdd(const PackedFv& image) {
+  num_variables_ = kWordLevels;
+  while ((size_t(1) << num_variables_) < image.size()) {
+    ++num_variables_;
+  }
+  if (num_variables_ > kMaxVariables) {
+    throw invalid_argument("Image is too large for a decision diagram.");
+  }
+  vector<uint64_t> table(size_t(1) << (num_variables_ - kWordLevels), 0);
+  for (size_t w = 0; w < image.num_words(); ++w) {
+    table[w] = image.ValueWord(w);
+    if (image.HasUnknownPlane()) {
+      table[w] &= ~image.UnknownWord(w);
+    }
+  }
+  for (size_t level = 0; level < num_variables_; ++level) {
+    order_.push_back(num_variables_ - 1 - level);
+  }
+  Build(table);
+}
+
+vector<size_t> Robdd::LevelNodeCounts() const {
+  vector<size_t> counts;
+  for (const vector<uint32_t>& nodes : level_nodes_) {
+    counts.push_back(nodes.size());
+  }
+  return counts;
+}
+
+void Robdd::SwapAdjacentLevels(size_t level) {
+  if (level + 1 >= num_variables_) {
+    throw out_of_range("No level below the one to swap.");
+  }
+  const uint32_t upper = static_cast<uint32_t>(level);
+  const uint32_t lower = upper + 1;
+  vector<uint32_t> upper_nodes;
+  vector<uint32_t> lower_nodes;
+  upper_nodes.swap(level_nodes_[upper]);
+  lower_nodes.swap(level_nodes_[lower]);
+
+  // Upper nodes that do not depend on the lower variable only move down.
+  // The rest are rewritten in place below.
+  vector<uint32_t> rewritten;
+  for (uint32_t index : upper_nodes) {
+    if (nodes_[nodes_[index].lo].level == lower ||
+        nodes_[nodes_[index].hi].level == lower) {
+      rewritten.push_back(index);
+    } else {
+      nodes_[index].level = lower;
+      level_nodes_[lower].push_back(index);
+    }
+  }
+  ResetUniqueTable(lower);
+  // Lower nodes still referenced from above now test their variable at the
+  // upper level. Their children are unchanged.
+  for (uint32_t index : lower_nodes) {
+    nodes_[index].level = upper;
+  }
+  level_nodes_[upper].swap(lower_nodes);
+  ResetUniqueTable(upper);
+
+  // A node f = (x, f0, f1) over (y, ...) children becomes
+  // (y, (x, f00, f10), (x, f01, f11)), where fij is f with x = i and y = j,
+  // and keeps its index so that its parents are unchanged.
+  for (uint32_t index : rewritten) {
+    const uint32_t f0 = nodes_[index].lo;
+    const uint32_t f1 = nodes_[index].hi;
+    uint32_t f00 = f0;
+    uint32_t f01 = f0;
+    uint32_t f10 = f1;
+    uint32_t f11 = f1;
+    if (nodes_[f0].level == upper) {
+      f00 = nodes_[f0].lo;
+      f01 = nodes_[f0].hi;
+    }
+    if (nodes_[f1].level == upper) {
+      f10 = nodes_[f1].lo;
+      f11 = nodes_[f1].hi;
+    }
+    const uint32_t lo = MakeNode(lower, f00, f10);
+    ++nodes_[lo].refs;
+    const uint32_t hi = MakeNode(lower, f01, f11);
+    ++nodes_[hi].refs;
+    --nodes_[f0].refs;
+    --nodes_[f1].refs;
+    nodes_[index].level = upper;
+    nodes_[index].lo = lo;
+    nodes_[index].hi = hi;
+    AddToLevel(index);
+  }
+  swap(order_[level], order_[level + 1]);
+  // Only former lower nodes can have lost their last parent. Nodes further
+  // down keep theirs, because the subfunctions below the two levels do not
+  // depend on their order.
+  CollectLevel(upper);
+}
+
+size_t Robdd::Sift(size_t max_passes) {
+  for (size_t pass = 0; pass < max_passes; ++pass) {
+    const size_t start_count = NodeCount();
+    // Variables in decreasing order of the nodes at their level.
+    const vector<size_t> level_counts = LevelNodeCounts();
+    vector<pair<size_t, size_t>> by_count;
+    for (size_t level = 0; level < num_variables_; ++level) {
+      by_count.push_back(make_pair(level_counts[level], order_[level]));
+    }
+    sort(by_count.rbegin(), by_count.rend());
+
+    for (const auto& p : by_count) {
+      size_t level =
+          find(order_.begin(), order_.end(), p.second) - order_.begin();
+      size_t best_level = level;
+      size_t best_count = NodeCount();
+      while (level + 1 < num_variables_) {
+        SwapAdjacentLevels(level++);
+        if (NodeCount() < best_count) {
+          best_count = NodeCount();
+          best_level = level;
+        }
+      }
+      while (level > 0) {
+        SwapAdjacentLevels(--level);
+        if (NodeCount() < best_count) {
+          best_count = NodeCount();
+          best_level = level;
+        }
+      }
+      while (level < best_level) {
+        SwapAdjacentLevels(level++);
+      }
+    }
+    if (NodeCount() >= start_count) {
+      break;
+    }
+  }
+  return NodeCount();
+}
+
+bool Robdd::Evaluate(uint64_t address) const {
+  uint32_t node = root_;
+  while (node != kFalse && node != kTrue) {
+    const Node& n = nodes_[node];
+    node = ((address >> order_[n.level]) & 1) ? n.hi : n.lo;
+  }
+  return node == kTrue;
+}
+
+void Robdd::Build(const vector<uint64_t>& table) {
+  const uint32_t terminal_level = static_cast<uint32_t>(num_variables_);
+  const Node terminal = {terminal_level, kFalse, kFalse, 0};
+  nodes_.assign(2, terminal);
+  free_.clear();
+  level_nodes_.assign(num_variables_, vector<uint32_t>());
+  unique_.assign(num_variables_, vector<uint32_t>());
+  for (uint32_t level = 0; level < num_variables_; ++level) {
+    ResetUniqueTable(level);
+  }
+
+  // Level of the first variable resolved within a word.
+  const uint32_t word_level =
+      static_cast<uint32_t>(num_variables_ - kWordLevels);
+  // Nodes of the whole words seen so far. All-zero words are never looked
+  // up, so zero marks an empty slot.
+  vector<uint64_t> word_keys(CeilPowerOfTwo(2 * table.size()), 0);
+  vector<uint32_t> word_nodes(word_keys.size());
+  const uint32_t word_mask = static_cast<uint32_t>(word_keys.size() - 1);
+  vector<uint32_t> level_nodes(table.size());
+  for (size_t w = 0; w < table.size(); ++w) {
+    const uint64_t word = table[w];
+    if (word == 0 || word == ~uint64_t(0)) {
+      level_nodes[w] = (word == 0) ? kFalse : kTrue;
+      continue;
+    }
+    uint32_t slot = HashWord(word) & word_mask;
+    while (word_keys[slot] != 0 && word_keys[slot] != word) {
+      slot = (slot + 1) & word_mask;
+    }
+    if (word_keys[slot] == 0) {
+      word_keys[slot] = word;
+      word_nodes[slot] = BuildWord(word, kWordBits, word_level);
+    }
+    level_nodes[w] = word_nodes[slot];
+  }
+
+  // Combine pairs of subfunctions a level at a time, up to the root.
+  for (size_t count = table.size(); count > 1; count /= 2) {
+    const uint32_t level = word_level - 1 -
+        static_cast<uint32_t>(__builtin_ctzll(table.size() / count));
+    for (size_t i = 0; i < count / 2; ++i) {
+      level_nodes[i] = MakeNode(level, level_nodes[2 * i],
+                                level_nodes[2 * i + 1]);
+    }
+  }
+  root_ = level_nodes[0];
+  ++nodes_[root_].refs;
+}
+
+uint32_t Robdd::BuildWord(uint64_t bits, size_t width, uint32_t level) {
+  if (bits == 0) {
+    return kFalse;
+  }
+  if (bits == LowMask(width)) {
+    return kTrue;
+  }
+  const size_t half = width / 2;
+  const uint32_t lo = BuildWord(bits >> half, half, level + 1);
+  const uint32_t hi = BuildWord(bits & LowMask(half), half, level + 1);
+  return MakeNode(level, lo, hi);
+}
+
+uint32_t Robdd::MakeNode(uint32_t level, uint32_t lo, uint32_t hi) {
+  if (lo == hi) {
+    return lo;
+  }
+  const vector<uint32_t>& table = unique_[level];
+  const uint32_t mask = static_cast<uint32_t>(table.size() - 1);
+  uint32_t slot = HashNode(lo, hi) & mask;
+  while (table[slot] != kEmpty) {
+    const Node& node = nodes_[table[slot]];
+    if (node.lo == lo && node.hi == hi) {
+      return table[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  const Node node = {level, lo, hi, 0};
+  uint32_t index;
+  if (free_.empty()) {
+    index = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(node);
+  } else {
+    index = free_.back();
+    free_.pop_back();
+    nodes_[index] = node;
+  }
+  ++nodes_[lo].refs;
+  ++nodes_[hi].refs;
+  AddToLevel(index);
+  return index;
+}
+
+void Robdd::AddToLevel(uint32_t index) {
+  const Node& node = nodes_[index];
+  vector<uint32_t>& nodes = level_nodes_[node.level];
+  vector<uint32_t>& table = unique_[node.level];
+  nodes.push_back(index);
+  if (2 * nodes.size() > table.size()) {
+    ResetUniqueTable(node.level);
+    return;
+  }
+  const uint32_t mask = static_cast<uint32_t>(table.size() - 1);
+  uint32_t slot = HashNode(node.lo, node.hi) & mask;
+  while (table[slot] != kEmpty) {
+    slot = (slot + 1) & mask;
+  }
+  table[slot] = index;
+}
+
+void Robdd::CollectLevel(uint32_t level) {
+  vector<uint32_t>& nodes = level_nodes_[level];
+  size_t live = 0;
+  for (uint32_t index : nodes) {
+    if (nodes_[index].refs != 0) {
+      nodes[live++] = index;
+      continue;
+    }
+    --nodes_[nodes_[index].lo].refs;
+    --nodes_[nodes_[index].hi].refs;
+    free_.push_back(index);
+  }
+  nodes.resize(live);
+  ResetUniqueTable(level);
+}
+
+void Robdd::ResetUniqueTable(uint32_t level) {
+  const vector<uint32_t>& nodes = level_nodes_[level];
+  vector<uint32_t>& table = unique_[level];
+  // At most a quarter full, so that a level can grow before the next reset.
+  table.assign(CeilPowerOfTwo(max<size_t>(16, 4 * nodes.size())),
+               uint32_t(kEmpty));
+  const uint32_t mask = static_cast<uint32_t>(table.size() - 1);
+  for (uint32_t index : nodes) {
+    uint32_t slot = HashNode(nodes_[index].lo, nodes_[index].hi) & mask;
+    while (table[slot] != kEmpty) {
+      slot = (slot + 1) & mask;
+    }
+    table[slot] = index;
+  }
+}
+
+}  // namespace codec
+}  // namespace signal_content
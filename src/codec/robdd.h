@@ -0,0 +1,115 @@
+/*
+ * robdd.h
+ *
+ * Reduced ordered binary decision diagrams of memory images. An image is read
+ * as the truth table of a function of its address bits: the value at address
+ * a is image[a], with X and Z treated as zero and the image zero-padded to a
+ * power of two. The number of nodes in the reduced diagram is a measure of
+ * the logic needed to implement the memory as a function.
+ *
+ * The diagram is built bottom-up from the packed words of the truth table.
+ * Nodes live in one vector and are hash-consed through a flat unique table per
+ * level, so identical subfunctions share a node and there is no per-node
+ * allocation. Nodes are reference counted, and the slots of dead nodes are
+ * reused.
+ *
+ * Variable order matters a great deal; Sift searches for a smaller diagram by
+ * Rudell's sifting. An adjacent-level swap only rewrites the nodes at the two
+ * levels involved, in place, so that nodes above them keep their indices, and
+ * collects the nodes that die; its cost is proportional to the nodes at those
+ * levels, not to the size of the image.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_ROBDD_H_
+#define SIGNAL_CONTENT_CODEC_ROBDD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../base/packed_fv.h"
+
+namespace signal_content {
+namespace codec {
+
+class Robdd {
+ public:
+  // The largest image is 2^kMaxVariables values.
+  static const size_t kMaxVariables = 32;
+
+  // Builds the diagram of 'image' with the most significant address bit at
+  // the root. Images smaller than 64 values are padded to 64.
+  explicit Robdd(const base::PackedFv& image);
+
+  size_t num_variables() const { return num_variables_; }
+
+  // Nodes in the diagram, not counting the two terminals.
+  size_t NodeCount() const { return nodes_.size() - 2 - free_.size(); }
+  // Nodes testing the variable at each level, root level first.
+  std::vector<size_t> LevelNodeCounts() const;
+  // The address bit tested at each level, root level first. Bit 0 is the
+  // least significant.
+  const std::vector<size_t>& variable_order() const { return order_; }
+
+  // Exchanges the variables at levels 'level' and 'level' + 1.
+  void SwapAdjacentLevels(size_t level);
+
+  // Moves each variable, starting with the one with the most nodes, to the
+  // level that minimizes the node count, for up to 'max_passes' passes or
+  // until a pass gains nothing. Returns the final node count.
+  size_t Sift(size_t max_passes = 1);
+
+  // The value the diagram gives 'address'.
+  bool Evaluate(uint64_t address) const;
+
+ private:
+  static const uint32_t kFalse = 0;
+  static const uint32_t kTrue = 1;
+  static const uint32_t kEmpty = 0xFFFFFFFF;
+  static const size_t kWordBits = 64;
+  // Levels resolved within one word of the truth table.
+  static const size_t kWordLevels = 6;
+
+  struct Node {
+    uint32_t level;
+    uint32_t lo;
+    uint32_t hi;
+    // References from parent nodes and the root.
+    uint32_t refs;
+  };
+
+  // Builds the diagram of 'table', whose entry t, MSB-first, holds the value
+  // whose level-l variable is bit (num_variables_ - 1 - l) of t.
+  void Build(const std::vector<uint64_t>& table);
+  // Returns the node for the 'width'-entry truth table right-aligned in
+  // 'bits', whose first entry is its most significant bit and whose first
+  // variable is at 'level'.
+  uint32_t BuildWord(uint64_t bits, size_t width, uint32_t level);
+  // Returns the node for (level, lo, hi), creating it with references to
+  // 'lo' and 'hi' if needed. The caller takes its own reference.
+  uint32_t MakeNode(uint32_t level, uint32_t lo, uint32_t hi);
+  // Adds node 'index' to the unique table and node list of its level.
+  void AddToLevel(uint32_t index);
+  // Drops the dead nodes of 'level', releasing their references, and
+  // rebuilds its unique table.
+  void CollectLevel(uint32_t level);
+  // Rebuilds the unique table of 'level' from its node list.
+  void ResetUniqueTable(uint32_t level);
+
+  size_t num_variables_;
+  std::vector<size_t> order_;
+
+  std::vector<Node> nodes_;
+  // Slots of nodes that have died, for reuse.
+  std::vector<uint32_t> free_;
+  uint32_t root_{kFalse};
+  // Per level, the live nodes and an open-addressing table of them, kEmpty
+  // when unused.
+  std::vector<std::vector<uint32_t>> level_nodes_;
+  std::vector<std::vector<uint32_t>> unique_;
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_ROBDD_H_ */
@@ -0,0 +1,222 @@
+/*
+ * run_length.cpp
+ */
+
+#include "run_length.h"
+
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "bit_reader.h"
+#include "bit_writer.h"
+
+using namespace std;
+
+namespace signal_content {
+using base::PackedFv;
+namespace codec {
+
+namespace {
+
+const uint32_t kMaxRiceParameter = 62;
+const uint64_t kSaturated = numeric_limits<uint64_t>::max();
+
+inline size_t Log2Floor(uint64_t n) {
+  return 63 - __builtin_clzll(n);
+}
+
+inline uint64_t SaturatingAdd(uint64_t a, uint64_t b) {
+  return (a > kSaturated - b) ? kSaturated : a + b;
+}
+
+// Statistics of the runs of one polarity, from which the cost of every code
+// follows exactly.
+struct RunStats {
+  void Add(uint64_t length) {
+    ++count;
+    gamma_bits += 2 * Log2Floor(length) + 1;
+    for (uint64_t x = length - 1; x != 0; x &= x - 1) {
+      ++set_bits[__builtin_ctzll(x)];
+    }
+  }
+
+  // A Rice code with parameter k spends (n - 1) >> k zeroes, a one and k
+  // remainder bits on a run of length n. The quotients sum to
+  // sum over b >= k of set_bits[b] * 2^(b - k).
+  uint64_t RiceBits(uint32_t k) const {
+    uint64_t bits = count * (k + 1);
+    for (size_t b = k; b < 64; ++b) {
+      if (set_bits[b] == 0) {
+        continue;
+      }
+      if (b - k >= 63 || set_bits[b] > (kSaturated >> (b - k))) {
+        return kSaturated;
+      }
+      bits = SaturatingAdd(bits, set_bits[b] << (b - k));
+    }
+    return bits;
+  }
+
+  uint64_t Bits(uint32_t parameter) const {
+    return (parameter == RunLengthCodec::kEliasGamma) ?
+        gamma_bits : RiceBits(parameter);
+  }
+
+  uint64_t count{0};
+  uint64_t gamma_bits{0};
+  // The number of runs whose length minus one has bit b set.
+  uint64_t set_bits[64] = {0};
+};
+
+struct RunStatsCollector {
+  void operator()(bool value, uint64_t length) {
+    stats[value].Add(length);
+  }
+  RunStats stats[2];
+};
+
+struct RunWriter {
+  void operator()(bool value, uint64_t length) {
+    const uint32_t parameter = parameters[value];
+    if (parameter == RunLengthCodec::kEliasGamma) {
+      const size_t zeros = Log2Floor(length);
+      if (zeros != 0) {
+        writer->Write(0, zeros);
+      }
+      writer->Write(length, zeros + 1);
+      return;
+    }
+    uint64_t quotient = (length - 1) >> parameter;
+    for (; quotient >= 64; quotient -= 64) {
+      writer->Write(0, 64);
+    }
+    // The quotient's zeroes and the terminating one.
+    writer->Write(1, quotient + 1);
+    if (parameter != 0) {
+      writer->Write((length - 1) & ((uint64_t(1) << parameter) - 1),
+                    parameter);
+    }
+  }
+
+  BitWriter* writer;
+  const uint32_t* parameters;
+};
+
+}  // namespace
+
+RunLengthCodec::RunLengthCodec(const PackedFv& bits) : num_bits_(bits.size()) {
+  RunStatsCollector collector;
+  ForEachRun(bits, &collector);
+  encoded_bits_ = kHeaderBits;
+  for (int value = 0; value < 2; ++value) {
+    const RunStats& stats = collector.stats[value];
+    num_runs_[value] = stats.count;
+    parameter_[value] = kEliasGamma;
+    uint64_t best_bits = stats.gamma_bits;
+    for (uint32_t k = 0; k <= kMaxRiceParameter; ++k) {
+      const uint64_t bits = stats.RiceBits(k);
+      if (bits < best_bits) {
+        best_bits = bits;
+        parameter_[value] = k;
+      }
+    }
+    encoded_bits_ += best_bits;
+  }
+}
+
+size_t RunLengthCodec::EncodedBits(const PackedFv& bits) const {
+  RunStatsCollector collector;
+  ForEachRun(bits, &collector);
+  size_t encoded_bits = kHeaderBits;
+  for (int value = 0; value < 2; ++value) {
+    encoded_bits += collector.stats[value].Bits(parameter_[value]);
+  }
+  return encoded_bits;
+}
+
+size_t RunLengthCodec::Encode(const PackedFv& bits, uint8_t* out) const {
+  BitWriter writer(out);
+  writer.Write(bits.size(), 64);
+  writer.Write(bits.empty() ? 0 : bits.PeekBits(0, 1), 1);
+  writer.Write(parameter_[0], 6);
+  writer.Write(parameter_[1], 6);
+  RunWriter run_writer = {&writer, parameter_};
+  ForEachRun(bits, &run_writer);
+  writer.Flush();
+  return writer.bits_written();
+}
+
+PackedFv RunLengthCodec::Decode(const uint8_t* bytes, size_t num_bits) {
+  BitReader reader(bytes, num_bits);
+  const uint64_t total = reader.Read(64);
+  bool value = reader.Read(1) != 0;
+  uint32_t parameters[2];
+  parameters[0] = static_cast<uint32_t>(reader.Read(6));
+  parameters[1] = static_cast<uint32_t>(reader.Read(6));
+  for (uint32_t parameter : parameters) {
+    if (parameter != kEliasGamma && parameter > kMaxRiceParameter) {
+      throw runtime_error("Invalid run-length code parameter.");
+    }
+  }
+
+  PackedFv decoded;
+  uint64_t produced = 0;
+  while (produced < total) {
+    const uint32_t parameter = parameters[value];
+    uint64_t length;
+    if (parameter == kEliasGamma) {
+      const uint64_t zeros = reader.ReadUnary();
+      if (zeros > 63) {
+        throw runtime_error("Invalid Elias gamma code.");
+      }
+      // The leading one was consumed by ReadUnary.
+      length = (uint64_t(1) << zeros) | (zeros ? reader.Read(zeros) : 0);
+    } else {
+      const uint64_t quotient = reader.ReadUnary();
+      if (quotient > (kSaturated >> parameter)) {
+        throw runtime_error("Invalid Rice code.");
+      }
+      length = (quotient << parameter) + 1;
+      if (parameter != 0) {
+        length += reader.Read(parameter);
+      }
+    }
+    if (length > total - produced) {
+      throw runtime_error("Run exceeds the stream length.");
+    }
+    const uint64_t fill = value ? ~uint64_t(0) : 0;
+    for (uint64_t left = length; left != 0;) {
+      const size_t chunk = (left < 64) ? left : 64;
+      decoded.PushBits(fill, chunk);
+      left -= chunk;
+    }
+    produced += length;
+    value = !value;
+  }
+  if (!reader.done()) {
+    throw runtime_error("Trailing data in run-length stream.");
+  }
+  return decoded;
+}
+
+void RunLengthCodec::PrintCompressionData() const {
+  const char* names[2] = {"Zero", "One"};
+  for (int value = 0; value < 2; ++value) {
+    cout << names[value] << " runs: " << num_runs_[value] << ", code: ";
+    if (parameter_[value] == kEliasGamma) {
+      cout << "Elias gamma\n";
+    } else {
+      cout << "Rice k=" << parameter_[value] << "\n";
+    }
+  }
+  cout << "Raw bits: " << num_bits_ << "\n";
+  cout << "Coded bits: " << encoded_bits_ << "\n";
+  cout << "Compression ratio: "
+       << (encoded_bits_ > 0 ? double(num_bits_) / encoded_bits_ : 0.0)
+       << "\n";
+}
+
+}  // namespace codec
+}  // namespace signal_content
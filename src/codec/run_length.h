@@ -0,0 +1,109 @@
+/*
+ * run_length.h
+ *
+ * Bit-level run-length coding for sparse streams such as memory images, which
+ * are mostly long constant runs broken by isolated veto bits, and tower
+ * streams, which are mostly zero energy.
+ *
+ * A stream is coded as its first value followed by the lengths of its
+ * alternating runs. Zero runs and one runs each get their own code: either
+ * Elias gamma, which suits lengths spread over many orders of magnitude, or
+ * Golomb-Rice with parameter k, which suits lengths clustered around 2^k. The
+ * encoder picks whichever is smallest for the stream at hand.
+ *
+ * Runs are found a word at a time by counting leading zeros, so a run costs
+ * one step per 64-bit word it spans rather than one per bit.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_RUN_LENGTH_H_
+#define SIGNAL_CONTENT_CODEC_RUN_LENGTH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../base/packed_fv.h"
+
+namespace signal_content {
+namespace codec {
+
+// Calls (*visitor)(bool value, uint64_t length) for each maximal run of equal
+// values in 'bits', in order. X and Z are treated as zeroes.
+template <typename Visitor>
+void ForEachRun(const base::PackedFv& bits, Visitor* visitor) {
+  typedef base::PackedFv::Word Word;
+  const size_t kWordBits = base::PackedFv::kBitsPerWord;
+  const size_t num_bits = bits.size();
+  if (num_bits == 0) {
+    return;
+  }
+  bool value = (bits.PeekBits(0, 1) != 0);
+  uint64_t run = 0;
+  for (size_t w = 0; w * kWordBits < num_bits; ++w) {
+    Word word = bits.ValueWord(w);
+    if (bits.HasUnknownPlane()) {
+      word &= ~bits.UnknownWord(w);
+    }
+    const size_t valid = (num_bits - w * kWordBits < kWordBits) ?
+        num_bits - w * kWordBits : kWordBits;
+    size_t pos = 0;
+    while (pos < valid) {
+      // Ones mark values that end the current run.
+      const Word diff = (value ? ~word : word) << pos;
+      size_t same = (diff == 0) ? kWordBits - pos : __builtin_clzll(diff);
+      if (same > valid - pos) {
+        same = valid - pos;
+      }
+      run += same;
+      pos += same;
+      if (pos < valid) {
+        (*visitor)(value, run);
+        value = !value;
+        run = 0;
+      }
+    }
+  }
+  (*visitor)(value, run);
+}
+
+class RunLengthCodec {
+ public:
+  // Parameter value selecting Elias gamma instead of a Rice code.
+  static const uint32_t kEliasGamma = 63;
+
+  // Picks the code for each run polarity that minimizes the encoding of
+  // 'bits'.
+  explicit RunLengthCodec(const base::PackedFv& bits);
+
+  // Exact size in bits of the encoding of 'bits', including its header.
+  size_t EncodedBits(const base::PackedFv& bits) const;
+  // Encodes 'bits' into 'out', which must hold
+  // BitWriter::BytesForBits(EncodedBits(bits)) bytes. Returns the number of
+  // bits written.
+  size_t Encode(const base::PackedFv& bits, uint8_t* out) const;
+
+  // Decodes the first 'num_bits' bits of 'bytes'. The encoding describes its
+  // own parameters, so no codec instance is needed. Throws
+  // std::runtime_error if the encoding is malformed.
+  static base::PackedFv Decode(const uint8_t* bytes, size_t num_bits);
+
+  // Rice parameter, or kEliasGamma, used for runs of zeroes and of ones.
+  uint32_t zero_run_parameter() const { return parameter_[0]; }
+  uint32_t one_run_parameter() const { return parameter_[1]; }
+
+  void PrintCompressionData() const;
+
+ private:
+  // Header: the stream length (64 bits), its first value (1 bit) and the
+  // parameter of each polarity (6 bits each).
+  static const size_t kHeaderBits = 64 + 1 + 6 + 6;
+
+  uint32_t parameter_[2];
+  uint64_t num_bits_{0};
+  uint64_t num_runs_[2];
+  size_t encoded_bits_{0};
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_RUN_LENGTH_H_ */
@@ -0,0 +1,500 @@
+/*
+ * stream_codec.cpp
+ */
+
+#include "stream_codec.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "../base/frame_view.h"
+#include "bit_writer.h"
+#include "context_mixing.h"
+#include "frame_symbols.h"
+#include "huffman.h"
+#include "lzw.h"
+#include "rans.h"
+#include "run_length.h"
+#include "symbol_histogram.h"
+
+using namespace std;
+
+namespace signal_content {
+using base::PackedFv;
+using base::ThreadPool;
+using base::VFrameView;
+namespace codec {
+
+namespace {
+
+// Codecs that code each chunk on its own store it as a record: the payload
+// length in bits as a 64-bit big-endian integer, then the payload,
+// zero-padded to a byte.
+const size_t kRecordHeaderBytes = 8;
+
+// Reserves a record for 'num_bits' payload bits at the end of 'out' and
+// returns where its payload starts.
+uint8_t* AppendRecord(size_t num_bits, vector<uint8_t>* out) {
+  const size_t start = out->size();
+  out->resize(start + kRecordHeaderBytes + BitWriter::BytesForBits(num_bits));
+  for (size_t i = 0; i < kRecordHeaderBytes; ++i) {
+    (*out)[start + i] = static_cast<uint8_t>(num_bits >> (56 - 8 * i));
+  }
+  return out->data() + start + kRecordHeaderBytes;
+}
+
+// Reads the record at '*pos', advances '*pos' past it and returns its
+// payload.
+const uint8_t* ReadRecord(const vector<uint8_t>& encoded, size_t* pos,
+                          size_t* num_bits) {
+  if (encoded.size() - *pos < kRecordHeaderBytes) {
+    throw runtime_error("Truncated chunk header.");
+  }
+  uint64_t bits = 0;
+  for (size_t i = 0; i < kRecordHeaderBytes; ++i) {
+    bits = (bits << 8) | encoded[*pos + i];
+  }
+  *pos += kRecordHeaderBytes;
+  if (bits > 8 * (encoded.size() - *pos)) {
+    throw runtime_error("Truncated chunk.");
+  }
+  const uint8_t* payload = encoded.data() + *pos;
+  *pos += BitWriter::BytesForBits(bits);
+  *num_bits = bits;
+  return payload;
+}
+
+void CheckChunk(const PackedFv& chunk, size_t symbol_bits) {
+  if (chunk.size() % symbol_bits != 0) {
+    throw invalid_argument("Chunk is not a whole number of symbols.");
+  }
+}
+
+void AppendSymbols(const vector<int>& symbols, size_t symbol_bits,
+                   PackedFv* out) {
+  for (int symbol : symbols) {
+    out->PushBits(static_cast<uint32_t>(symbol), symbol_bits);
+  }
+}
+
+struct HistogramAdder {
+  void operator()(const int* symbols, size_t count) {
+    histogram->Add(symbols, count);
+  }
+  SymbolHistogram* histogram;
+};
+
+// One code for the whole stream, built from the training pass.
+class HuffmanStreamCodec : public StreamCodec {
+ public:
+  explicit HuffmanStreamCodec(size_t symbol_bits)
+      : symbol_bits_(symbol_bits), histogram_(symbol_bits) {}
+
+  string name() const override { return "huffman"; }
+  size_t symbol_bits() const override { return symbol_bits_; }
+  bool trains() const override { return true; }
+
+  void Train(const PackedFv& chunk) override {
+    CheckChunk(chunk, symbol_bits_);
+    HistogramAdder adder = {&histogram_};
+    ForEachFrameSymbols(VFrameView(chunk, symbol_bits_), symbol_bits_,
+                        &adder);
+  }
+  void FinishTraining() override {
+    codec_.reset(new HuffmanCodec(histogram_, symbol_bits_));
+  }
+
+  void Encode(const PackedFv& chunk) override {
+    CheckChunk(chunk, symbol_bits_);
+    const VFrameView frames(chunk, symbol_bits_);
+    codec_->Encode(frames,
+                   AppendRecord(codec_->EncodedBits(frames), &encoded_));
+  }
+
+  void Decode(const vector<uint8_t>& encoded, PackedFv* out) const override {
+    size_t pos = 0;
+    while (pos < encoded.size()) {
+      size_t num_bits;
+      const uint8_t* payload = ReadRecord(encoded, &pos, &num_bits);
+      AppendSymbols(codec_->Decode(payload, num_bits), symbol_bits_, out);
+    }
+  }
+
+ private:
+  size_t symbol_bits_;
+  SymbolHistogram histogram_;
+  unique_ptr<HuffmanCodec> codec_;
+};
+
+// One model for the whole stream, built from the training pass. Each chunk
+// is a separate rANS encoding, which holds its own length.
+class RansStreamCodec : public StreamCodec {
+ public:
+  explicit RansStreamCodec(size_t symbol_bits)
+      : symbol_bits_(symbol_bits), histogram_(symbol_bits) {}
+
+  string name() const override { return "rans"; }
+  size_t symbol_bits() const override { return symbol_bits_; }
+  bool trains() const override { return true; }
+
+  void Train(const PackedFv& chunk) override {
+    CheckChunk(chunk, symbol_bits_);
+    HistogramAdder adder = {&histogram_};
+    ForEachFrameSymbols(VFrameView(chunk, symbol_bits_), symbol_bits_,
+                        &adder);
+  }
+  void FinishTraining() override {
+    codec_.reset(new RansCodec(histogram_, symbol_bits_));
+  }
+
+  void Encode(const PackedFv& chunk) override {
+    CheckChunk(chunk, symbol_bits_);
+    const vector<uint8_t> bytes =
+        codec_->Encode(VFrameView(chunk, symbol_bits_));
+    copy(bytes.begin(), bytes.end(),
+         AppendRecord(bytes.size() * 8, &encoded_));
+  }
+
+  void Decode(const vector<uint8_t>& encoded, PackedFv* out) const override {
+    size_t pos = 0;
+    while (pos < encoded.size()) {
+      size_t num_bits;
+      const uint8_t* payload = ReadRecord(encoded, &pos, &num_bits);
+      const vector<uint8_t> bytes(payload, payload + num_bits / 8);
+      AppendSymbols(codec_->Decode(bytes), symbol_bits_, out);
+    }
+  }
+
+ private:
+  size_t symbol_bits_;
+  SymbolHistogram histogram_;
+  unique_ptr<RansCodec> codec_;
+};
+
+// Single-pass LZW over bytes. The dictionary carries across chunks, so the
+// output is the same however the stream is split.
+class LzwStreamCodec : public StreamCodec {
+ public:
+  string name() const override { return "lzw_stream"; }
+  size_t symbol_bits() const override { return 8; }
+
+  void Encode(const PackedFv& chunk) override {
+    CheckChunk(chunk, 8);
+    encoder_.Push(chunk);
+    encoder_.TakeOutput(&encoded_);
+  }
+  void FinishEncoding() override {
+    encoder_.Finish();
+    encoder_.TakeOutput(&encoded_);
+  }
+
+  void Decode(const vector<uint8_t>& encoded, PackedFv* out) const override {
+    LzwStreamDecoder<> decoder;
+    vector<uint32_t> symbols;
+    if (!decoder.Decode(encoded.data(), encoded.size(), &symbols)) {
+      throw runtime_error("LZW stream has no end code.");
+    }
+    for (uint32_t symbol : symbols) {
+      out->PushBits(symbol, 8);
+    }
+  }
+
+ private:
+  LzwStreamEncoder<> encoder_;
+};
+
+// Each chunk is run-length coded with the codes that suit it best, so no
+// training pass is needed.
+class RunLengthStreamCodec : public StreamCodec {
+ public:
+  string name() const override { return "run_length"; }
+  size_t symbol_bits() const override { return 1; }
+
+  void Encode(const PackedFv& chunk) override {
+    const RunLengthCodec codec(chunk);
+    codec.Encode(chunk, AppendRecord(codec.EncodedBits(chunk), &encoded_));
+  }
+
+  void Decode(const vector<uint8_t>& encoded, PackedFv* out) const override {
+    size_t pos = 0;
+    while (pos < encoded.size()) {
+      size_t num_bits;
+      const uint8_t* payload = ReadRecord(encoded, &pos, &num_bits);
+      out->Append(RunLengthCodec::Decode(payload, num_bits));
+    }
+  }
+};
+
+// Each chunk is coded on its own, as one block with a fresh predictor, with
+// frames of one symbol.
+class ContextMixingStreamCodec : public StreamCodec {
+ public:
+  explicit ContextMixingStreamCodec(size_t symbol_bits)
+      : codec_(symbol_bits) {}
+
+  string name() const override { return "context_mixing"; }
+  size_t symbol_bits() const override { return codec_.frame_size(); }
+
+  void Encode(const PackedFv& chunk) override {
+    CheckChunk(chunk, codec_.frame_size());
+    const vector<uint8_t> block = codec_.Encode(chunk);
+    copy(block.begin(), block.end(),
+         AppendRecord(block.size() * 8, &encoded_));
+  }
+
+  void Decode(const vector<uint8_t>& encoded, PackedFv* out) const override {
+    size_t pos = 0;
+    while (pos < encoded.size()) {
+      size_t num_bits;
+      const uint8_t* payload = ReadRecord(encoded, &pos, &num_bits);
+      const vector<uint8_t> block(payload, payload + num_bits / 8);
+      out->Append(codec_.Decode(block));
+    }
+  }
+
+ private:
+  ContextMixingCodec codec_;
+};
+
+// Transforms each chunk before the wrapped codec sees it. Training and
+// encoding each run their own copy of the transform over the whole stream.
+class TransformedStreamCodec : public StreamCodec {
+ public:
+  TransformedStreamCodec(const FrameTransform& transform,
+                         unique_ptr<StreamCodec> codec)
+      : transform_(transform), train_transform_(transform),
+        encode_transform_(transform), codec_(std::move(codec)) {
+    transform_.Reset();
+    train_transform_.Reset();
+    encode_transform_.Reset();
+  }
+
+  string name() const override {
+    return transform_.name() + "+" + codec_->name();
+  }
+  size_t symbol_bits() const override {
+    // The least common multiple of the frame and symbol sizes.
+    size_t a = transform_.frame_size();
+    size_t b = codec_->symbol_bits();
+    while (b != 0) {
+      const size_t r = a % b;
+      a = b;
+      b = r;
+    }
+    return transform_.frame_size() / a * codec_->symbol_bits();
+  }
+  bool trains() const override { return codec_->trains(); }
+
+  void Train(const PackedFv& chunk) override {
+    PackedFv residuals;
+    train_transform_.Forward(chunk, &residuals);
+    codec_->Train(residuals);
+  }
+  void FinishTraining() override { codec_->FinishTraining(); }
+
+  void Encode(const PackedFv& chunk) override {
+    PackedFv residuals;
+    encode_transform_.Forward(chunk, &residuals);
+    codec_->Encode(residuals);
+    CopyNewOutput();
+  }
+  void FinishEncoding() override {
+    codec_->FinishEncoding();
+    CopyNewOutput();
+  }
+  size_t encoded_bits() const override { return codec_->encoded_bits(); }
+
+  void Decode(const vector<uint8_t>& encoded, PackedFv* out) const override {
+    PackedFv residuals;
+    codec_->Decode(encoded, &residuals);
+    FrameTransform transform(transform_);
+    transform.Inverse(residuals, out);
+  }
+
+ private:
+  // Brings encoded() up to date with the wrapped codec's output.
+  void CopyNewOutput() {
+    const vector<uint8_t>& output = codec_->encoded();
+    encoded_.insert(encoded_.end(), output.begin() + encoded_.size(),
+                    output.end());
+  }
+
+  FrameTransform transform_;
+  FrameTransform train_transform_;
+  FrameTransform encode_transform_;
+  unique_ptr<StreamCodec> codec_;
+};
+
+// Factory for a codec that takes any symbol size from 1 to 32 bits.
+template <typename Codec>
+StreamCodecFactory SymbolCodecFactory(size_t default_symbol_bits) {
+  return [default_symbol_bits] (size_t symbol_bits) {
+    if (symbol_bits == 0) {
+      symbol_bits = default_symbol_bits;
+    }
+    if (symbol_bits > 32) {
+      throw invalid_argument("Symbol size cannot exceed 32 bits.");
+    }
+    return unique_ptr<StreamCodec>(new Codec(symbol_bits));
+  };
+}
+
+// Factory for a codec that takes frames of any size, such as bus captures or
+// memory words wider than 32 bits.
+template <typename Codec>
+StreamCodecFactory FrameCodecFactory(size_t default_frame_bits) {
+  return [default_frame_bits] (size_t frame_bits) {
+    return unique_ptr<StreamCodec>(
+        new Codec(frame_bits == 0 ? default_frame_bits : frame_bits));
+  };
+}
+
+// Factory for a codec with a fixed symbol size.
+template <typename Codec>
+StreamCodecFactory FixedSymbolCodecFactory(size_t codec_symbol_bits) {
+  return [codec_symbol_bits] (size_t symbol_bits) {
+    if (symbol_bits != 0 && symbol_bits != codec_symbol_bits) {
+      throw invalid_argument("Codec does not support this symbol size.");
+    }
+    return unique_ptr<StreamCodec>(new Codec());
+  };
+}
+
+}  // namespace
+
+StreamCodecRegistry& StreamCodecRegistry::Global() {
+  static StreamCodecRegistry* registry = [] () {
+    StreamCodecRegistry* r = new StreamCodecRegistry();
+    r->Register("huffman", SymbolCodecFactory<HuffmanStreamCodec>(8));
+    r->Register("rans", SymbolCodecFactory<RansStreamCodec>(8));
+    r->Register("lzw_stream", FixedSymbolCodecFactory<LzwStreamCodec>(8));
+    r->Register("run_length",
+                FixedSymbolCodecFactory<RunLengthStreamCodec>(1));
+    r->Register("context_mixing",
+                FrameCodecFactory<ContextMixingStreamCodec>(8));
+    return r;
+  }();
+  return *registry;
+}
+
+void StreamCodecRegistry::Register(const string& name,
+                                   StreamCodecFactory factory) {
+  factories_[name] = std::move(factory);
+}
+
+unique_ptr<StreamCodec> StreamCodecRegistry::Create(const string& name,
+                                                    size_t symbol_bits) const {
+  auto it = factories_.find(name);
+  if (it == factories_.end()) {
+    throw invalid_argument("No stream codec named " + name);
+  }
+  return it->second(symbol_bits);
+}
+
+vector<string> StreamCodecRegistry::Names() const {
+  vector<string> names;
+  for (const auto& p : factories_) {
+    names.push_back(p.first);
+  }
+  return names;
+}
+
+unique_ptr<StreamCodec> WithFrameTransform(const FrameTransform& transform,
+                                           unique_ptr<StreamCodec> codec) {
+  return unique_ptr<StreamCodec>(
+      new TransformedStreamCodec(transform, std::move(codec)));
+}
+
+ChunkSource PackedFvChunks(const PackedFv& bits, size_t chunk_bits) {
+  if (chunk_bits == 0) {
+    throw invalid_argument("Chunk size must be positive.");
+  }
+  size_t pos = 0;
+  return [&bits, chunk_bits, pos] (PackedFv* chunk) mutable {
+    if (pos >= bits.size()) {
+      return false;
+    }
+    const size_t end = min(bits.size(), pos + chunk_bits);
+    chunk->reserve(end - pos);
+    for (; pos < end; pos += PackedFv::kBitsPerWord) {
+      const size_t n = min(size_t(PackedFv::kBitsPerWord), end - pos);
+      chunk->PushBits(bits.PeekValueBits(pos, n),
+                      bits.PeekUnknownBits(pos, n), n);
+    }
+    pos = end;
+    return true;
+  };
+}
+
+StreamFanOut::StreamFanOut(vector<unique_ptr<StreamCodec>> codecs,
+                           ThreadPool* pool)
+    : codecs_(std::move(codecs)), pool_(pool) {}
+
+void StreamFanOut::Run(const ChunkSource& source) {
+  const bool any_trains = any_of(
+      codecs_.begin(), codecs_.end(),
+      [] (const unique_ptr<StreamCodec>& codec) { return codec->trains(); });
+
+  // First pass: training codecs train while the others encode.
+  vector<PackedFv> kept;
+  PackedFv chunk;
+  bool have_chunk = source(&chunk);
+  while (have_chunk) {
+    const PackedFv& current = chunk;
+    for (const unique_ptr<StreamCodec>& codec : codecs_) {
+      StreamCodec* c = codec.get();
+      pool_->Submit([c, &current] () {
+        if (c->trains()) {
+          c->Train(current);
+        } else {
+          c->Encode(current);
+        }
+      });
+    }
+    PackedFv next;
+    try {
+      have_chunk = source(&next);
+    } catch (...) {
+      // The tasks still read 'chunk'. They finish before it is destroyed,
+      // and the source's error wins over theirs.
+      try {
+        pool_->Wait();
+      } catch (...) {
+      }
+      throw;
+    }
+    pool_->Wait();
+    if (any_trains) {
+      kept.push_back(std::move(chunk));
+    }
+    chunk = std::move(next);
+  }
+
+  auto trains = [] (const StreamCodec& codec) { return codec.trains(); };
+  ForEachCodec(trains, [] (StreamCodec* codec) { codec->FinishTraining(); });
+  // Second pass over the kept chunks, one codec per thread; each codec sees
+  // the chunks in order.
+  ForEachCodec(trains, [&kept] (StreamCodec* codec) {
+    for (const PackedFv& c : kept) {
+      codec->Encode(c);
+    }
+  });
+  ForEachCodec([] (const StreamCodec&) { return true; },
+               [] (StreamCodec* codec) { codec->FinishEncoding(); });
+}
+
+void StreamFanOut::ForEachCodec(
+    const function<bool(const StreamCodec&)>& select,
+    const function<void(StreamCodec*)>& op) {
+  for (const unique_ptr<StreamCodec>& codec : codecs_) {
+    if (select(*codec)) {
+      StreamCodec* c = codec.get();
+      pool_->Submit([&op, c] () { op(c); });
+    }
+  }
+  pool_->Wait();
+}
+
+}  // namespace codec
+}  // namespace signal_content
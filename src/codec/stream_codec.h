@@ -0,0 +1,138 @@
+/*
+ * stream_codec.h
+ *
+ * A common interface for codecs over a stream of packed bits that arrives in
+ * chunks, a registry of the codecs that implement it, and a driver that feeds
+ * one stream to many codecs at once.
+ *
+ * A codec sees the stream twice if it needs training: once through Train and
+ * once through Encode. Codecs that adapt as they go see it once, through
+ * Encode. Every chunk must be a whole number of the codec's symbols.
+ *
+ * StreamFanOut reads each chunk from its source once and hands the same chunk
+ * to every codec, each on its own pool thread, so comparing N codecs costs
+ * one read of the data rather than N copies of it.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_STREAM_CODEC_H_
+#define SIGNAL_CONTENT_CODEC_STREAM_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../base/packed_fv.h"
+#include "../base/thread_pool.h"
+#include "frame_transform.h"
+
+namespace signal_content {
+namespace codec {
+
+class StreamCodec {
+ public:
+  virtual ~StreamCodec() {}
+
+  virtual std::string name() const = 0;
+  // Chunks must be a multiple of this many bits.
+  virtual size_t symbol_bits() const = 0;
+
+  // True if the codec must see the whole stream through Train, followed by
+  // FinishTraining, before the first Encode.
+  virtual bool trains() const { return false; }
+  virtual void Train(const base::PackedFv& /* chunk */) {}
+  virtual void FinishTraining() {}
+
+  // Appends the encoding of 'chunk' to encoded().
+  virtual void Encode(const base::PackedFv& chunk) = 0;
+  // Completes encoded(). Must be called once, after the last Encode.
+  virtual void FinishEncoding() {}
+
+  const std::vector<uint8_t>& encoded() const { return encoded_; }
+  // Size of encoded(), counting any chunk framing.
+  virtual size_t encoded_bits() const { return encoded_.size() * 8; }
+
+  // Decodes the output of an encoding pass, appending it to 'out'. Throws
+  // std::runtime_error if 'encoded' is malformed.
+  virtual void Decode(const std::vector<uint8_t>& encoded,
+                      base::PackedFv* out) const = 0;
+
+ protected:
+  std::vector<uint8_t> encoded_;
+};
+
+// Makes a codec for symbols of 'symbol_bits' bits; 0 selects the codec's
+// default.
+typedef std::function<std::unique_ptr<StreamCodec>(size_t symbol_bits)>
+    StreamCodecFactory;
+
+class StreamCodecRegistry {
+ public:
+  // The registry holding every codec in this library that codes a plain
+  // stream: "huffman", "rans", "lzw_stream", "run_length" and
+  // "context_mixing". Codecs for tower grids and zero-suppressed frames need
+  // the stream's layout and are used directly.
+  static StreamCodecRegistry& Global();
+
+  // Replaces any factory already registered under 'name'.
+  void Register(const std::string& name, StreamCodecFactory factory);
+
+  // Throws std::invalid_argument if no codec is registered under 'name', or
+  // if the codec does not support 'symbol_bits'.
+  std::unique_ptr<StreamCodec> Create(const std::string& name,
+                                      size_t symbol_bits = 0) const;
+
+  // Registered names in sorted order.
+  std::vector<std::string> Names() const;
+
+ private:
+  std::map<std::string, StreamCodecFactory> factories_;
+};
+
+// Wraps 'codec' so that it codes the residuals of 'transform' rather than
+// the stream itself, and decodes back to the stream. The wrapper is named
+// "<transform>+<codec>", e.g. "delta_prev+huffman", and its chunks must be
+// whole frames as well as whole symbols.
+std::unique_ptr<StreamCodec> WithFrameTransform(
+    const FrameTransform& transform, std::unique_ptr<StreamCodec> codec);
+
+// Stores the next chunk of a stream in '*chunk', which is empty on entry, and
+// returns true; returns false at the end of the stream.
+typedef std::function<bool(base::PackedFv* chunk)> ChunkSource;
+
+// Splits 'bits' into chunks of 'chunk_bits' bits, the last possibly shorter.
+// 'bits' must outlive the source.
+ChunkSource PackedFvChunks(const base::PackedFv& bits, size_t chunk_bits);
+
+class StreamFanOut {
+ public:
+  // Runs on the threads of 'pool', which must outlive this object.
+  StreamFanOut(std::vector<std::unique_ptr<StreamCodec>> codecs,
+               base::ThreadPool* pool);
+
+  // Reads 'source' to the end, training and then encoding every codec. The
+  // next chunk is read while the codecs work on the current one. Chunks are
+  // kept in memory for the encoding pass only if some codec trains.
+  void Run(const ChunkSource& source);
+
+  const std::vector<std::unique_ptr<StreamCodec>>& codecs() const {
+    return codecs_;
+  }
+
+ private:
+  // Calls 'op' on every codec for which 'select' is true, concurrently, and
+  // waits for all of them.
+  void ForEachCodec(const std::function<bool(const StreamCodec&)>& select,
+                    const std::function<void(StreamCodec*)>& op);
+
+  std::vector<std::unique_ptr<StreamCodec>> codecs_;
+  base::ThreadPool* pool_;
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_STREAM_CODEC_H_ */
@@ -0,0 +1,509 @@
+/*
+ * streaming_entropy.h
+ *
+ * Entropy of a stream of words in a fixed amount of memory, for streams whose
+ * distinct words would not fit in ShannonEntropyAccumulator's table: wide
+ * words such as whole tower rows or 64-bit frames, over long captures.
+ *
+ * The 'heavy_hitters' most frequent words are tracked by the SpaceSaving
+ * algorithm of Metwally, Agrawal and El Abbadi: once its table is full, a new
+ * word replaces the one with the smallest count, so a frequent word that
+ * first appears late in a non-stationary stream still displaces rare ones.
+ * Any word with more than N / heavy_hitters of the N words is tracked. The
+ * stream as a whole is summarized by
+ *
+ *   - a count-min sketch, which with SpaceSaving's own count gives a tight
+ *     upper bound on the count of each tracked word;
+ *   - a HyperLogLog counter of the distinct words;
+ *   - a reservoir sample of occurrences, each with the number of times its
+ *     word occurs from there to the end of the stream.
+ *
+ * The head is the tracked words that are surely more frequent than any
+ * untracked one, and its share of the entropy comes from their counts. The
+ * rest of the words form the tail, whose share is estimated from the sampled
+ * occurrences of tail words as in Chakrabarti, Cormode and McGregor: if an
+ * occurrence's word occurs r times from it onwards in a tail of T words,
+ * f(r) - f(r - 1) with f(x) = x log2(T / x) is an unbiased estimate of the
+ * tail entropy. The estimate is bounded below by the largest count any tail
+ * word can have and above by a uniform spread over the distinct tail words.
+ * The upper bound holds unless the distinct count is off by more than three
+ * standard errors. Both bounds take T as exact, which it is only as far as
+ * the head counts are; the sketch overcounts by about N * e / sketch_width.
+ *
+ * With the default parameters the estimator holds about 2 MB.
+ *
+ * Words wider than 64 bits are reduced to a 64-bit fingerprint; distinct
+ * words collide with probability about 2^-64 per pair.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_STREAMING_ENTROPY_H_
+#define SIGNAL_CONTENT_CODEC_STREAMING_ENTROPY_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "entropy.h"
+
+namespace signal_content {
+namespace codec {
+
+// The counts of up to 'capacity' keys of a stream, by SpaceSaving. Once the
+// table is full, a new key takes the place of the key with the smallest
+// count and inherits that count as its error. A key's count is at least its
+// number of occurrences and at most that plus its error, and a key outside
+// the table occurs at most MinCount() times. Keys must be well mixed.
+class SpaceSavingCounts {
+ public:
+  struct Entry {
+    uint64_t key;
+    uint64_t count;
+    uint64_t error;
+    // The key's slot in the index.
+    uint32_t slot;
+  };
+
+  explicit SpaceSavingCounts(size_t capacity) : capacity_(capacity) {
+    size_t slots = 16;
+    while (slots < 2 * capacity) {
+      slots *= 2;
+    }
+    index_.assign(slots, uint32_t(kEmpty));
+    entries_.reserve(capacity);
+  }
+
+  void Add(uint64_t key) {
+    size_t slot = Slot(key);
+    for (; index_[slot] != kEmpty; slot = (slot + 1) & (index_.size() - 1)) {
+      if (entries_[index_[slot]].key == key) {
+        const uint32_t position = index_[slot];
+        ++entries_[position].count;
+        SiftDown(position);
+        return;
+      }
+    }
+    if (entries_.size() < capacity_) {
+      const Entry entry = {key, 1, 0, static_cast<uint32_t>(slot)};
+      index_[slot] = static_cast<uint32_t>(entries_.size());
+      entries_.push_back(entry);
+      SiftUp(index_[slot]);
+      return;
+    }
+    // The smallest count is at the root of the heap.
+    Entry& root = entries_[0];
+    Erase(root.slot);
+    slot = Slot(key);
+    while (index_[slot] != kEmpty) {
+      slot = (slot + 1) & (index_.size() - 1);
+    }
+    index_[slot] = 0;
+    root.key = key;
+    root.error = root.count++;
+    root.slot = static_cast<uint32_t>(slot);
+    SiftDown(0);
+  }
+
+  // Null if 'key' is not counted.
+  const Entry* Find(uint64_t key) const {
+    for (size_t slot = Slot(key); index_[slot] != kEmpty;
+         slot = (slot + 1) & (index_.size() - 1)) {
+      if (entries_[index_[slot]].key == key) {
+        return &entries_[index_[slot]];
+      }
+    }
+    return nullptr;
+  }
+
+  // The keys counted, in no particular order.
+  const std::vector<Entry>& entries() const { return entries_; }
+  // Zero until the table is full.
+  uint64_t MinCount() const {
+    return (entries_.size() < capacity_) ? 0 : entries_[0].count;
+  }
+  size_t memory_bytes() const {
+    return entries_.capacity() * sizeof(Entry) +
+           index_.size() * sizeof(uint32_t);
+  }
+
+ private:
+  static const uint32_t kEmpty = 0xFFFFFFFF;
+
+  size_t Slot(uint64_t key) const {
+    return static_cast<size_t>(key >> 32) & (index_.size() - 1);
+  }
+
+  void Place(uint32_t position, const Entry& entry) {
+    entries_[position] = entry;
+    index_[entry.slot] = position;
+  }
+
+  // Restores the heap order of 'entries_' by count, smallest first.
+  void SiftUp(uint32_t position) {
+    const Entry entry = entries_[position];
+    while (position > 0) {
+      const uint32_t parent = (position - 1) / 2;
+      if (entries_[parent].count <= entry.count) {
+        break;
+      }
+      Place(position, entries_[parent]);
+      position = parent;
+    }
+    Place(position, entry);
+  }
+
+  void SiftDown(uint32_t position) {
+    const Entry entry = entries_[position];
+    const size_t size = entries_.size();
+    while (2 * size_t(position) + 1 < size) {
+      uint32_t child = 2 * position + 1;
+      if (child + 1 < size &&
+          entries_[child + 1].count < entries_[child].count) {
+        ++child;
+      }
+      if (entry.count <= entries_[child].count) {
+        break;
+      }
+      Place(position, entries_[child]);
+      position = child;
+    }
+    Place(position, entry);
+  }
+
+  // Empties 'slot' of the index, moving later keys of its probe sequence
+  // back so that they stay reachable.
+  void Erase(size_t slot) {
+    const size_t mask = index_.size() - 1;
+    size_t next = slot;
+    while (true) {
+      next = (next + 1) & mask;
+      if (index_[next] == kEmpty) {
+        break;
+      }
+      const size_t home = Slot(entries_[index_[next]].key);
+      // The key at 'next' may move back unless its home lies cyclically in
+      // (slot, next].
+      const bool stays = (slot <= next) ? (slot < home && home <= next)
+                                        : (slot < home || home <= next);
+      if (!stays) {
+        index_[slot] = index_[next];
+        entries_[index_[slot]].slot = static_cast<uint32_t>(slot);
+        slot = next;
+      }
+    }
+    index_[slot] = kEmpty;
+  }
+
+  size_t capacity_;
+  // A min-heap by count.
+  std::vector<Entry> entries_;
+  // Open-addressing index from key to position in 'entries_', kEmpty when
+  // unused.
+  std::vector<uint32_t> index_;
+};
+
+class StreamingEntropyEstimator {
+ public:
+  struct Parameters {
+    // Distinct words in the head.
+    size_t heavy_hitters = size_t(1) << 14;
+    // Count-min sketch: 'sketch_depth' rows of 'sketch_width' counters. The
+    // width must be a power of two.
+    size_t sketch_width = size_t(1) << 15;
+    size_t sketch_depth = 4;
+    // log2 of the number of HyperLogLog registers, in [4, 18]. The distinct
+    // count has a relative standard error of 1.04 / sqrt(2^precision).
+    int distinct_precision = 14;
+    // Occurrences sampled for the point estimate, of which those of tail
+    // words are used. The standard error falls as one over the square root.
+    size_t tail_samples = size_t(1) << 14;
+    uint64_t seed = 1;
+  };
+
+  struct Estimate {
+    // Bits per word.
+    double entropy;
+    double lower_bound;
+    double upper_bound;
+    // Standard error of the sampled tail term of 'entropy'.
+    double standard_error;
+    // Share of the words in the head.
+    double head_fraction;
+    double distinct_words;
+  };
+
+  // Throws std::invalid_argument if 'parameters' are out of range.
+  explicit StreamingEntropyEstimator(const Parameters& parameters)
+      : parameters_(parameters), heavy_counts_(parameters.heavy_hitters),
+        rng_(parameters.seed) {
+    if (parameters.heavy_hitters == 0 ||
+        parameters.heavy_hitters >= (size_t(1) << 31) ||
+        parameters.sketch_depth == 0 ||
+        parameters.sketch_width < 2 ||
+        (parameters.sketch_width & (parameters.sketch_width - 1)) != 0 ||
+        parameters.distinct_precision < 4 ||
+        parameters.distinct_precision > 18 || parameters.tail_samples == 0) {
+      throw std::invalid_argument("Invalid streaming entropy parameters.");
+    }
+    sketch_.assign(parameters.sketch_depth * parameters.sketch_width, 0);
+    registers_.assign(size_t(1) << parameters.distinct_precision, 0);
+    samples_.reserve(parameters.tail_samples);
+  }
+
+  StreamingEntropyEstimator()
+      : StreamingEntropyEstimator(Parameters()) {}
+
+  void AddSample(uint64_t word) { AddKey(MixKey(word)); }
+
+  // Adds one sample whose value is the 'count' words at 'words'.
+  void AddWideSample(const uint64_t* words, size_t count) {
+    uint64_t hash = MixKey(count);
+    for (size_t i = 0; i < count; ++i) {
+      hash = MixKey(hash ^ (words[i] + 0x9E3779B97F4A7C15ULL));
+    }
+    AddKey(hash);
+  }
+
+  uint64_t total() const { return total_words_; }
+
+  // Memory held, which is fixed by the parameters once the sample is full.
+  size_t memory_bytes() const {
+    return heavy_counts_.memory_bytes() + sketch_.size() * sizeof(uint64_t) +
+           registers_.size() + samples_.capacity() * sizeof(Sample) +
+           sampled_words_.size() * (sizeof(uint64_t) + sizeof(SampledWord));
+  }
+
+  double GetEntropy() const { return GetEstimate().entropy; }
+
+  Estimate GetEstimate() const {
+    Estimate estimate;
+    const double n = static_cast<double>(total_words_);
+    // Both SpaceSaving and the sketch overcount, so each counted word takes
+    // the smaller of the two. Words not surely more frequent than every
+    // uncounted word stay in the tail.
+    uint64_t head_total = 0;
+    size_t head_words = 0;
+    double head_count_log_sum = 0.0;
+    uint64_t max_tail_count = heavy_counts_.MinCount();
+    for (const SpaceSavingCounts::Entry& entry : heavy_counts_.entries()) {
+      const uint64_t count = std::min(entry.count, SketchCount(entry.key));
+      if (!InHead(entry)) {
+        max_tail_count = std::max(max_tail_count, count);
+        continue;
+      }
+      head_total += count;
+      ++head_words;
+      head_count_log_sum += CountLogCount(count);
+    }
+    head_total = std::min(head_total, total_words_);
+    const uint64_t tail = total_words_ - head_total;
+    // -sum p log2 p over the head words.
+    const double head_term = (total_words_ == 0) ? 0.0 :
+        (head_total * std::log2(n) - head_count_log_sum) / n;
+    estimate.head_fraction = (total_words_ == 0) ? 1.0 : head_total / n;
+    estimate.distinct_words = head_words;
+    estimate.standard_error = 0.0;
+    if (tail == 0) {
+      estimate.entropy = estimate.lower_bound = estimate.upper_bound =
+          head_term;
+      return estimate;
+    }
+
+    // The tail contributes (T / N) * (H_tail + log2(N / T)), where H_tail is
+    // the entropy of a word given that it is in the tail.
+    const double t = static_cast<double>(tail);
+    double distinct_tail = std::max(1.0, DistinctWords() - head_words);
+    estimate.distinct_words += distinct_tail;
+    const double relative_error =
+        1.04 / std::sqrt(static_cast<double>(registers_.size()));
+    distinct_tail *= 1.0 + 3.0 * relative_error;
+
+    const double lower =
+        std::log2(t / std::max<uint64_t>(1, std::min(max_tail_count, tail)));
+    const double upper =
+        std::max(lower, std::log2(std::max(1.0, std::min(t, distinct_tail))));
+
+    // Mean and variance of the per-sample estimates over tail words.
+    double sum = 0.0;
+    double sum_squares = 0.0;
+    size_t num_tail_samples = 0;
+    for (const Sample& sample : samples_) {
+      const SpaceSavingCounts::Entry* entry = heavy_counts_.Find(sample.key);
+      if (entry != nullptr && InHead(*entry)) {
+        continue;
+      }
+      ++num_tail_samples;
+      const double r = static_cast<double>(
+          sampled_words_.find(sample.key)->second.occurrences - sample.offset);
+      const double information =
+          r * std::log2(t / r) -
+          ((r > 1) ? (r - 1) * std::log2(t / (r - 1)) : 0.0);
+      sum += information;
+      sum_squares += information * information;
+    }
+    // Without tail samples the estimate is the middle of the bounds, and its
+    // error half their width.
+    double sampled = 0.5 * (lower + upper);
+    double sampled_error = 0.5 * (upper - lower);
+    if (num_tail_samples != 0) {
+      const double num_samples = static_cast<double>(num_tail_samples);
+      const double mean = sum / num_samples;
+      const double variance =
+          std::max(0.0, sum_squares / num_samples - mean * mean);
+      sampled = std::min(upper, std::max(lower, mean));
+      sampled_error = std::sqrt(variance / num_samples);
+    }
+
+    const double tail_share = t / n;
+    const double tail_offset = tail_share * std::log2(n / t);
+    estimate.entropy = head_term + tail_offset + tail_share * sampled;
+    estimate.lower_bound = head_term + tail_offset + tail_share * lower;
+    estimate.upper_bound = head_term + tail_offset + tail_share * upper;
+    estimate.standard_error = tail_share * sampled_error;
+    return estimate;
+  }
+
+ private:
+  struct Sample {
+    uint64_t key;
+    // Occurrences of the word counted before the sampled one.
+    uint64_t offset;
+  };
+
+  struct SampledWord {
+    // Occurrences since the word was first in the sample.
+    uint64_t occurrences;
+    // Samples of the word.
+    size_t samples;
+  };
+
+  void AddKey(uint64_t key) {
+    ++total_words_;
+    heavy_counts_.Add(key);
+    for (size_t row = 0; row < parameters_.sketch_depth; ++row) {
+      ++sketch_[SketchIndex(row, key)];
+    }
+
+    const uint64_t hash = MixKey(key ^ 0x5851F42D4C957F2DULL);
+    const int precision = parameters_.distinct_precision;
+    const uint64_t rest = hash << precision;
+    const uint8_t rank = (rest == 0) ? 64 - precision + 1
+                                     : __builtin_clzll(rest) + 1;
+    uint8_t& reg = registers_[hash >> (64 - precision)];
+    reg = std::max(reg, rank);
+
+    SampleOccurrence(key);
+  }
+
+  size_t SketchIndex(size_t row, uint64_t key) const {
+    const uint64_t hash = MixKey(key + (row + 1) * 0x9E3779B97F4A7C15ULL);
+    return row * parameters_.sketch_width +
+           (hash & (parameters_.sketch_width - 1));
+  }
+
+  bool InHead(const SpaceSavingCounts::Entry& entry) const {
+    return entry.count - entry.error > heavy_counts_.MinCount();
+  }
+
+  // An upper bound on the occurrences of 'key'.
+  uint64_t SketchCount(uint64_t key) const {
+    uint64_t count = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < parameters_.sketch_depth; ++row) {
+      count = std::min(count, sketch_[SketchIndex(row, key)]);
+    }
+    return count;
+  }
+
+  double DistinctWords() const {
+    const double m = static_cast<double>(registers_.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (uint8_t reg : registers_) {
+      sum += std::ldexp(1.0, -reg);
+      zeros += (reg == 0);
+    }
+    const double alpha = 0.7213 / (1.0 + 1.079 / m);
+    const double estimate = alpha * m * m / sum;
+    // Linear counting is more accurate while many registers are empty.
+    if (estimate <= 2.5 * m && zeros != 0) {
+      return m * std::log(m / zeros);
+    }
+    return estimate;
+  }
+
+  // Uniform in (0, 1].
+  double UniformOpen() {
+    return ((rng_() >> 11) + 1) * (1.0 / 9007199254740992.0);
+  }
+
+  // Reservoir sampling with geometric skips (Li's algorithm L), so most
+  // occurrences cost a lookup of the sampled words and one comparison.
+  void SampleOccurrence(uint64_t key) {
+    auto it = sampled_words_.find(key);
+    if (it != sampled_words_.end()) {
+      ++it->second.occurrences;
+    }
+    const uint64_t index = total_words_ - 1;
+    const size_t capacity = parameters_.tail_samples;
+    if (samples_.size() < capacity) {
+      samples_.push_back(NewSample(key));
+      if (samples_.size() == capacity) {
+        skip_weight_ = std::exp(std::log(UniformOpen()) / capacity);
+        ScheduleNextSample(index);
+      }
+      return;
+    }
+    if (index == next_sample_) {
+      Sample& sample = samples_[rng_() % capacity];
+      auto old = sampled_words_.find(sample.key);
+      if (--old->second.samples == 0) {
+        sampled_words_.erase(old);
+      }
+      sample = NewSample(key);
+      skip_weight_ *= std::exp(std::log(UniformOpen()) / capacity);
+      ScheduleNextSample(index);
+    }
+  }
+
+  // A sample of the current, already counted, occurrence of 'key'.
+  Sample NewSample(uint64_t key) {
+    SampledWord& word = sampled_words_[key];
+    if (word.samples++ == 0) {
+      word.occurrences = 1;
+    }
+    Sample sample;
+    sample.key = key;
+    sample.offset = word.occurrences - 1;
+    return sample;
+  }
+
+  void ScheduleNextSample(uint64_t index) {
+    const double skip =
+        std::floor(std::log(UniformOpen()) / std::log1p(-skip_weight_));
+    next_sample_ = (skip >= 1e18) ? std::numeric_limits<uint64_t>::max()
+                                  : index + static_cast<uint64_t>(skip) + 1;
+  }
+
+  Parameters parameters_;
+  uint64_t total_words_{0};
+  // Head counts, keyed by the mixed word.
+  SpaceSavingCounts heavy_counts_;
+  // Count-min counters, row by row.
+  std::vector<uint64_t> sketch_;
+  std::vector<uint8_t> registers_;
+  std::vector<Sample> samples_;
+  std::unordered_map<uint64_t, SampledWord> sampled_words_;
+  uint64_t next_sample_{0};
+  double skip_weight_{0.0};
+  std::mt19937_64 rng_;
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_STREAMING_ENTROPY_H_ */
@@ -0,0 +1,218 @@
+/*
+ * symbol_histogram.cpp
+ */
+
+#include "symbol_histogram.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../base/thread_pool.h"
+#include "frame_symbols.h"
+
+using namespace std;
+
+namespace signal_content {
+using base::ThreadPool;
+using base::VFrameView;
+namespace codec {
+
+namespace {
+
+// Frames handed to a worker at a time.
+const size_t kFramesPerWorkItem = 64 * 1024;
+
+// LSD radix sort on 8-bit digits. Passes over a digit that is the same in
+// every symbol are skipped, so narrow symbols take fewer passes.
+void RadixSort(vector<uint32_t>* symbols) {
+  vector<uint32_t> scratch(symbols->size());
+  for (int shift = 0; shift < 32; shift += 8) {
+    size_t counts[256] = {0};
+    for (uint32_t symbol : *symbols) {
+      ++counts[(symbol >> shift) & 0xFF];
+    }
+    if (counts[((*symbols)[0] >> shift) & 0xFF] == symbols->size()) {
+      continue;
+    }
+    size_t offset = 0;
+    for (size_t digit = 0; digit < 256; ++digit) {
+      const size_t count = counts[digit];
+      counts[digit] = offset;
+      offset += count;
+    }
+    for (uint32_t symbol : *symbols) {
+      scratch[counts[(symbol >> shift) & 0xFF]++] = symbol;
+    }
+    symbols->swap(scratch);
+  }
+}
+
+typedef vector<pair<uint32_t, uint64_t>> SortedCounts;
+
+SortedCounts MergeSortedCounts(const SortedCounts& a, const SortedCounts& b) {
+  SortedCounts merged;
+  merged.reserve(a.size() + b.size());
+  size_t i = 0;
+  size_t j = 0;
+  while (i < a.size() || j < b.size()) {
+    if (j == b.size() || (i < a.size() && a[i].first < b[j].first)) {
+      merged.push_back(a[i++]);
+    } else if (i == a.size() || b[j].first < a[i].first) {
+      merged.push_back(b[j++]);
+    } else {
+      merged.push_back(make_pair(a[i].first, a[i].second + b[j].second));
+      ++i;
+      ++j;
+    }
+  }
+  return merged;
+}
+
+struct HistogramAdder {
+  void operator()(const int* symbols, size_t count) {
+    histogram->Add(symbols, count);
+  }
+  SymbolHistogram* histogram;
+};
+
+}  // namespace
+
+SymbolHistogram::SymbolHistogram(size_t symbol_bits)
+    : symbol_bits_(symbol_bits),
+      dense_(symbol_bits <= kMaxDenseSymbolBits),
+      num_lanes_(symbol_bits <= kMaxLanedSymbolBits ? kNumLanes : 1) {
+  if (symbol_bits == 0 || symbol_bits > 32) {
+    throw invalid_argument("Symbol size must be between 1 and 32 bits.");
+  }
+  if (dense_) {
+    dense_counts_.assign(num_lanes_ << symbol_bits_, 0);
+  } else {
+    pending_.reserve(kSparseBatchSize);
+  }
+}
+
+void SymbolHistogram::Add(const int* symbols, size_t count) {
+  total_ += count;
+  if (!dense_) {
+    // Batches grow with the number of distinct symbols, so the linear merge
+    // into sparse_counts_ stays amortized over the batch.
+    const size_t batch_size =
+        max(size_t(kSparseBatchSize), sparse_counts_.size());
+    for (size_t i = 0; i < count; ++i) {
+      pending_.push_back(static_cast<uint32_t>(symbols[i]));
+    }
+    if (pending_.size() >= batch_size) {
+      MergeSparse(&pending_);
+      pending_.clear();
+    }
+    return;
+  }
+
+  // Symbols are in range by construction; mask anyway so a stray value
+  // cannot write outside the table.
+  const uint32_t mask = (uint32_t(1) << symbol_bits_) - 1;
+  uint64_t* const counts = dense_counts_.data();
+  size_t i = 0;
+  if (num_lanes_ == kNumLanes) {
+    uint64_t* const lane1 = counts + (size_t(1) << symbol_bits_);
+    uint64_t* const lane2 = lane1 + (size_t(1) << symbol_bits_);
+    uint64_t* const lane3 = lane2 + (size_t(1) << symbol_bits_);
+    for (; i + 4 <= count; i += 4) {
+      ++counts[symbols[i] & mask];
+      ++lane1[symbols[i + 1] & mask];
+      ++lane2[symbols[i + 2] & mask];
+      ++lane3[symbols[i + 3] & mask];
+    }
+  }
+  for (; i < count; ++i) {
+    ++counts[symbols[i] & mask];
+  }
+}
+
+void SymbolHistogram::MergeSparse(vector<uint32_t>* symbols) {
+  if (symbols->empty()) {
+    return;
+  }
+  RadixSort(symbols);
+  SortedCounts runs;
+  for (size_t i = 0; i < symbols->size();) {
+    size_t end = i + 1;
+    while (end < symbols->size() && (*symbols)[end] == (*symbols)[i]) {
+      ++end;
+    }
+    runs.push_back(make_pair((*symbols)[i], end - i));
+    i = end;
+  }
+
+  sparse_counts_ = MergeSortedCounts(sparse_counts_, runs);
+}
+
+void SymbolHistogram::Merge(const SymbolHistogram& other) {
+  if (other.symbol_bits_ != symbol_bits_) {
+    throw invalid_argument("Histograms must share a symbol size.");
+  }
+  total_ += other.total_;
+  if (dense_) {
+    const size_t num_symbols = size_t(1) << symbol_bits_;
+    for (size_t lane = 0; lane < other.num_lanes_; ++lane) {
+      for (size_t symbol = 0; symbol < num_symbols; ++symbol) {
+        dense_counts_[symbol] +=
+            other.dense_counts_[(lane << symbol_bits_) + symbol];
+      }
+    }
+    return;
+  }
+  vector<uint32_t> pending = other.pending_;
+  MergeSparse(&pending);
+  sparse_counts_ = MergeSortedCounts(sparse_counts_, other.sparse_counts_);
+}
+
+unordered_map<int, size_t> SymbolHistogram::Counts() const {
+  unordered_map<int, size_t> counts;
+  if (dense_) {
+    const size_t num_symbols = size_t(1) << symbol_bits_;
+    for (size_t symbol = 0; symbol < num_symbols; ++symbol) {
+      uint64_t count = 0;
+      for (size_t lane = 0; lane < num_lanes_; ++lane) {
+        count += dense_counts_[(lane << symbol_bits_) + symbol];
+      }
+      if (count != 0) {
+        counts.insert(make_pair(static_cast<int>(symbol), count));
+      }
+    }
+    return counts;
+  }
+  SymbolHistogram flushed(*this);
+  flushed.MergeSparse(&flushed.pending_);
+  for (const auto& p : flushed.sparse_counts_) {
+    counts.insert(make_pair(static_cast<int>(p.first), p.second));
+  }
+  return counts;
+}
+
+SymbolHistogram ComputeSymbolHistogram(const VFrameView& frames,
+                                       size_t symbol_bits,
+                                       size_t num_threads) {
+  const size_t num_items =
+      (frames.num_frames() + kFramesPerWorkItem - 1) / kFramesPerWorkItem;
+  num_threads = ThreadPool::WorkersFor(num_items, num_threads);
+
+  vector<SymbolHistogram> partials(num_threads, SymbolHistogram(symbol_bits));
+  ThreadPool::RunParallel(num_items, num_threads,
+                          [&] (size_t worker, size_t i) {
+    HistogramAdder adder = {&partials[worker]};
+    const size_t first = i * kFramesPerWorkItem;
+    ForEachFrameSymbols(
+        frames.Subview(first, min(kFramesPerWorkItem,
+                                  frames.num_frames() - first)),
+        symbol_bits, &adder);
+  });
+
+  for (size_t t = 1; t < num_threads; ++t) {
+    partials[0].Merge(partials[t]);
+  }
+  return partials[0];
+}
+
+}  // namespace codec
+}  // namespace signal_content
@@ -0,0 +1,77 @@
+/*
+ * symbol_histogram.h
+ *
+ * Symbol frequency counting for entropy coder training. Symbols of up to
+ * kMaxDenseSymbolBits bits are counted in a flat array indexed by symbol.
+ * Wider symbols are buffered, radix sorted and run-length merged into a
+ * sorted list of (symbol, count) pairs, which avoids a hash table probe per
+ * symbol.
+ *
+ * Histograms are mergeable, and ComputeSymbolHistogram counts a frame view
+ * with one histogram per worker thread.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_SYMBOL_HISTOGRAM_H_
+#define SIGNAL_CONTENT_CODEC_SYMBOL_HISTOGRAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../base/frame_view.h"
+
+namespace signal_content {
+namespace codec {
+
+class SymbolHistogram {
+ public:
+  static const size_t kMaxDenseSymbolBits = 16;
+
+  explicit SymbolHistogram(size_t symbol_bits);
+
+  void Add(const int* symbols, size_t count);
+
+  // Adds the counts of a histogram over the same symbol size.
+  void Merge(const SymbolHistogram& other);
+
+  size_t symbol_bits() const { return symbol_bits_; }
+  uint64_t total() const { return total_; }
+
+  // Every symbol with a nonzero count, with its count.
+  std::unordered_map<int, size_t> Counts() const;
+
+ private:
+  // Buffered symbols are sorted and merged into sparse_counts_ in batches of
+  // at least this many.
+  static const size_t kSparseBatchSize = 1 << 16;
+  // Dense symbols of up to this many bits are counted in several interleaved
+  // tables, so that runs of one symbol do not serialize on one counter.
+  static const size_t kMaxLanedSymbolBits = 12;
+  static const size_t kNumLanes = 4;
+
+  // Sorts 'symbols' and merges them into sparse_counts_.
+  void MergeSparse(std::vector<uint32_t>* symbols);
+
+  size_t symbol_bits_;
+  bool dense_;
+  size_t num_lanes_;
+  // Lane-major: the count of symbol s in lane l is at (l << symbol_bits_) + s.
+  std::vector<uint64_t> dense_counts_;
+  std::vector<uint32_t> pending_;
+  // Sorted by symbol.
+  std::vector<std::pair<uint32_t, uint64_t>> sparse_counts_;
+  uint64_t total_{0};
+};
+
+// Counts the symbols of 'frames' using 'num_threads' workers (0 means one per
+// hardware thread).
+SymbolHistogram ComputeSymbolHistogram(const base::VFrameView& frames,
+                                       size_t symbol_bits,
+                                       size_t num_threads);
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_SYMBOL_HISTOGRAM_H_ */
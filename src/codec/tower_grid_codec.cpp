@@ -0,0 +1,485 @@
+/*
+ * tower_grid_codec.cpp
+ */
+
+#include "tower_grid_codec.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "bit_reader.h"
+#include "bit_writer.h"
+
+using namespace std;
+
+namespace signal_content {
+namespace codec {
+
+namespace {
+
+// Contexts 0 to 364 are the quantized gradient triples, folded so that a
+// triple and its negation share one. The two after them code the sample
+// that ends a run, one for a == b and one otherwise.
+const int kRunEndContext = 365;
+const int kNumContexts = 367;
+// Statistics are halved every this many samples of a context, so that they
+// follow the data.
+const int kResetCount = 64;
+const int kMinBiasCorrection = -128;
+const int kMaxBiasCorrection = 127;
+// The number of grids, as a 64-bit big-endian integer.
+const size_t kHeaderBytes = 8;
+
+// Run lengths are coded in blocks of 2^kRunOrder[i] samples, where i rises
+// after every whole block and falls after every run that stops short.
+const int kRunOrder[32] = {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                           4, 4, 5, 5, 6, 6, 7, 7, 8, 9, 10, 11, 12, 13, 14,
+                           15};
+
+inline int MedianEdgePrediction(int a, int b, int c) {
+  const int high = max(a, b);
+  const int low = min(a, b);
+  return (c >= high) ? low : (c <= low) ? high : a + b - c;
+}
+
+// 'value' if it lies in [low, max_value], else 'low', as JPEG-LS bounds its
+// thresholds.
+inline int ClampThreshold(int value, int low, int max_value) {
+  return (value > max_value || value < low) ? low : value;
+}
+
+// Golomb-Rice parameters, bias correction and run state for one channel.
+class ChannelModel {
+ public:
+  explicit ChannelModel(size_t bits)
+      : bits_(static_cast<int>(bits)), max_value_((1 << bits) - 1),
+        range_(1 << bits), limit_(2 * (bits_ + max(8, bits_))),
+        a_(kNumContexts, max(2, (range_ + 32) / 64)), b_(kNumContexts, 0),
+        c_(kNumContexts, 0), n_(kNumContexts, 1) {
+    // The default JPEG-LS gradient thresholds for this range.
+    if (max_value_ >= 128) {
+      const int factor = (min(max_value_, 4095) + 128) / 256;
+      t1_ = ClampThreshold(factor * (3 - 2) + 2, 1, max_value_);
+      t2_ = ClampThreshold(factor * (7 - 3) + 3, t1_, max_value_);
+      t3_ = ClampThreshold(factor * (21 - 4) + 4, t2_, max_value_);
+    } else {
+      const int factor = 256 / (max_value_ + 1);
+      t1_ = ClampThreshold(max(2, 3 / factor), 1, max_value_);
+      t2_ = ClampThreshold(max(3, 7 / factor), t1_, max_value_);
+      t3_ = ClampThreshold(max(4, 21 / factor), t2_, max_value_);
+    }
+  }
+
+  // Quantizes a gradient to [-4, 4] without branches.
+  int Quantize(int g) const {
+    return (g > 0) + (g >= t1_) + (g >= t2_) + (g >= t3_) -
+           (g < 0) - (g <= -t1_) - (g <= -t2_) - (g <= -t3_);
+  }
+
+  void EncodeRegular(int x, int prediction, int context, BitWriter* writer) {
+    const int sign = (context < 0) ? -1 : 1;
+    const int q = sign * context;
+    const int corrected = Corrected(prediction, sign, q);
+    const int error = Reduce(sign * (x - corrected));
+    WriteError(error, q, writer);
+    Update(q, error);
+  }
+
+  int DecodeRegular(int prediction, int context, BitReader* reader) {
+    const int sign = (context < 0) ? -1 : 1;
+    const int q = sign * context;
+    const int corrected = Corrected(prediction, sign, q);
+    const int error = ReadError(q, reader);
+    Update(q, error);
+    return Wrap(corrected + sign * error);
+  }
+
+  // The sample that ends a run is predicted by a if a == b and by b
+  // otherwise.
+  void EncodeRunEnd(int x, int a, int b, BitWriter* writer) {
+    const int q = kRunEndContext + (a == b);
+    const int error = Reduce(x - ((a == b) ? a : b));
+    WriteError(error, q, writer);
+    Update(q, error);
+  }
+
+  int DecodeRunEnd(int a, int b, BitReader* reader) {
+    const int q = kRunEndContext + (a == b);
+    const int error = ReadError(q, reader);
+    Update(q, error);
+    return Wrap(((a == b) ? a : b) + error);
+  }
+
+  // Codes a run of 'length' samples, which either reaches the end of the
+  // row or is followed by a sample that differs.
+  void EncodeRun(size_t length, bool reaches_end, BitWriter* writer) {
+    while (length >= (size_t(1) << kRunOrder[run_index_])) {
+      writer->Write(1, 1);
+      length -= size_t(1) << kRunOrder[run_index_];
+      run_index_ = min(run_index_ + 1, 31);
+    }
+    if (reaches_end) {
+      if (length > 0) {
+        writer->Write(1, 1);
+      }
+      return;
+    }
+    // A zero, then the rest of the length.
+    writer->Write(length, kRunOrder[run_index_] + 1);
+    run_index_ = max(run_index_ - 1, 0);
+  }
+
+  // Returns the length of the run, of at most 'max_length' samples, and
+  // whether a differing sample follows it.
+  size_t DecodeRun(size_t max_length, BitReader* reader, bool* interrupted) {
+    size_t length = 0;
+    while (length < max_length) {
+      if (reader->Read(1) == 0) {
+        const int order = kRunOrder[run_index_];
+        const size_t rest = (order == 0) ? 0 : reader->Read(order);
+        if (length + rest >= max_length) {
+          throw runtime_error("Run overruns the grid row.");
+        }
+        run_index_ = max(run_index_ - 1, 0);
+        *interrupted = true;
+        return length + rest;
+      }
+      const size_t block = size_t(1) << kRunOrder[run_index_];
+      if (block <= max_length - length) {
+        run_index_ = min(run_index_ + 1, 31);
+      }
+      length += min(block, max_length - length);
+    }
+    *interrupted = false;
+    return length;
+  }
+
+ private:
+  int Corrected(int prediction, int sign, int q) const {
+    return min(max(prediction + sign * c_[q], 0), max_value_);
+  }
+
+  // Reduces an error modulo the range to [-range / 2, range / 2).
+  int Reduce(int error) const {
+    if (error < 0) {
+      error += range_;
+    }
+    return (error >= (range_ + 1) / 2) ? error - range_ : error;
+  }
+
+  int Wrap(int x) const {
+    return (x < 0) ? x + range_ : (x > max_value_) ? x - range_ : x;
+  }
+
+  int RiceParameter(int q) const {
+    int k = 0;
+    while ((n_[q] << k) < a_[q]) {
+      ++k;
+    }
+    return k;
+  }
+
+  // Errors map to non-negative integers, interleaving signs in the order
+  // the context's bias makes likelier.
+  bool SwapSigns(int k, int q) const { return k == 0 && 2 * b_[q] <= -n_[q]; }
+
+  void WriteError(int error, int q, BitWriter* writer) const {
+    const int k = RiceParameter(q);
+    uint32_t mapped;
+    if (SwapSigns(k, q)) {
+      mapped = (error >= 0) ? 2 * error + 1 : -2 * (error + 1);
+    } else {
+      mapped = (error >= 0) ? 2 * error : -2 * error - 1;
+    }
+    // Unary quotients are capped; past the cap the value is sent whole.
+    const uint32_t quotient = mapped >> k;
+    if (quotient < static_cast<uint32_t>(limit_ - bits_ - 1)) {
+      writer->Write(1, quotient + 1);
+      if (k != 0) {
+        writer->Write(mapped & ((1u << k) - 1), k);
+      }
+    } else {
+      writer->Write(1, limit_ - bits_);
+      writer->Write(mapped - 1, bits_);
+    }
+  }
+
+  int ReadError(int q, BitReader* reader) const {
+    const int k = RiceParameter(q);
+    const uint64_t quotient = reader->ReadUnary();
+    uint32_t mapped;
+    if (quotient < static_cast<uint64_t>(limit_ - bits_ - 1)) {
+      mapped = static_cast<uint32_t>(quotient << k);
+      if (k != 0) {
+        mapped |= static_cast<uint32_t>(reader->Read(k));
+      }
+    } else if (quotient == static_cast<uint64_t>(limit_ - bits_ - 1)) {
+      mapped = static_cast<uint32_t>(reader->Read(bits_)) + 1;
+    } else {
+      throw runtime_error("Invalid residual code.");
+    }
+    if (mapped >= static_cast<uint32_t>(range_)) {
+      throw runtime_error("Invalid residual code.");
+    }
+    const int m = static_cast<int>(mapped);
+    if (SwapSigns(k, q)) {
+      return (m & 1) ? (m - 1) / 2 : -(m / 2) - 1;
+    }
+    return (m & 1) ? -(m + 1) / 2 : m / 2;
+  }
+
+  void Update(int q, int error) {
+    b_[q] += error;
+    a_[q] += abs(error);
+    if (n_[q] == kResetCount) {
+      a_[q] >>= 1;
+      b_[q] = (b_[q] >= 0) ? b_[q] >> 1 : -((1 - b_[q]) >> 1);
+      n_[q] >>= 1;
+    }
+    ++n_[q];
+    if (b_[q] <= -n_[q]) {
+      b_[q] += n_[q];
+      if (c_[q] > kMinBiasCorrection) {
+        --c_[q];
+      }
+      if (b_[q] <= -n_[q]) {
+        b_[q] = -n_[q] + 1;
+      }
+    } else if (b_[q] > 0) {
+      b_[q] -= n_[q];
+      if (c_[q] < kMaxBiasCorrection) {
+        ++c_[q];
+      }
+      if (b_[q] > 0) {
+        b_[q] = 0;
+      }
+    }
+  }
+
+  int bits_;
+  int max_value_;
+  int range_;
+  // Longest code for one sample, in bits.
+  int limit_;
+  int t1_;
+  int t2_;
+  int t3_;
+  // Per context: sum of absolute errors, sum of errors, bias correction and
+  // sample count.
+  vector<int> a_;
+  vector<int> b_;
+  vector<int> c_;
+  vector<int> n_;
+  int run_index_{0};
+};
+
+// One channel of a grid with a border of zeroes: a row above the first and
+// a column either side, so that every sample has all four neighbours.
+class PaddedPlane {
+ public:
+  PaddedPlane(size_t rows, size_t columns)
+      : width_(columns + 2), values_((rows + 1) * width_, 0) {}
+
+  int* row(size_t r) { return &values_[(r + 1) * width_ + 1]; }
+  size_t width() const { return width_; }
+
+ private:
+  size_t width_;
+  vector<int> values_;
+};
+
+// Predictions and contexts of a row whose samples are all known, computed
+// for the whole row at once.
+void PredictRow(const ChannelModel& model, const int* current,
+                const int* above, size_t columns, int* predictions,
+                int* contexts) {
+  for (size_t c = 0; c < columns; ++c) {
+    const int a = current[c - 1];
+    const int b = above[c];
+    const int cc = above[c - 1];
+    const int d = above[c + 1];
+    predictions[c] = MedianEdgePrediction(a, b, cc);
+    contexts[c] = 81 * model.Quantize(d - b) + 9 * model.Quantize(b - cc) +
+                  model.Quantize(cc - a);
+  }
+}
+
+// The part of each context that depends only on the row above.
+void PredictRowAbove(const ChannelModel& model, const int* above,
+                     size_t columns, int* contexts) {
+  for (size_t c = 0; c < columns; ++c) {
+    contexts[c] = 81 * model.Quantize(above[c + 1] - above[c]) +
+                  9 * model.Quantize(above[c] - above[c - 1]);
+  }
+}
+
+void EncodePlane(PaddedPlane* plane, size_t rows, size_t columns,
+                 ChannelModel* model, BitWriter* writer) {
+  vector<int> predictions(columns);
+  vector<int> contexts(columns);
+  for (size_t r = 0; r < rows; ++r) {
+    const int* current = plane->row(r);
+    const int* above = current - plane->width();
+    PredictRow(*model, current, above, columns, predictions.data(),
+               contexts.data());
+    size_t c = 0;
+    while (c < columns) {
+      if (contexts[c] != 0) {
+        model->EncodeRegular(current[c], predictions[c], contexts[c], writer);
+        ++c;
+        continue;
+      }
+      const int run_value = current[c - 1];
+      size_t length = 0;
+      while (c + length < columns && current[c + length] == run_value) {
+        ++length;
+      }
+      c += length;
+      model->EncodeRun(length, c == columns, writer);
+      if (c < columns) {
+        model->EncodeRunEnd(current[c], current[c - 1], above[c], writer);
+        ++c;
+      }
+    }
+  }
+}
+
+void DecodePlane(PaddedPlane* plane, size_t rows, size_t columns,
+                 ChannelModel* model, BitReader* reader) {
+  vector<int> contexts_above(columns);
+  for (size_t r = 0; r < rows; ++r) {
+    int* current = plane->row(r);
+    const int* above = current - plane->width();
+    PredictRowAbove(*model, above, columns, contexts_above.data());
+    size_t c = 0;
+    while (c < columns) {
+      const int a = current[c - 1];
+      const int context =
+          contexts_above[c] + model->Quantize(above[c - 1] - a);
+      if (context != 0) {
+        current[c] = model->DecodeRegular(
+            MedianEdgePrediction(a, above[c], above[c - 1]), context, reader);
+        ++c;
+        continue;
+      }
+      bool interrupted;
+      const size_t length = model->DecodeRun(columns - c, reader,
+                                             &interrupted);
+      fill(current + c, current + c + length, a);
+      c += length;
+      if (interrupted) {
+        current[c] = model->DecodeRunEnd(a, above[c], reader);
+        ++c;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TowerGridCodec::TowerGridCodec(size_t rows, size_t columns,
+                               const vector<size_t>& channel_bits)
+    : rows_(rows), columns_(columns), channel_bits_(channel_bits) {
+  if (rows == 0 || columns == 0) {
+    throw invalid_argument("Grid must have at least one sample.");
+  }
+  size_t total_bits = 0;
+  for (size_t bits : channel_bits) {
+    if (bits == 0 || bits > 16) {
+      throw invalid_argument("Channels must be between 1 and 16 bits.");
+    }
+    total_bits += bits;
+  }
+  if (channel_bits.empty() || total_bits > 32) {
+    throw invalid_argument("Samples must be between 1 and 32 bits.");
+  }
+}
+
+vector<uint8_t> TowerGridCodec::Encode(const vector<uint32_t>& samples) const {
+  if (samples.size() % grid_size() != 0) {
+    throw invalid_argument("Samples are not a whole number of grids.");
+  }
+  const uint64_t num_grids = samples.size() / grid_size();
+  vector<uint8_t> encoded(kHeaderBytes);
+  for (size_t i = 0; i < kHeaderBytes; ++i) {
+    encoded[i] = static_cast<uint8_t>(num_grids >> (56 - 8 * i));
+  }
+
+  vector<ChannelModel> models;
+  vector<PaddedPlane> planes;
+  size_t max_grid_bits = 0;
+  for (size_t bits : channel_bits_) {
+    models.emplace_back(bits);
+    planes.emplace_back(rows_, columns_);
+    // A sample costs at most 2 * (bits + max(8, bits)) bits, and a run
+    // ending before a sample at most 17 more.
+    max_grid_bits += grid_size() * (2 * (bits + max<size_t>(8, bits)) + 17);
+  }
+  vector<uint8_t> scratch(BitWriter::BytesForBits(max_grid_bits) + 8);
+
+  for (uint64_t grid = 0; grid < num_grids; ++grid) {
+    const uint32_t* words = &samples[grid * grid_size()];
+    BitWriter writer(scratch.data());
+    size_t shift = 0;
+    for (size_t ch = channel_bits_.size(); ch-- > 0;) {
+      const uint32_t mask = (1u << channel_bits_[ch]) - 1;
+      for (size_t r = 0; r < rows_; ++r) {
+        int* row = planes[ch].row(r);
+        for (size_t c = 0; c < columns_; ++c) {
+          row[c] = (words[r * columns_ + c] >> shift) & mask;
+        }
+      }
+      shift += channel_bits_[ch];
+      EncodePlane(&planes[ch], rows_, columns_, &models[ch], &writer);
+    }
+    writer.Flush();
+    encoded.insert(encoded.end(), scratch.begin(),
+                   scratch.begin() +
+                       BitWriter::BytesForBits(writer.bits_written()));
+  }
+  return encoded;
+}
+
+vector<uint32_t> TowerGridCodec::Decode(const vector<uint8_t>& encoded) const {
+  if (encoded.size() < kHeaderBytes) {
+    throw runtime_error("Truncated tower grid header.");
+  }
+  uint64_t num_grids = 0;
+  for (size_t i = 0; i < kHeaderBytes; ++i) {
+    num_grids = (num_grids << 8) | encoded[i];
+  }
+  // Every grid takes at least one byte.
+  const size_t payload_bytes = encoded.size() - kHeaderBytes;
+  if (num_grids > payload_bytes) {
+    throw runtime_error("Tower grid count exceeds the data.");
+  }
+
+  vector<ChannelModel> models;
+  vector<PaddedPlane> planes;
+  for (size_t bits : channel_bits_) {
+    models.emplace_back(bits);
+    planes.emplace_back(rows_, columns_);
+  }
+  vector<uint32_t> samples(num_grids * grid_size(), 0);
+  BitReader reader(encoded.data() + kHeaderBytes, payload_bytes * 8);
+  for (uint64_t grid = 0; grid < num_grids; ++grid) {
+    uint32_t* words = &samples[grid * grid_size()];
+    size_t shift = 0;
+    for (size_t ch = channel_bits_.size(); ch-- > 0;) {
+      DecodePlane(&planes[ch], rows_, columns_, &models[ch], &reader);
+      for (size_t r = 0; r < rows_; ++r) {
+        const int* row = planes[ch].row(r);
+        for (size_t c = 0; c < columns_; ++c) {
+          words[r * columns_ + c] |= static_cast<uint32_t>(row[c]) << shift;
+        }
+      }
+      shift += channel_bits_[ch];
+    }
+    reader.AlignToByte();
+  }
+  return samples;
+}
+
+}  // namespace codec
+}  // namespace signal_content
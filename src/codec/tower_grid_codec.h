@@ -0,0 +1,69 @@
+/*
+ * tower_grid_codec.h
+ *
+ * Lossless coding of a sequence of 2D grids, such as the calorimeter towers
+ * of each cycle, in the manner of JPEG-LS (LOCO-I). Energy deposits cluster,
+ * so a tower is predicted from its already coded neighbours: left (a),
+ * above (b), above-left (c) and above-right (d). The prediction is the
+ * median edge detector
+ *
+ *   min(a, b)     if c >= max(a, b)
+ *   max(a, b)     if c <= min(a, b)
+ *   a + b - c     otherwise,
+ *
+ * which picks the neighbour across an edge and the plane through a, b and c
+ * elsewhere. The residual is coded with a Golomb-Rice code whose parameter
+ * and bias correction adapt per context, where a context is the quantized
+ * gradients d - b, b - c and c - a. Where all three are zero, as over the
+ * empty towers that fill most of a grid, the coder switches to coding the
+ * length of the run of towers equal to a.
+ *
+ * Each sample is a word of independent channels, for towers the fine grain
+ * bit, ECAL and HCAL, and every channel has its own grid and statistics.
+ * Samples outside the grid count as zero. Statistics carry over from one
+ * grid to the next, and each grid is padded to a byte.
+ *
+ * Predictions and contexts for a whole row are computed in one pass of
+ * branch-free loops that the compiler vectorizes; only the adaptive coding
+ * itself goes sample by sample.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_TOWER_GRID_CODEC_H_
+#define SIGNAL_CONTENT_CODEC_TOWER_GRID_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace signal_content {
+namespace codec {
+
+class TowerGridCodec {
+ public:
+  // Grids of 'rows' x 'columns' samples, each made of channels of the given
+  // widths, most significant first, of 1 to 16 bits each. Throws
+  // std::invalid_argument otherwise.
+  TowerGridCodec(size_t rows, size_t columns,
+                 const std::vector<size_t>& channel_bits);
+
+  size_t rows() const { return rows_; }
+  size_t columns() const { return columns_; }
+  size_t grid_size() const { return rows_ * columns_; }
+
+  // Encodes 'samples', which holds whole grids one after another, each in
+  // row-major order. Throws std::invalid_argument if it does not.
+  std::vector<uint8_t> Encode(const std::vector<uint32_t>& samples) const;
+
+  // Throws std::runtime_error if 'encoded' is malformed.
+  std::vector<uint32_t> Decode(const std::vector<uint8_t>& encoded) const;
+
+ private:
+  size_t rows_;
+  size_t columns_;
+  std::vector<size_t> channel_bits_;
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_TOWER_GRID_CODEC_H_ */
@@ -0,0 +1,353 @@
+/*
+ * zero_suppression.cpp
+ */
+
+#include "zero_suppression.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "bit_reader.h"
+#include "bit_writer.h"
+
+using namespace std;
+
+namespace signal_content {
+namespace codec {
+
+namespace {
+
+const size_t kMaxFrameSize = 65536;
+// The number of frames, as a 64-bit big-endian integer.
+const size_t kHeaderBytes = 8;
+// How far past the active samples CompressActive may store.
+const size_t kCompressOverhang = 8;
+
+// Bits in the Elias-gamma code of n > 0.
+inline size_t GammaBits(uint32_t n) {
+  return 2 * (31 - __builtin_clz(n)) + 1;
+}
+
+// Copies the index and value of each active sample among 'num_samples' at
+// 'samples', from sample 'i' on, after the 'count' already at 'indices' and
+// 'values', and returns the new count. Branch-free, so it may store one
+// entry past the last active one.
+inline size_t CompressRest(const uint32_t* samples, size_t num_samples,
+                           size_t i, size_t count, uint16_t* indices,
+                           uint32_t* values) {
+  for (; i < num_samples; ++i) {
+    indices[count] = static_cast<uint16_t>(i);
+    values[count] = samples[i];
+    count += (samples[i] != 0);
+  }
+  return count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// For each mask of active lanes among eight, the lanes in order, as eight
+// 4-bit fields from least significant.
+struct CompressTable {
+  CompressTable() {
+    for (uint32_t mask = 0; mask < 256; ++mask) {
+      uint32_t lanes = 0;
+      int n = 0;
+      for (uint32_t lane = 0; lane < 8; ++lane) {
+        if (mask & (1u << lane)) {
+          lanes |= lane << (4 * n++);
+        }
+      }
+      packed_lanes[mask] = lanes;
+    }
+  }
+  uint32_t packed_lanes[256];
+};
+
+const CompressTable kCompressTable;
+
+// Eight samples at a time, in a version compiled for AVX2 and chosen at
+// runtime, since the default build targets plain x86-64.
+__attribute__((target("avx2"))) size_t CompressActiveAvx2(
+    const uint32_t* samples, size_t num_samples, uint16_t* indices,
+    uint32_t* values) {
+  size_t count = 0;
+  size_t i = 0;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lane_ids = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i field_shifts = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+  for (; i + 8 <= num_samples; i += 8) {
+    const __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+    const uint32_t active = ~static_cast<uint32_t>(_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(x, zero)))) & 0xFF;
+    if (active == 0) {
+      continue;
+    }
+    const __m256i permute = _mm256_and_si256(
+        _mm256_srlv_epi32(
+            _mm256_set1_epi32(kCompressTable.packed_lanes[active]),
+            field_shifts),
+        _mm256_set1_epi32(7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + count),
+                        _mm256_permutevar8x32_epi32(x, permute));
+    // Indices narrow to 16 bits within each half; the two halves are then
+    // joined in the low half.
+    const __m256i lanes = _mm256_add_epi32(
+        _mm256_permutevar8x32_epi32(lane_ids, permute),
+        _mm256_set1_epi32(static_cast<int>(i)));
+    const __m256i narrow = _mm256_permute4x64_epi64(
+        _mm256_packus_epi32(lanes, lanes), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + count),
+                     _mm256_castsi256_si128(narrow));
+    count += __builtin_popcount(active);
+  }
+  return CompressRest(samples, num_samples, i, count, indices, values);
+}
+#endif
+
+size_t CompressActiveGeneric(const uint32_t* samples, size_t num_samples,
+                             uint16_t* indices, uint32_t* values) {
+  size_t count = 0;
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 4 <= num_samples; i += 4) {
+    const __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+    uint32_t active = ~static_cast<uint32_t>(_mm_movemask_ps(
+        _mm_castsi128_ps(_mm_cmpeq_epi32(x, zero)))) & 0xF;
+    while (active != 0) {
+      const size_t lane = __builtin_ctz(active);
+      indices[count] = static_cast<uint16_t>(i + lane);
+      values[count] = samples[i + lane];
+      ++count;
+      active &= active - 1;
+    }
+  }
+#endif
+  return CompressRest(samples, num_samples, i, count, indices, values);
+}
+
+// Copies the index and value of each active sample among 'num_samples' at
+// 'samples' to 'indices' and 'values', and returns how many there were. May
+// store up to kCompressOverhang entries past the last active one.
+size_t CompressActive(const uint32_t* samples, size_t num_samples,
+                      uint16_t* indices, uint32_t* values) {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2) {
+    return CompressActiveAvx2(samples, num_samples, indices, values);
+  }
+#endif
+  return CompressActiveGeneric(samples, num_samples, indices, values);
+}
+
+}  // namespace
+
+SparseFrames::SparseFrames(size_t frame_size)
+    : frame_size_(frame_size), offsets_(1, 0),
+      index_scratch_(frame_size + kCompressOverhang),
+      value_scratch_(frame_size + kCompressOverhang) {
+  if (frame_size == 0 || frame_size > kMaxFrameSize) {
+    throw invalid_argument("Frame size must be between 1 and 65536.");
+  }
+}
+
+void SparseFrames::Append(const uint32_t* samples) {
+  const size_t count = CompressActive(samples, frame_size_,
+                                      index_scratch_.data(),
+                                      value_scratch_.data());
+  indices_.insert(indices_.end(), index_scratch_.begin(),
+                  index_scratch_.begin() + count);
+  values_.insert(values_.end(), value_scratch_.begin(),
+                 value_scratch_.begin() + count);
+  offsets_.push_back(values_.size());
+}
+
+void SparseFrames::AppendActive(const vector<uint16_t>& indices,
+                                const vector<uint32_t>& values) {
+  if (indices.size() != values.size()) {
+    throw invalid_argument("Every active index needs one value.");
+  }
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (indices[i] >= frame_size_ || (i > 0 && indices[i] <= indices[i - 1])) {
+      throw invalid_argument("Active indices must increase within the frame.");
+    }
+    if (values[i] == 0) {
+      throw invalid_argument("Active values must be non-zero.");
+    }
+  }
+  indices_.insert(indices_.end(), indices.begin(), indices.end());
+  values_.insert(values_.end(), values.begin(), values.end());
+  offsets_.push_back(values_.size());
+}
+
+void SparseFrames::Expand(size_t frame, uint32_t* samples) const {
+  fill(samples, samples + frame_size_, 0);
+  ForEachActive(frame, [samples] (uint16_t index, uint32_t value) {
+    samples[index] = value;
+  });
+}
+
+size_t SparseFrames::memory_bytes() const {
+  return offsets_.capacity() * sizeof(size_t) +
+         (indices_.capacity() + index_scratch_.capacity()) * sizeof(uint16_t) +
+         (values_.capacity() + value_scratch_.capacity()) * sizeof(uint32_t);
+}
+
+ZeroSuppressionCodec::ZeroSuppressionCodec(size_t frame_size,
+                                           size_t value_bits)
+    : frame_size_(frame_size), value_bits_(value_bits), count_bits_(1) {
+  if (frame_size == 0 || frame_size > kMaxFrameSize) {
+    throw invalid_argument("Frame size must be between 1 and 65536.");
+  }
+  if (value_bits == 0 || value_bits > 32) {
+    throw invalid_argument("Values must be between 1 and 32 bits.");
+  }
+  while ((size_t(1) << count_bits_) <= frame_size) {
+    ++count_bits_;
+  }
+}
+
+size_t ZeroSuppressionCodec::GapBits(const uint16_t* indices,
+                                     size_t count) const {
+  size_t bits = count_bits_;
+  uint32_t next = 0;
+  for (size_t i = 0; i < count; ++i) {
+    bits += GammaBits(indices[i] - next + 1);
+    next = indices[i] + 1u;
+  }
+  return bits;
+}
+
+vector<uint8_t> ZeroSuppressionCodec::Encode(const SparseFrames& frames) const {
+  if (frames.frame_size() != frame_size_) {
+    throw invalid_argument("Frames have the wrong size.");
+  }
+  const uint32_t value_mask =
+      (value_bits_ == 32) ? ~0u : (1u << value_bits_) - 1;
+  // The exact size first, so that the buffer is allocated once.
+  size_t num_bits = 0;
+  for (size_t f = 0; f < frames.num_frames(); ++f) {
+    const size_t count = frames.NumActive(f);
+    num_bits += 1 +
+        min(frame_size_, GapBits(frames.ActiveIndices(f), count)) +
+        count * value_bits_;
+  }
+  const uint64_t num_frames = frames.num_frames();
+  vector<uint8_t> encoded(kHeaderBytes + BitWriter::BytesForBits(num_bits));
+  for (size_t i = 0; i < kHeaderBytes; ++i) {
+    encoded[i] = static_cast<uint8_t>(num_frames >> (56 - 8 * i));
+  }
+
+  BitWriter writer(encoded.data() + kHeaderBytes);
+  for (size_t f = 0; f < frames.num_frames(); ++f) {
+    const size_t count = frames.NumActive(f);
+    const uint16_t* indices = frames.ActiveIndices(f);
+    const uint32_t* values = frames.ActiveValues(f);
+    if (GapBits(indices, count) < frame_size_) {
+      writer.Write(1, 1);
+      writer.Write(count, count_bits_);
+      uint32_t next = 0;
+      for (size_t i = 0; i < count; ++i) {
+        const uint32_t gap = indices[i] - next + 1;
+        writer.Write(gap, GammaBits(gap));
+        next = indices[i] + 1u;
+      }
+    } else {
+      writer.Write(0, 1);
+      // The bitmap, a word at a time.
+      uint64_t word = 0;
+      size_t word_start = 0;
+      for (size_t i = 0; i < count; ++i) {
+        while (indices[i] >= word_start + 64) {
+          writer.Write(word, 64);
+          word = 0;
+          word_start += 64;
+        }
+        word |= uint64_t(1) << (63 - (indices[i] - word_start));
+      }
+      for (; word_start < frame_size_; word_start += 64) {
+        const size_t n = min(size_t(64), frame_size_ - word_start);
+        writer.Write(word >> (64 - n), n);
+        word = 0;
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      if ((values[i] & ~value_mask) != 0) {
+        throw invalid_argument("Value does not fit in the value width.");
+      }
+      writer.Write(values[i], value_bits_);
+    }
+  }
+  writer.Flush();
+  return encoded;
+}
+
+SparseFrames ZeroSuppressionCodec::Decode(
+    const vector<uint8_t>& encoded) const {
+  if (encoded.size() < kHeaderBytes) {
+    throw runtime_error("Truncated zero suppression header.");
+  }
+  uint64_t num_frames = 0;
+  for (size_t i = 0; i < kHeaderBytes; ++i) {
+    num_frames = (num_frames << 8) | encoded[i];
+  }
+  // Every frame takes at least its flag.
+  const size_t payload_bits = (encoded.size() - kHeaderBytes) * 8;
+  if (num_frames > payload_bits) {
+    throw runtime_error("Frame count exceeds the data.");
+  }
+
+  SparseFrames frames(frame_size_);
+  BitReader reader(encoded.data() + kHeaderBytes, payload_bits);
+  vector<uint16_t> indices;
+  vector<uint32_t> values;
+  for (uint64_t f = 0; f < num_frames; ++f) {
+    indices.clear();
+    if (reader.Read(1) == 1) {
+      const size_t count = reader.Read(count_bits_);
+      uint32_t next = 0;
+      for (size_t i = 0; i < count; ++i) {
+        const uint64_t zeros = reader.ReadUnary();
+        if (zeros > 16) {
+          throw runtime_error("Invalid index gap.");
+        }
+        const uint32_t gap = static_cast<uint32_t>(
+            (uint64_t(1) << zeros) | (zeros ? reader.Read(zeros) : 0));
+        next += gap - 1;
+        if (next >= frame_size_) {
+          throw runtime_error("Active index past the end of the frame.");
+        }
+        indices.push_back(static_cast<uint16_t>(next));
+        ++next;
+      }
+    } else {
+      for (size_t word_start = 0; word_start < frame_size_;
+           word_start += 64) {
+        const size_t n = min(size_t(64), frame_size_ - word_start);
+        uint64_t word = reader.Read(n) << (64 - n);
+        while (word != 0) {
+          const size_t bit = __builtin_clzll(word);
+          indices.push_back(static_cast<uint16_t>(word_start + bit));
+          word &= ~(uint64_t(1) << (63 - bit));
+        }
+      }
+    }
+    values.resize(indices.size());
+    for (uint32_t& value : values) {
+      value = static_cast<uint32_t>(reader.Read(value_bits_));
+      if (value == 0) {
+        throw runtime_error("Active value is zero.");
+      }
+    }
+    frames.AppendActive(indices, values);
+  }
+  return frames;
+}
+
+}  // namespace codec
+}  // namespace signal_content
@@ -0,0 +1,109 @@
+/*
+ * zero_suppression.h
+ *
+ * Zero-suppressed frames, such as the towers of each cycle, most of which
+ * read zero. SparseFrames keeps only the active (non-zero) samples of each
+ * frame, as a list of indices and a list of values, so that analyses can
+ * visit the active samples alone, and ZeroSuppressionCodec packs them into a
+ * stream of bits.
+ *
+ * In the stream, each frame is a one-bit flag and then either a bitmap of
+ * its active samples or their count and the gaps between them, Elias-gamma
+ * coded, whichever is shorter; then the values, packed at a fixed width.
+ *
+ * Frames are scanned for active samples with a vector compare. On CPUs with
+ * AVX2, detected at runtime, the active values and indices of eight samples
+ * are also compressed into place with one permute each; otherwise they are
+ * copied from the compare mask a bit at a time.
+ */
+
+#ifndef SIGNAL_CONTENT_CODEC_ZERO_SUPPRESSION_H_
+#define SIGNAL_CONTENT_CODEC_ZERO_SUPPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace signal_content {
+namespace codec {
+
+class SparseFrames {
+ public:
+  // Frames of 'frame_size' samples, which must be between 1 and 65536.
+  // Throws std::invalid_argument otherwise.
+  explicit SparseFrames(size_t frame_size);
+
+  size_t frame_size() const { return frame_size_; }
+  size_t num_frames() const { return offsets_.size() - 1; }
+  // Active samples in all frames.
+  size_t num_active() const { return values_.size(); }
+
+  // Appends the frame of frame_size() samples at 'samples'.
+  void Append(const uint32_t* samples);
+  // Appends a frame given by its active samples, in increasing index order.
+  void AppendActive(const std::vector<uint16_t>& indices,
+                    const std::vector<uint32_t>& values);
+
+  // The active samples of 'frame', in index order.
+  size_t NumActive(size_t frame) const {
+    return offsets_[frame + 1] - offsets_[frame];
+  }
+  const uint16_t* ActiveIndices(size_t frame) const {
+    return indices_.data() + offsets_[frame];
+  }
+  const uint32_t* ActiveValues(size_t frame) const {
+    return values_.data() + offsets_[frame];
+  }
+
+  // Calls fn(index, value) for every active sample of 'frame'.
+  template <typename Fn>
+  void ForEachActive(size_t frame, Fn fn) const {
+    for (size_t i = offsets_[frame]; i < offsets_[frame + 1]; ++i) {
+      fn(indices_[i], values_[i]);
+    }
+  }
+
+  // Writes the frame_size() samples of 'frame', zeroes included, to
+  // 'samples'.
+  void Expand(size_t frame, uint32_t* samples) const;
+
+  size_t memory_bytes() const;
+
+ private:
+  size_t frame_size_;
+  // Frame f's active samples are [offsets_[f], offsets_[f + 1]).
+  std::vector<size_t> offsets_;
+  std::vector<uint16_t> indices_;
+  std::vector<uint32_t> values_;
+  // Room for one frame, and the overhang of the vector stores, for Append.
+  std::vector<uint16_t> index_scratch_;
+  std::vector<uint32_t> value_scratch_;
+};
+
+class ZeroSuppressionCodec {
+ public:
+  // Frames of 'frame_size' samples of 'value_bits' bits, between 1 and 32.
+  // Throws std::invalid_argument otherwise.
+  ZeroSuppressionCodec(size_t frame_size, size_t value_bits);
+
+  // Throws std::invalid_argument if 'frames' has another frame size or a
+  // value does not fit in value_bits.
+  std::vector<uint8_t> Encode(const SparseFrames& frames) const;
+
+  // Throws std::runtime_error if 'encoded' is malformed.
+  SparseFrames Decode(const std::vector<uint8_t>& encoded) const;
+
+ private:
+  // Bits to code a frame's active indices as their count and gaps.
+  size_t GapBits(const uint16_t* indices, size_t count) const;
+
+  size_t frame_size_;
+  size_t value_bits_;
+  // Width of an active count, 0 to frame_size_.
+  size_t count_bits_;
+};
+
+}  // namespace codec
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_CODEC_ZERO_SUPPRESSION_H_ */
@@ -0,0 +1,56 @@
+/*
+ * bit_string_parser.cpp
+ */
+
+#include "bit_string_parser.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace signal_content {
+namespace parser {
+
+base::PackedFv ParseBitStringFile(const string& filename) {
+  ifstream file(filename, ios::binary);
+  if (!file.is_open()) {
+    throw runtime_error("Could not open bit string file " + filename);
+  }
+
+  base::PackedFv bits;
+  vector<char> buffer(1 << 20);
+  base::PackedFv::Word value = 0;
+  base::PackedFv::Word unknown = 0;
+  size_t pending = 0;
+  while (file) {
+    file.read(buffer.data(), buffer.size());
+    const streamsize count = file.gcount();
+    for (streamsize i = 0; i < count; ++i) {
+      const char c = buffer[i];
+      int encoding;
+      switch (c) {
+        case '0': encoding = 0; break;
+        case '1': encoding = 1; break;
+        case 'x': case 'X': encoding = 2; break;
+        case 'z': case 'Z': encoding = 3; break;
+        case ' ': case '\t': case '\n': case '\r': continue;
+        default:
+          throw runtime_error("Unexpected character in bit string file " +
+                              filename);
+      }
+      value = (value << 1) | (encoding & 0x1);
+      unknown = (unknown << 1) | (encoding >> 1);
+      if (++pending == base::PackedFv::kBitsPerWord) {
+        bits.PushBits(value, unknown, pending);
+        value = unknown = pending = 0;
+      }
+    }
+  }
+  bits.PushBits(value, unknown, pending);
+  return bits;
+}
+
+}  // namespace parser
+}  // namespace signal_content
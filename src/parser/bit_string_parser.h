@@ -0,0 +1,26 @@
+/*
+ * bit_string_parser.h
+ *
+ * Reader for text files holding a stream of four-value logic as characters,
+ * such as the memory_image_*.txt files written by generate_epims. '0', '1',
+ * 'x'/'X' and 'z'/'Z' are values; whitespace is ignored.
+ */
+
+#ifndef SIGNAL_CONTENT_PARSER_BIT_STRING_PARSER_H_
+#define SIGNAL_CONTENT_PARSER_BIT_STRING_PARSER_H_
+
+#include <string>
+
+#include "../base/packed_fv.h"
+
+namespace signal_content {
+namespace parser {
+
+// Throws std::runtime_error if the file cannot be read or holds any other
+// character.
+base::PackedFv ParseBitStringFile(const std::string& filename);
+
+}  // namespace parser
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_PARSER_BIT_STRING_PARSER_H_ */
@@ -0,0 +1,83 @@
+/*
+ * tower_parser.cpp
+ */
+
+#include "tower_parser.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace signal_content {
+namespace parser {
+
+namespace {
+
+int HexDigitValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+}  // namespace
+
+TowerGrid ParseTowerFile(const string& filename) {
+  ifstream file(filename);
+  if (!file.is_open()) {
+    throw runtime_error("Could not open tower file " + filename);
+  }
+  TowerGrid grid;
+  file >> grid.x_dim >> grid.y_dim;
+  if (!file || grid.x_dim == 0 || grid.y_dim == 0) {
+    throw runtime_error("Missing tower grid dimensions in " + filename);
+  }
+
+  // Slurp the rest of the file; line-by-line stream extraction dominates the
+  // runtime on large grids.
+  stringstream contents;
+  contents << file.rdbuf();
+  const string text = contents.str();
+
+  grid.words.reserve(text.size() / 6 * kTowerWordBits);
+  size_t num_words = 0;
+  uint32_t word = 0;
+  int digits = 0;
+  for (char c : text) {
+    if (c == '\n' || c == '\r') {
+      if (digits == 5) {
+        grid.words.PushBits(word, kTowerWordBits);
+        ++num_words;
+      } else if (digits != 0) {
+        throw runtime_error("Malformed tower word in " + filename);
+      }
+      word = 0;
+      digits = 0;
+      continue;
+    }
+    const int value = HexDigitValue(c);
+    if (value < 0 || digits == 5 || (digits == 0 && value > 1)) {
+      throw runtime_error("Malformed tower word in " + filename);
+    }
+    word = (word << 4) | value;
+    ++digits;
+  }
+  if (digits == 5) {
+    grid.words.PushBits(word, kTowerWordBits);
+    ++num_words;
+  } else if (digits != 0) {
+    throw runtime_error("Malformed tower word in " + filename);
+  }
+
+  if (num_words % grid.num_towers() != 0) {
+    throw runtime_error("Tower count is not a multiple of the grid size in " +
+                        filename);
+  }
+  grid.num_cycles = num_words / grid.num_towers();
+  return grid;
+}
+
+}  // namespace parser
+}  // namespace signal_content
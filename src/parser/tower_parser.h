@@ -0,0 +1,62 @@
+/*
+ * tower_parser.h
+ *
+ * Reader for the calorimeter tower files written by generate_rct_tower_inputs
+ * (towers_<X>x<Y>.txt).
+ *
+ * The file starts with X_DIM and Y_DIM on their own lines. Then, for each
+ * tower in x-major order, there is one line per cycle of five hex digits: the
+ * fine grain bit, the ECAL byte and the HCAL byte. Each line is stored as a
+ * 17-bit tower word, fg:ecal:hcal, most significant bit first.
+ */
+
+#ifndef SIGNAL_CONTENT_PARSER_TOWER_PARSER_H_
+#define SIGNAL_CONTENT_PARSER_TOWER_PARSER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "../base/frame_view.h"
+#include "../base/packed_fv.h"
+
+namespace signal_content {
+namespace parser {
+
+static const size_t kTowerWordBits = 17;
+
+inline unsigned int TowerFineGrain(uint32_t word) { return (word >> 16) & 0x1; }
+inline unsigned int TowerEcal(uint32_t word) { return (word >> 8) & 0xFF; }
+inline unsigned int TowerHcal(uint32_t word) { return word & 0xFF; }
+
+struct TowerGrid {
+  size_t x_dim{0};
+  size_t y_dim{0};
+  size_t num_cycles{0};
+
+  // Tower words in file order: every cycle of tower (0, 0), then (0, 1), ...
+  base::PackedFv words;
+
+  size_t num_towers() const { return x_dim * y_dim; }
+  size_t TowerIndex(size_t x, size_t y) const { return x * y_dim + y; }
+
+  // The cycles of one tower as 17-bit frames.
+  base::VFrameView TowerStream(size_t tower_index) const {
+    return base::VFrameView(words, kTowerWordBits,
+                            tower_index * num_cycles * kTowerWordBits,
+                            kTowerWordBits, num_cycles);
+  }
+
+  uint32_t Word(size_t tower_index, size_t cycle) const {
+    return static_cast<uint32_t>(words.PeekBits(
+        (tower_index * num_cycles + cycle) * kTowerWordBits, kTowerWordBits));
+  }
+};
+
+// Throws std::runtime_error if the file cannot be read or is malformed.
+TowerGrid ParseTowerFile(const std::string& filename);
+
+}  // namespace parser
+}  // namespace signal_content
+
+#endif /* SIGNAL_CONTENT_PARSER_TOWER_PARSER_H_ */
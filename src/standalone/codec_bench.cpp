@@ -0,0 +1,776 @@
+/*
+ * codec_bench.cpp
+ *
+ * Benchmarks every codec over a fixed set of corpora and writes one CSV row
+ * per (corpus, codec) pair, so that runs can be compared across commits:
+ *
+ *   label,corpus,codec,raw_bytes,encoded_bytes,ratio,entropy_bytes,
+ *   excess_pct,train_mbps,encode_mbps,decode_mbps,peak_mem_kb,roundtrip
+ *
+ * entropy_bytes is the order-0 Shannon entropy of the corpus at its symbol
+ * size, and excess_pct how far the encoding is above it. Throughputs are in
+ * megabytes of raw input per second, best of --repeat runs; train_mbps is
+ * empty for codecs that need no training. peak_mem_kb is the growth of the
+ * peak resident set while the codec trains, encodes and decodes, measured
+ * through /proc; it is -1 where that is unavailable.
+ *
+ * Corpora are the tower files in --corpus-dir, generated epim memory images,
+ * a slowly varying synthetic bus and synthetic skewed byte streams with fixed
+ * seeds. The towers and the bus also appear as frame-to-frame residuals
+ * (see codec/frame_transform.h), named <corpus>_<transform>. tower_grid and
+ * zero_suppression, which code the towers cycle by cycle, and
+ * fixed_frame_huffman, which codes the fields of tower words, have no rows
+ * for the other corpora.
+ *
+ * Usage:
+ *   codec_bench [--corpus-dir <dir>] [--label <text>] [--out <file.csv>]
+ *               [--repeat <n>]
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <malloc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../base/frame_view.h"
+#include "../base/packed_fv.h"
+#include "../codec/bit_writer.h"
+#include "../codec/context_mixing.h"
+#include "../codec/fixed_frame_huffman.h"
+#include "../codec/frame_transform.h"
+#include "../codec/huffman.h"
+#include "../codec/lzw.h"
+#include "../codec/rans.h"
+#include "../codec/run_length.h"
+#include "../codec/symbol_histogram.h"
+#include "../codec/tower_grid_codec.h"
+#include "../codec/zero_suppression.h"
+#include "../parser/tower_parser.h"
+
+using namespace std;
+using namespace signal_content;
+using base::PackedFv;
+using base::VFrameView;
+using codec::FrameTransform;
+
+namespace {
+
+struct Corpus {
+  string name;
+  PackedFv bits;
+  // Symbol size for the symbol-wise codecs and for the entropy bound. The
+  // corpus is a whole number of symbols.
+  size_t symbol_bits;
+  // For corpora of 2D grids, such as towers, the grid dimensions; zero
+  // otherwise. Grid corpora hold every cycle of one grid position, then
+  // every cycle of the next, in row-major order.
+  size_t grid_rows;
+  size_t grid_columns;
+};
+
+// A codec under test. Train, Encode and Decode are timed separately and may
+// each run several times; Verify checks the last decode against the input.
+class BenchCodec {
+ public:
+  virtual ~BenchCodec() {}
+  virtual string name() const = 0;
+  // False for codecs that adapt as they go and have nothing to train.
+  virtual bool trains() const { return true; }
+  // False for corpora the codec cannot code, which are skipped.
+  virtual bool Supports(const Corpus&) const { return true; }
+  virtual void Train(const Corpus& corpus) = 0;
+  // Returns the size of the encoding in bits.
+  virtual size_t Encode(const Corpus& corpus) = 0;
+  virtual void Decode() = 0;
+  virtual bool Verify(const Corpus& corpus) const = 0;
+};
+
+bool SameBits(const PackedFv& a, const PackedFv& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t pos = 0; pos < a.size(); pos += 64) {
+    const size_t n = min(size_t(64), a.size() - pos);
+    if (a.PeekBits(pos, n) != b.PeekBits(pos, n)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The symbols of 'corpus' in order.
+vector<int> CorpusSymbols(const Corpus& corpus) {
+  vector<int> symbols;
+  symbols.reserve(corpus.bits.size() / corpus.symbol_bits);
+  for (size_t pos = 0; pos < corpus.bits.size(); pos += corpus.symbol_bits) {
+    symbols.push_back(
+        static_cast<int>(corpus.bits.PeekBits(pos, corpus.symbol_bits)));
+  }
+  return symbols;
+}
+
+class HuffmanBench : public BenchCodec {
+ public:
+  string name() const override { return "huffman"; }
+  void Train(const Corpus& corpus) override {
+    codec_.reset(new codec::HuffmanCodec(
+        corpus.bits, corpus.symbol_bits, corpus.symbol_bits));
+  }
+  size_t Encode(const Corpus& corpus) override {
+    const VFrameView frames(corpus.bits, corpus.symbol_bits);
+    encoded_.assign(
+        codec::BitWriter::BytesForBits(codec_->EncodedBits(frames)), 0);
+    encoded_bits_ = codec_->Encode(frames, encoded_.data());
+    return encoded_bits_;
+  }
+  void Decode() override {
+    decoded_ = codec_->Decode(encoded_.data(), encoded_bits_);
+  }
+  bool Verify(const Corpus& corpus) const override {
+    return decoded_ == CorpusSymbols(corpus);
+  }
+
+ private:
+  unique_ptr<codec::HuffmanCodec> codec_;
+  vector<uint8_t> encoded_;
+  size_t encoded_bits_{0};
+  vector<int> decoded_;
+};
+
+class RansBench : public BenchCodec {
+ public:
+  string name() const override { return "rans"; }
+  void Train(const Corpus& corpus) override {
+    codec_.reset(new codec::RansCodec(
+        corpus.bits, corpus.symbol_bits, corpus.symbol_bits));
+  }
+  size_t Encode(const Corpus& corpus) override {
+    encoded_ = codec_->Encode(VFrameView(corpus.bits, corpus.symbol_bits));
+    return encoded_.size() * 8;
+  }
+  void Decode() override { decoded_ = codec_->Decode(encoded_); }
+  bool Verify(const Corpus& corpus) const override {
+    return decoded_ == CorpusSymbols(corpus);
+  }
+
+ private:
+  unique_ptr<codec::RansCodec> codec_;
+  vector<uint8_t> encoded_;
+  vector<int> decoded_;
+};
+
+// A separate code for the fine grain bit and ECAL byte and for the HCAL byte
+// of a tower word, with the layout fixed at compile time.
+class FixedFrameHuffmanBench : public BenchCodec {
+ public:
+  typedef codec::FixedFrameHuffmanCodec<parser::kTowerWordBits,
+                                        codec::TowerWordLayout> Codec;
+
+  string name() const override { return "fixed_frame_huffman"; }
+  bool Supports(const Corpus& corpus) const override {
+    return corpus.symbol_bits == parser::kTowerWordBits;
+  }
+  void Train(const Corpus& corpus) override {
+    codec_.reset(
+        new Codec(base::FrameView<parser::kTowerWordBits>(corpus.bits)));
+  }
+  size_t Encode(const Corpus& corpus) override {
+    const base::FrameView<parser::kTowerWordBits> frames(corpus.bits);
+    encoded_.assign(
+        codec::BitWriter::BytesForBits(codec_->EncodedBits(frames)), 0);
+    encoded_bits_ = codec_->Encode(frames, encoded_.data());
+    num_frames_ = frames.num_frames();
+    return encoded_bits_;
+  }
+  void Decode() override {
+    decoded_ = codec_->Decode(encoded_.data(), encoded_bits_, num_frames_);
+  }
+  bool Verify(const Corpus& corpus) const override {
+    const vector<int> words = CorpusSymbols(corpus);
+    if (decoded_.size() != words.size() * Codec::kNumFields) {
+      return false;
+    }
+    for (size_t i = 0; i < words.size(); ++i) {
+      const uint32_t word = words[i];
+      if (decoded_[2 * i] != static_cast<int>(word >> 8) ||
+          decoded_[2 * i + 1] != static_cast<int>(parser::TowerHcal(word))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  unique_ptr<Codec> codec_;
+  vector<uint8_t> encoded_;
+  size_t encoded_bits_{0};
+  size_t num_frames_{0};
+  vector<int> decoded_;
+};
+
+// The dictionary is trained on the corpus and codes are 12 bits.
+class LzwBench : public BenchCodec {
+ public:
+  string name() const override { return "lzw"; }
+  void Train(const Corpus& corpus) override {
+    codec_.reset(new codec::LzwCodec());
+    codec_->PopulateDictionary(corpus.bits);
+  }
+  size_t Encode(const Corpus& corpus) override {
+    encoded_ = codec_->Encode(corpus.bits);
+    return encoded_.size() * 12;
+  }
+  void Decode() override { decoded_ = codec_->Decode(encoded_); }
+  bool Verify(const Corpus& corpus) const override {
+    // Decoding yields whole bytes, so the last one may be padded.
+    if (decoded_.size() < corpus.bits.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < corpus.bits.size(); ++i) {
+      if (decoded_[i] != (corpus.bits.PeekBits(i, 1) != 0)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  unique_ptr<codec::LzwCodec> codec_;
+  vector<int> encoded_;
+  vector<bool> decoded_;
+};
+
+// Single-pass LZW needs no training.
+class LzwStreamBench : public BenchCodec {
+ public:
+  string name() const override { return "lzw_stream"; }
+  bool trains() const override { return false; }
+  void Train(const Corpus&) override {}
+  size_t Encode(const Corpus& corpus) override {
+    codec::LzwStreamEncoder<> encoder;
+    encoder.Push(corpus.bits);
+    encoder.Finish();
+    encoded_.clear();
+    encoder.TakeOutput(&encoded_);
+    return encoded_.size() * 8;
+  }
+  void Decode() override {
+    codec::LzwStreamDecoder<> decoder;
+    decoded_.clear();
+    decoder.Decode(encoded_.data(), encoded_.size(), &decoded_);
+  }
+  bool Verify(const Corpus& corpus) const override {
+    PackedFv bits;
+    for (uint32_t symbol : decoded_) {
+      bits.PushBits(symbol, 8);
+    }
+    // The last symbol is zero-padded.
+    if (bits.size() < corpus.bits.size() ||
+        bits.size() - corpus.bits.size() >= 8) {
+      return false;
+    }
+    for (size_t pos = 0; pos < corpus.bits.size(); pos += 64) {
+      const size_t n = min(size_t(64), corpus.bits.size() - pos);
+      if (bits.PeekBits(pos, n) != corpus.bits.PeekBits(pos, n)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  vector<uint8_t> encoded_;
+  vector<uint32_t> decoded_;
+};
+
+class RunLengthBench : public BenchCodec {
+ public:
+  string name() const override { return "run_length"; }
+  void Train(const Corpus& corpus) override {
+    codec_.reset(new codec::RunLengthCodec(corpus.bits));
+  }
+  size_t Encode(const Corpus& corpus) override {
+    encoded_.assign(
+        codec::BitWriter::BytesForBits(codec_->EncodedBits(corpus.bits)), 0);
+    encoded_bits_ = codec_->Encode(corpus.bits, encoded_.data());
+    return encoded_bits_;
+  }
+  void Decode() override {
+    decoded_ = codec::RunLengthCodec::Decode(encoded_.data(), encoded_bits_);
+  }
+  bool Verify(const Corpus& corpus) const override {
+    return SameBits(decoded_, corpus.bits);
+  }
+
+ private:
+  unique_ptr<codec::RunLengthCodec> codec_;
+  vector<uint8_t> encoded_;
+  size_t encoded_bits_{0};
+  PackedFv decoded_;
+};
+
+// The words of a grid corpus cycle by cycle: every grid position of the
+// first cycle, in row-major order, then of the next.
+vector<uint32_t> GridSamples(const Corpus& corpus) {
+  const size_t num_positions = corpus.grid_rows * corpus.grid_columns;
+  const size_t num_cycles =
+      corpus.bits.size() / corpus.symbol_bits / num_positions;
+  vector<uint32_t> samples(num_cycles * num_positions);
+  for (size_t position = 0; position < num_positions; ++position) {
+    for (size_t cycle = 0; cycle < num_cycles; ++cycle) {
+      samples[cycle * num_positions + position] =
+          static_cast<uint32_t>(corpus.bits.PeekBits(
+              (position * num_cycles + cycle) * corpus.symbol_bits,
+              corpus.symbol_bits));
+    }
+  }
+  return samples;
+}
+
+// Adapts as it goes, with frames of the corpus's symbol size.
+class ContextMixingBench : public BenchCodec {
+ public:
+  string name() const override { return "context_mixing"; }
+  bool trains() const override { return false; }
+  void Train(const Corpus& corpus) override {
+    codec_.reset(new codec::ContextMixingCodec(corpus.symbol_bits));
+  }
+  size_t Encode(const Corpus& corpus) override {
+    encoded_ = codec_->Encode(corpus.bits);
+    return encoded_.size() * 8;
+  }
+  void Decode() override { decoded_ = codec_->Decode(encoded_); }
+  bool Verify(const Corpus& corpus) const override {
+    return SameBits(decoded_, corpus.bits);
+  }
+
+ private:
+  unique_ptr<codec::ContextMixingCodec> codec_;
+  vector<uint8_t> encoded_;
+  PackedFv decoded_;
+};
+
+// The same coder over independent blocks of about kBlockBits bits, coded on
+// every hardware thread.
+class ContextMixingBlocksBench : public BenchCodec {
+ public:
+  static const size_t kBlockBits = size_t(1) << 20;
+
+  string name() const override { return "context_mixing_blocks"; }
+  bool trains() const override { return false; }
+  void Train(const Corpus& corpus) override {
+    codec_.reset(new codec::ContextMixingCodec(corpus.symbol_bits));
+  }
+  size_t Encode(const Corpus& corpus) override {
+    const size_t frames_per_block =
+        max(size_t(1), size_t(kBlockBits) / corpus.symbol_bits);
+    encoded_ = codec_->EncodeBlocks(corpus.bits, frames_per_block);
+    return encoded_.TotalBytes() * 8;
+  }
+  void Decode() override { decoded_ = codec_->DecodeBlocks(encoded_); }
+  bool Verify(const Corpus& corpus) const override {
+    return SameBits(decoded_, corpus.bits);
+  }
+
+ private:
+  unique_ptr<codec::ContextMixingCodec> codec_;
+  codec::ContextMixingBlocks encoded_;
+  PackedFv decoded_;
+};
+
+// Codes tower grids cycle by cycle, so Train reorders the words into whole
+// grids, untimed as training.
+class TowerGridBench : public BenchCodec {
+ public:
+  string name() const override { return "tower_grid"; }
+  bool trains() const override { return false; }
+  bool Supports(const Corpus& corpus) const override {
+    return corpus.grid_rows != 0 &&
+           corpus.symbol_bits == parser::kTowerWordBits;
+  }
+  void Train(const Corpus& corpus) override {
+    codec_.reset(new codec::TowerGridCodec(
+        corpus.grid_rows, corpus.grid_columns, {1, 8, 8}));
+    samples_ = GridSamples(corpus);
+  }
+  size_t Encode(const Corpus&) override {
+    encoded_ = codec_->Encode(samples_);
+    return encoded_.size() * 8;
+  }
+  void Decode() override { decoded_ = codec_->Decode(encoded_); }
+  bool Verify(const Corpus&) const override { return decoded_ == samples_; }
+
+ private:
+  unique_ptr<codec::TowerGridCodec> codec_;
+  vector<uint32_t> samples_;
+  vector<uint8_t> encoded_;
+  vector<uint32_t> decoded_;
+};
+
+// Zero-suppresses each cycle of a grid corpus. Encode includes the scan for
+// active towers; Verify expands the decoded frames.
+class ZeroSuppressionBench : public BenchCodec {
+ public:
+  string name() const override { return "zero_suppression"; }
+  bool trains() const override { return false; }
+  bool Supports(const Corpus& corpus) const override {
+    return corpus.grid_rows != 0;
+  }
+  void Train(const Corpus& corpus) override {
+    frame_size_ = corpus.grid_rows * corpus.grid_columns;
+    codec_.reset(
+        new codec::ZeroSuppressionCodec(frame_size_, corpus.symbol_bits));
+    samples_ = GridSamples(corpus);
+  }
+  size_t Encode(const Corpus&) override {
+    codec::SparseFrames frames(frame_size_);
+    for (size_t pos = 0; pos < samples_.size(); pos += frame_size_) {
+      frames.Append(&samples_[pos]);
+    }
+    encoded_ = codec_->Encode(frames);
+    return encoded_.size() * 8;
+  }
+  void Decode() override {
+    decoded_.reset(new codec::SparseFrames(codec_->Decode(encoded_)));
+  }
+  bool Verify(const Corpus&) const override {
+    if (decoded_->num_frames() * frame_size_ != samples_.size()) {
+      return false;
+    }
+    vector<uint32_t> frame(frame_size_);
+    for (size_t f = 0; f < decoded_->num_frames(); ++f) {
+      decoded_->Expand(f, frame.data());
+      if (!equal(frame.begin(), frame.end(),
+                 samples_.begin() + f * frame_size_)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  size_t frame_size_{0};
+  unique_ptr<codec::ZeroSuppressionCodec> codec_;
+  vector<uint32_t> samples_;
+  vector<uint8_t> encoded_;
+  unique_ptr<codec::SparseFrames> decoded_;
+};
+
+// New codecs are benchmarked by adding them here.
+vector<unique_ptr<BenchCodec>> MakeCodecs() {
+  vector<unique_ptr<BenchCodec>> codecs;
+  codecs.emplace_back(new HuffmanBench());
+  codecs.emplace_back(new FixedFrameHuffmanBench());
+  codecs.emplace_back(new RansBench());
+  codecs.emplace_back(new LzwBench());
+  codecs.emplace_back(new LzwStreamBench());
+  codecs.emplace_back(new RunLengthBench());
+  codecs.emplace_back(new ContextMixingBench());
+  codecs.emplace_back(new ContextMixingBlocksBench());
+  codecs.emplace_back(new TowerGridBench());
+  codecs.emplace_back(new ZeroSuppressionBench());
+  return codecs;
+}
+
+// A ratio-threshold memory image as generate_epims makes them: with ECAL in
+// the low 'cal_bits' address bits and HCAL above, an address is set when
+// ECAL / (ECAL + HCAL) exceeds one half and neither value is vetoed.
+PackedFv EpimImage(int cal_bits, size_t num_vetoes, uint32_t seed) {
+  mt19937 rng(seed);
+  const int cal_values = 1 << cal_bits;
+  set<int> ecal_vetoes;
+  set<int> ecalhcal_vetoes;
+  for (size_t i = 0; i < num_vetoes; ++i) {
+    if (i % 2 == 0) {
+      ecal_vetoes.insert(rng() % cal_values);
+    } else {
+      ecalhcal_vetoes.insert(rng() % (cal_values * cal_values));
+    }
+  }
+  PackedFv image;
+  image.reserve(size_t(cal_values) * cal_values);
+  for (int i = 0; i < cal_values * cal_values; ++i) {
+    const int ecal = i & (cal_values - 1);
+    const int hcal = i >> cal_bits;
+    const bool ratio_pass = ecal > hcal;
+    const bool veto = ecal_vetoes.count(ecal) != 0 ||
+                      ecalhcal_vetoes.count(i) != 0;
+    image.PushBits(ratio_pass && !veto, 1);
+  }
+  return image;
+}
+
+// Bytes drawn from a geometric distribution, so that byte k has probability
+// proportional to (1 - p)^k.
+PackedFv GeometricBytes(size_t num_bytes, double p, uint32_t seed) {
+  mt19937 rng(seed);
+  geometric_distribution<int> distribution(p);
+  PackedFv bits;
+  bits.reserve(num_bytes * 8);
+  for (size_t i = 0; i < num_bytes; ++i) {
+    bits.PushBits(min(distribution(rng), 255), 8);
+  }
+  return bits;
+}
+
+PackedFv UniformBytes(size_t num_bytes, uint32_t seed) {
+  mt19937 rng(seed);
+  PackedFv bits;
+  bits.reserve(num_bytes * 8);
+  for (size_t i = 0; i < num_bytes; ++i) {
+    bits.PushBits(rng() & 0xFF, 8);
+  }
+  return bits;
+}
+
+// 32-bit bus values that take small random steps, as a counter or a slowly
+// drifting measurement would.
+PackedFv RandomWalkBus(size_t num_frames, uint32_t seed) {
+  mt19937 rng(seed);
+  uniform_int_distribution<int> step(-3, 3);
+  PackedFv bits;
+  bits.reserve(num_frames * 32);
+  uint32_t value = rng();
+  for (size_t i = 0; i < num_frames; ++i) {
+    value += step(rng);
+    bits.PushBits(value, 32);
+  }
+  return bits;
+}
+
+// The residuals of 'corpus' under 'transform', coded at the same symbol
+// size. A grid corpus is transformed a cycle at a time, so the transform's
+// frame must be a whole grid, and its residuals keep the grid layout.
+Corpus TransformedCorpus(const Corpus& corpus, FrameTransform transform) {
+  Corpus residuals{corpus.name + "_" + transform.name(), PackedFv(),
+                   corpus.symbol_bits, corpus.grid_rows, corpus.grid_columns};
+  if (corpus.grid_rows == 0) {
+    transform.Forward(corpus.bits, &residuals.bits);
+    return residuals;
+  }
+  PackedFv cycles;
+  for (uint32_t sample : GridSamples(corpus)) {
+    cycles.PushBits(sample, corpus.symbol_bits);
+  }
+  PackedFv cycle_residuals;
+  transform.Forward(cycles, &cycle_residuals);
+  const size_t num_positions = corpus.grid_rows * corpus.grid_columns;
+  const size_t num_cycles =
+      corpus.bits.size() / corpus.symbol_bits / num_positions;
+  for (size_t position = 0; position < num_positions; ++position) {
+    for (size_t cycle = 0; cycle < num_cycles; ++cycle) {
+      residuals.bits.PushBits(
+          cycle_residuals.PeekBits(
+              (cycle * num_positions + position) * corpus.symbol_bits,
+              corpus.symbol_bits),
+          corpus.symbol_bits);
+    }
+  }
+  return residuals;
+}
+
+vector<Corpus> LoadCorpora(const string& corpus_dir) {
+  vector<Corpus> corpora;
+  for (const string name : {"towers_12x12", "towers_16x16"}) {
+    const string filename = corpus_dir + "/" + name + ".txt";
+    try {
+      parser::TowerGrid grid = parser::ParseTowerFile(filename);
+      corpora.push_back(Corpus{name, std::move(grid.words),
+                               parser::kTowerWordBits, grid.x_dim,
+                               grid.y_dim});
+      // The fine grain bit, ECAL and HCAL of each tower, each against the
+      // same tower in the previous cycle.
+      vector<size_t> fields;
+      for (size_t tower = 0; tower < grid.x_dim * grid.y_dim; ++tower) {
+        fields.insert(fields.end(), {1, 8, 8});
+      }
+      corpora.push_back(TransformedCorpus(
+          corpora.back(),
+          FrameTransform(grid.x_dim * grid.y_dim * parser::kTowerWordBits,
+                         fields, FrameTransform::Residual::kDifference,
+                         FrameTransform::Predictor::kPreviousFrame)));
+    } catch (const runtime_error& e) {
+      cerr << "Skipping " << name << ": " << e.what() << "\n";
+    }
+  }
+  corpora.push_back(Corpus{"epim_10b_v0", EpimImage(10, 0, 1), 16});
+  corpora.push_back(Corpus{"epim_10b_v64", EpimImage(10, 64, 2), 16});
+  const size_t kSyntheticBytes = 1 << 20;
+  const size_t bus = corpora.size();
+  corpora.push_back(
+      Corpus{"bus_walk", RandomWalkBus(kSyntheticBytes / 4, 6), 16});
+  for (FrameTransform::Residual residual :
+       {FrameTransform::Residual::kXor,
+        FrameTransform::Residual::kDifference}) {
+    const FrameTransform transform(32, 32, residual,
+                                   FrameTransform::Predictor::kPreviousFrame);
+    corpora.push_back(TransformedCorpus(corpora[bus], transform));
+  }
+  corpora.push_back(
+      Corpus{"geometric_p50", GeometricBytes(kSyntheticBytes, 0.5, 3), 8});
+  corpora.push_back(
+      Corpus{"geometric_p90", GeometricBytes(kSyntheticBytes, 0.9, 4), 8});
+  corpora.push_back(
+      Corpus{"uniform", UniformBytes(kSyntheticBytes, 5), 8});
+  return corpora;
+}
+
+double EntropyBits(const Corpus& corpus) {
+  const codec::SymbolHistogram histogram = codec::ComputeSymbolHistogram(
+      VFrameView(corpus.bits, corpus.symbol_bits), corpus.symbol_bits, 0);
+  const double total = static_cast<double>(histogram.total());
+  double bits = 0.0;
+  for (const auto& symbol_count : histogram.Counts()) {
+    bits -= symbol_count.second * log2(symbol_count.second / total);
+  }
+  return bits;
+}
+
+// A "Vm..." field of /proc/self/status in kB, or -1.
+long ProcStatusKb(const string& field) {
+  ifstream status("/proc/self/status");
+  string line;
+  while (getline(status, line)) {
+    if (line.compare(0, field.size() + 1, field + ":") == 0) {
+      return strtol(line.c_str() + field.size() + 1, nullptr, 10);
+    }
+  }
+  return -1;
+}
+
+// Returns freed heap to the system and resets the peak resident set to the
+// current one, so that the peak that follows counts only new allocations.
+bool ResetPeakRss() {
+  malloc_trim(0);
+  ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.close();
+  return clear_refs.good();
+}
+
+// Runs 'fn' 'repeat' times and returns the fastest run in seconds.
+template <typename Fn>
+double BestSeconds(size_t repeat, Fn fn) {
+  double best = 0.0;
+  for (size_t i = 0; i < repeat; ++i) {
+    const auto start = chrono::steady_clock::now();
+    fn();
+    const chrono::duration<double> elapsed =
+        chrono::steady_clock::now() - start;
+    if (i == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  return best;
+}
+
+void PrintUsage(const char* program) {
+  cerr << "Usage: " << program << " [--corpus-dir <dir>] [--label <text>] "
+       << "[--out <file.csv>] [--repeat <n>]\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  string corpus_dir = "src/standalone";
+  string label = "local";
+  string out_file;
+  size_t repeat = 3;
+
+  for (int i = 1; i < argc; ++i) {
+    const string flag(argv[i]);
+    if (i + 1 >= argc) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    const char* value = argv[++i];
+    if (flag == "--corpus-dir") {
+      corpus_dir = value;
+    } else if (flag == "--label") {
+      label = value;
+    } else if (flag == "--out") {
+      out_file = value;
+    } else if (flag == "--repeat") {
+      repeat = strtoul(value, nullptr, 10);
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (repeat == 0) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  ofstream file;
+  if (!out_file.empty()) {
+    file.open(out_file);
+    if (!file.is_open()) {
+      cerr << "Could not open " << out_file << "\n";
+      return 1;
+    }
+  }
+  ostream& os = out_file.empty() ? cout : file;
+  os << "label,corpus,codec,raw_bytes,encoded_bytes,ratio,entropy_bytes,"
+     << "excess_pct,train_mbps,encode_mbps,decode_mbps,peak_mem_kb,"
+     << "roundtrip\n";
+
+  const vector<Corpus> corpora = LoadCorpora(corpus_dir);
+  bool all_ok = true;
+  for (const Corpus& corpus : corpora) {
+    const double raw_bytes = corpus.bits.size() / 8.0;
+    const double entropy_bytes = EntropyBits(corpus) / 8.0;
+    for (const unique_ptr<BenchCodec>& codec : MakeCodecs()) {
+      if (!codec->Supports(corpus)) {
+        continue;
+      }
+      cerr << "Benchmarking " << codec->name() << " on " << corpus.name
+           << "\n";
+      const bool track_memory = ResetPeakRss();
+      const long start_rss_kb = ProcStatusKb("VmRSS");
+
+      size_t encoded_bits = 0;
+      const double train_seconds =
+          BestSeconds(repeat, [&]() { codec->Train(corpus); });
+      const double encode_seconds = BestSeconds(
+          repeat, [&]() { encoded_bits = codec->Encode(corpus); });
+      const double decode_seconds =
+          BestSeconds(repeat, [&]() { codec->Decode(); });
+      const bool ok = codec->Verify(corpus);
+      all_ok = all_ok && ok;
+
+      long peak_mem_kb = -1;
+      if (track_memory && start_rss_kb >= 0) {
+        peak_mem_kb = max(0L, ProcStatusKb("VmHWM") - start_rss_kb);
+      }
+      const double encoded_bytes = encoded_bits / 8.0;
+      auto mbps = [&](double seconds) {
+        return seconds > 0.0 ? raw_bytes / seconds / 1e6 : 0.0;
+      };
+      os << label << "," << corpus.name << "," << codec->name() << ","
+         << static_cast<size_t>(raw_bytes) << ","
+         << static_cast<size_t>(ceil(encoded_bytes)) << ","
+         << (encoded_bytes > 0 ? raw_bytes / encoded_bytes : 0.0) << ","
+         << entropy_bytes << ","
+         << (entropy_bytes > 0 ?
+             100.0 * (encoded_bytes / entropy_bytes - 1.0) : 0.0) << ",";
+      if (codec->trains()) {
+        os << mbps(train_seconds);
+      }
+      os << "," << mbps(encode_seconds) << ","
+         << mbps(decode_seconds) << "," << peak_mem_kb << ","
+         << (ok ? "ok" : "FAIL") << "\n";
+    }
+  }
+  return all_ok ? 0 : 1;
+}
@@ -10,9 +10,12 @@
 
 #include "../base/four_value_logic.h"
 #include "../base/frame_fv.h"
+#include "../base/frame_view.h"
+#include "../base/packed_fv.h"
 #include "../base/queue_fv.h"
-#include "../codec/huffman.h"
-#include "../codec/lzw.h"
+#include "../base/thread_pool.h"
+#include "../codec/robdd.h"
+#include "../codec/stream_codec.h"
 
 using namespace std;
 using namespace signal_content::base;
@@ -243,8 +246,8 @@ void print_vivado_script_post(ostream& os) {
   os << "exit" << endl;
 }
 
-QueueFv get_memory_image(const Parameters& parameters) {
-  QueueFv memory;
+PackedFv get_memory_image(const Parameters& parameters) {
+  PackedFv memory;
   const int num_addr_bits = parameters.cal_bits * 2;
   assert (num_addr_bits > 0);
   const int num_contents_bits = 1 << num_addr_bits;
@@ -261,6 +264,7 @@ QueueFv get_memory_image(const Parameters& parameters) {
     segment_value = ~segment_value;
   }
 
+  memory.reserve(num_contents_bits);
   auto next_segment_end_point_it = parameters.segment_end_points.begin();
   for (int i = 0; i < num_contents_bits; ++i) {
     int ecal = i & ecal_mask;
@@ -297,98 +301,42 @@ QueueFv get_memory_image(const Parameters& parameters) {
   return memory;
 }
 
-void compress_memory_image(ofstream& os, QueueFv& image, Parameters& parameters) {
+// Writes the encoded size in bits of the image under each codec. The image is
+// read once, in chunks, and every codec works on each chunk concurrently.
+void compress_memory_image(ofstream& os, PackedFv& image, Parameters& parameters,
+                           ThreadPool* pool) {
   int segments = parameters.segment_end_points.size();
   int vetoes = parameters.ecal_vetoes.size() + parameters.ecalhcal_vetoes.size();
 
   os << segments << ", " << vetoes << ", " << image.size() << ", ";
 
-  // Compress with LZW
-  LzwCodec lzw_codec;
-  lzw_codec.PopulateDictionary(image);
-  vector<int> lzw_encoded = lzw_codec.Encode(image);
-  os << (lzw_encoded.size() * 12) << ", ";
-
-  QueueFv dead_soon = image;
-  VFrameDeque memory_vfd = ConvertToFrameDeque(std::move(dead_soon), 64);
-  HuffmanCodec huffman_codec(memory_vfd, 64, 16);
-  vector<bool> huffman_encoded = huffman_codec.Encode(memory_vfd);
-  os << huffman_encoded.size() << endl;
-}
-
-struct TreeNode {
-  TreeNode() : value(FourValueLogic::Z), is_leaf(false), left(nullptr),
-                right(nullptr) {}
-  TreeNode(FourValueLogic v, bool f, TreeNode* l, TreeNode* r)
-      : value(v), is_leaf(f), left(l), right(r) {}
-  FourValueLogic value;
-  bool is_leaf;
-  TreeNode* left;
-  TreeNode* right;
-};
-
-pair<FourValueLogic, int> get_value_cost(TreeNode* node) {
-  if (node->is_leaf) {
-    return make_pair(node->value, 1);
-  } else {
-    pair<FourValueLogic, int> left_value_cost = get_value_cost(node->left);
-    pair<FourValueLogic, int> right_value_cost = get_value_cost(node->right);
-    if (left_value_cost.first == right_value_cost.first &&
-        left_value_cost.first != FourValueLogic::X &&
-        left_value_cost.first != FourValueLogic::Z) {
-      assert(left_value_cost.second == 1 && right_value_cost.second == 1);
-      return make_pair(left_value_cost.first, 1);
-    } else {
-      return make_pair(FourValueLogic::X,
-                       left_value_cost.second + right_value_cost.second);
-    }
+  // LZW with 8-bit symbols and 9- to 16-bit codes, run-length coding of the
+  // image bit by bit, since it is mostly long constant runs, and Huffman
+  // coding of 16-bit symbols.
+  const StreamCodecRegistry& registry = StreamCodecRegistry::Global();
+  vector<unique_ptr<StreamCodec>> codecs;
+  codecs.push_back(registry.Create("lzw_stream"));
+  codecs.push_back(registry.Create("run_length"));
+  codecs.push_back(registry.Create("huffman", 16));
+  StreamFanOut fan_out(std::move(codecs), pool);
+  fan_out.Run(PackedFvChunks(image, 1 << 20));
+  const auto& results = fan_out.codecs();
+  for (size_t i = 0; i < results.size(); ++i) {
+    os << (i == 0 ? "" : ", ") << results[i]->encoded_bits();
   }
+  os << endl;
 }
 
-void compress_memory_tree(ofstream& os, QueueFv& image, Parameters& parameters) {
+// Writes the node count of the image's decision diagram, in address order and
+// after sifting the variable order.
+void compress_memory_tree(ofstream& os, PackedFv& image, Parameters& parameters) {
   int segments = parameters.segment_end_points.size();
   int vetoes = parameters.ecal_vetoes.size() + parameters.ecalhcal_vetoes.size();
 
   os << segments << ", " << vetoes << ", " << image.size() << ", ";
-  vector<bool> memory_vect;
-  while (!image.empty()) {
-    memory_vect.push_back(bool(image.front()));
-    image.pop();
-  }
-
-  vector<TreeNode*> all_nodes;
-
-  // Build tree.
-  TreeNode* root = new TreeNode();
-  vector<TreeNode*> last_level;
-  last_level.push_back(root);
-  all_nodes.push_back(root);
-  for (int i = 0; i < 20; ++i) {
-    vector<TreeNode*> next_level;
-    for (TreeNode* node : last_level) {
-      TreeNode* left = new TreeNode();
-      TreeNode* right = new TreeNode();
-      node->left = left;
-      node->right = right;
-      next_level.push_back(left);
-      next_level.push_back(right);
-      all_nodes.push_back(left);
-      all_nodes.push_back(right);
-    }
-    last_level = next_level;
-  }
-  assert(last_level.size() == (1 << 20));
-  for (int i = 0; i < (1 << 20); ++i) {
-    last_level[i]->is_leaf = true;
-    last_level[i]->value =
-        signal_content::base::FourValueLogicFromBool(memory_vect[i]);
-  }
-
-  pair<FourValueLogic, int> root_value_cost = get_value_cost(root);
-  os << root_value_cost.second << endl;
-  for (TreeNode* node : all_nodes) {
-    delete node;
-  }
+  Robdd bdd(image);
+  os << bdd.NodeCount() << ", ";
+  os << bdd.Sift() << endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -448,6 +396,7 @@ int main(int argc, char* argv[]) {
   }
 
   ofstream memory_compression_file;
+  ThreadPool pool;
   if (compress_memory) {
     stringstream ss;
     ss << memory_compression_dir << "/memory_epim_";
@@ -540,12 +489,13 @@ int main(int argc, char* argv[]) {
     }
     if (compress_memory) {
       cout << "Compressing " << num_segments << "_" << num_vetoes << endl;
-      QueueFv memory = get_memory_image(parameters);
-      compress_memory_image(memory_compression_file, memory, parameters);
+      PackedFv memory = get_memory_image(parameters);
+      compress_memory_image(memory_compression_file, memory, parameters,
+                            &pool);
     }
     if (compress_tree) {
       cout << "Compressing " << num_segments << "_" << num_vetoes << endl;
-      QueueFv memory = get_memory_image(parameters);
+      PackedFv memory = get_memory_image(parameters);
       compress_memory_tree(tree_compression_file, memory, parameters);
     }
     if (make_memory_image) {
@@ -554,7 +504,7 @@ int main(int argc, char* argv[]) {
       const string file_name_init = memory_compression_dir + "/memory_image" +
           ss.str() + "_init.txt";
       cout << "Making memory image " << file_name << endl;
-      QueueFv memory = get_memory_image(parameters);
+      PackedFv memory = get_memory_image(parameters);
       ofstream ofile(file_name);
       ofstream ofile_init(file_name_init);
       assert(ofile.is_open());
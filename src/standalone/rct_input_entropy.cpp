@@ -3,24 +3,244 @@
  *
  *  Created on: Jul 22, 2014
  *      Author: gregerso
+ *
+ * Usage:
+ *   rct_input_entropy <dir> [--context] [--rows]
+ *
+ * Reads <dir>/ecal_towers_72x56.txt and <dir>/hcal_towers_72x56.txt and
+ * prints the entropy of the ECAL and HCAL values, alone and given previous
+ * cycles of the same tower. With --context it also prints, for each
+ * calorimeter, how much of a tower's value is predictable from its previous
+ * cycle, its four neighbours in the grid and the other calorimeter's value
+ * for the same tower: the mutual information with each context and the
+ * entropy that remains given it. With --rows it also estimates the entropy of
+ * a whole eta row of a cycle taken as one word, in bounded memory.
  */
 
 #include <cassert>
+#include <cstdint>
 
 #include <algorithm>
 #include <array>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
-#include <random>
 #include <string>
+#include <vector>
 
+#include "../base/thread_pool.h"
 #include "../codec/entropy.h"
+#include "../codec/streaming_entropy.h"
 
 using namespace std;
+using signal_content::base::ThreadPool;
+using signal_content::codec::JointEntropyAccumulator;
+using signal_content::codec::ShannonEntropyAccumulator;
+using signal_content::codec::StreamingEntropyEstimator;
+
+namespace {
+
+// The grid is 72 towers in phi, which wraps around, by 56 in eta, which does
+// not.
+const int kPhiTowers = 72;
+const int kEtaTowers = 56;
+const size_t kNumTowers = kPhiTowers * kEtaTowers;
+
+// Values indexed by [phi][eta][cycle].
+typedef vector<vector<vector<int>>> TowerValues;
+
+// The ranges ForEachTowerInParallel splits the towers into on 'pool'.
+size_t NumTowerRanges(const ThreadPool& pool) {
+  return min(pool.num_threads(), kNumTowers);
+}
+
+// Calls fn(range, tower) once for every tower. The towers are split into one
+// contiguous range per thread of 'pool', each submitted as a task; 'range'
+// numbers the task, for per-task partial results.
+void ForEachTowerInParallel(ThreadPool* pool,
+                            const function<void(size_t, size_t)>& fn) {
+  const size_t num_ranges = NumTowerRanges(*pool);
+  const size_t towers_per_range = (kNumTowers + num_ranges - 1) / num_ranges;
+  for (size_t range = 0; range < num_ranges; ++range) {
+    pool->Submit([&fn, range, towers_per_range] () {
+      const size_t end = min(kNumTowers, (range + 1) * towers_per_range);
+      for (size_t tower = range * towers_per_range; tower < end; ++tower) {
+        fn(range, tower);
+      }
+    });
+  }
+  pool->Wait();
+}
+
+void PrintEntropy(const TowerValues& ecal_towers,
+                  const TowerValues& hcal_towers, ThreadPool* pool) {
+  // Each tower's cycles form one sequence, so that blocks of consecutive
+  // values never span two towers. Each range of towers has its own
+  // accumulators, which are merged at the end.
+  const size_t kMaxBlockLength = 3;
+  typedef ShannonEntropyAccumulator<int> Accumulator;
+  const size_t num_ranges = NumTowerRanges(*pool);
+  vector<Accumulator> partials_e(num_ranges, Accumulator(kMaxBlockLength));
+  vector<Accumulator> partials_h(num_ranges, Accumulator(kMaxBlockLength));
+  ForEachTowerInParallel(pool, [&] (size_t range, size_t tower) {
+    const vector<int>& e_vals =
+        ecal_towers[tower / kEtaTowers][tower % kEtaTowers];
+    const vector<int>& h_vals =
+        hcal_towers[tower / kEtaTowers][tower % kEtaTowers];
+    partials_e[range].StartNewSequence();
+    partials_e[range].AddSamples(e_vals.data(), e_vals.size());
+    partials_h[range].StartNewSequence();
+    partials_h[range].AddSamples(h_vals.data(), h_vals.size());
+  });
+  for (size_t t = 1; t < num_ranges; ++t) {
+    partials_e[0].Merge(partials_e[t]);
+    partials_h[0].Merge(partials_h[t]);
+  }
+
+  const char* names[2] = {"ECAL", "HCAL"};
+  const Accumulator* accumulators[2] = {&partials_e[0], &partials_h[0]};
+  for (int i = 0; i < 2; ++i) {
+    cout << names[i] << " entropy: " << accumulators[i]->GetEntropy()
+         << " bits.\n";
+    for (size_t length = 2; length <= kMaxBlockLength; ++length) {
+      cout << names[i] << " entropy given the previous " << (length - 1)
+           << " cycle(s): "
+           << accumulators[i]->GetConditionalEntropy(length) << " bits.\n";
+    }
+  }
+}
+
+enum Context {
+  kPreviousCycle,
+  kPhiMinus,
+  kPhiPlus,
+  kEtaMinus,
+  kEtaPlus,
+  kOtherCalorimeter,
+  kNumContexts
+};
+
+const char* kContextNames[kNumContexts] = {
+  "previous cycle", "phi - 1", "phi + 1", "eta - 1", "eta + 1",
+  "other calorimeter"
+};
+
+// One joint histogram per calorimeter and context.
+typedef array<array<JointEntropyAccumulator, kNumContexts>, 2>
+    ContextAccumulators;
+
+void PrintContextInformation(const TowerValues& ecal_towers,
+                             const TowerValues& hcal_towers,
+                             ThreadPool* pool) {
+  const TowerValues* towers[2] = {&ecal_towers, &hcal_towers};
+  const size_t num_cycles = ecal_towers[0][0].size();
+  const size_t num_ranges = NumTowerRanges(*pool);
+  vector<ContextAccumulators> partials(num_ranges);
+  ForEachTowerInParallel(pool, [&] (size_t range, size_t tower) {
+    const int phi = tower / kEtaTowers;
+    const int eta = tower % kEtaTowers;
+    const int neighbour_phi[2] = {(phi + kPhiTowers - 1) % kPhiTowers,
+                                  (phi + 1) % kPhiTowers};
+    for (int calo = 0; calo < 2; ++calo) {
+      const TowerValues& values = *towers[calo];
+      const vector<int>& own = values[phi][eta];
+      const vector<int>& other = (*towers[1 - calo])[phi][eta];
+      array<JointEntropyAccumulator, kNumContexts>& acc =
+          partials[range][calo];
+      for (size_t cycle = 0; cycle < num_cycles; ++cycle) {
+        const uint32_t x = own[cycle];
+        if (cycle > 0) {
+          acc[kPreviousCycle].Add(x, own[cycle - 1]);
+        }
+        acc[kPhiMinus].Add(x, values[neighbour_phi[0]][eta][cycle]);
+        acc[kPhiPlus].Add(x, values[neighbour_phi[1]][eta][cycle]);
+        if (eta > 0) {
+          acc[kEtaMinus].Add(x, values[phi][eta - 1][cycle]);
+        }
+        if (eta + 1 < kEtaTowers) {
+          acc[kEtaPlus].Add(x, values[phi][eta + 1][cycle]);
+        }
+        acc[kOtherCalorimeter].Add(x, other[cycle]);
+      }
+    }
+  });
+  for (size_t t = 1; t < num_ranges; ++t) {
+    for (int calo = 0; calo < 2; ++calo) {
+      for (int context = 0; context < kNumContexts; ++context) {
+        partials[0][calo][context].Merge(partials[t][calo][context]);
+      }
+    }
+  }
+
+  // Entropies are in bits per tower per cycle. The saving is the share of
+  // H(X) that a code conditioned on the context would not have to send.
+  // The formatting is restored afterwards for the reports that follow.
+  const char* names[2] = {"ECAL", "HCAL"};
+  const ios::fmtflags flags = cout.flags();
+  const streamsize precision = cout.precision();
+  cout << fixed << setprecision(4);
+  for (int calo = 0; calo < 2; ++calo) {
+    for (int context = 0; context < kNumContexts; ++context) {
+      const JointEntropyAccumulator& acc = partials[0][calo][context];
+      const double entropy = acc.EntropyX();
+      const double information = acc.MutualInformation();
+      cout << names[calo] << " given " << kContextNames[context]
+           << ": H(X) " << entropy
+           << ", H(X|context) " << acc.ConditionalEntropy()
+           << ", I(X;context) " << information
+           << ", saving " << setprecision(1)
+           << (entropy > 0 ? 100.0 * information / entropy : 0.0) << "%"
+           << setprecision(4) << " (" << acc.num_pairs()
+           << " distinct pairs)\n";
+    }
+  }
+  cout.flags(flags);
+  cout.precision(precision);
+}
+
+// Rows have too many distinct values to count exactly over a long capture,
+// so their entropy is estimated with bounds.
+void PrintRowEntropy(const TowerValues& ecal_towers,
+                     const TowerValues& hcal_towers) {
+  const TowerValues* towers[2] = {&ecal_towers, &hcal_towers};
+  const char* names[2] = {"ECAL", "HCAL"};
+  const size_t num_cycles = ecal_towers[0][0].size();
+  vector<uint64_t> row(kEtaTowers);
+  for (int calo = 0; calo < 2; ++calo) {
+    StreamingEntropyEstimator estimator;
+    for (size_t cycle = 0; cycle < num_cycles; ++cycle) {
+      for (int phi = 0; phi < kPhiTowers; ++phi) {
+        for (int eta = 0; eta < kEtaTowers; ++eta) {
+          row[eta] = (*towers[calo])[phi][eta][cycle];
+        }
+        estimator.AddWideSample(row.data(), row.size());
+      }
+    }
+    const StreamingEntropyEstimator::Estimate estimate =
+        estimator.GetEstimate();
+    cout << names[calo] << " row entropy: " << estimate.entropy
+         << " bits (bounds " << estimate.lower_bound << " to "
+         << estimate.upper_bound << ", standard error "
+         << estimate.standard_error << ", "
+         << 100.0 * estimate.head_fraction << "% in the head, about "
+         << estimate.distinct_words << " distinct rows).\n";
+  }
+}
+
+}  // namespace
 
 int main(int argc, char* argv[]) {
 
-  assert(argc == 2);
+  assert(argc >= 2);
+  bool analyze_context = false;
+  bool analyze_rows = false;
+  for (int i = 2; i < argc; ++i) {
+    const string flag = argv[i];
+    assert(flag == "--context" || flag == "--rows");
+    analyze_context |= (flag == "--context");
+    analyze_rows |= (flag == "--rows");
+  }
 
   const string ecal_in_filename = string(argv[1]) + "/ecal_towers_72x56.txt";
   const string hcal_in_filename = string(argv[1]) + "/hcal_towers_72x56.txt";
@@ -29,52 +249,47 @@ int main(int argc, char* argv[]) {
   assert(ecal_in_file.is_open());
   assert(hcal_in_file.is_open());
 
-  vector<vector<vector<int>>> ecal_towers;
-  vector<vector<vector<int>>> hcal_towers;
+  TowerValues ecal_towers;
+  TowerValues hcal_towers;
 
   // Preallocate 72x56 2D vector of vectors.
-  for (int i = 0; i < 72; i++) {
-    vector<vector<int>> row(56);
+  for (int i = 0; i < kPhiTowers; i++) {
+    vector<vector<int>> row(kEtaTowers);
     ecal_towers.push_back(row);
     hcal_towers.push_back(row);
   }
 
-  string line;
-  int ecal, hcal;
-  while (!ecal_in_file.eof() && !hcal_in_file.eof()) {
-    for (int i = 0; i < 72; ++i) {
-      for (int j = 0; j < 56; ++j) {
-        ecal_in_file >> ecal;
-        hcal_in_file >> hcal;
-        ecal_towers[i][j].push_back(ecal);
-        hcal_towers[i][j].push_back(hcal);
-      }
+  // Only whole cycles are kept; reading past the last one fails the stream.
+  vector<int> ecal_cycle(kNumTowers);
+  vector<int> hcal_cycle(kNumTowers);
+  while (true) {
+    size_t read = 0;
+    while (read < kNumTowers &&
+           ecal_in_file >> ecal_cycle[read] &&
+           hcal_in_file >> hcal_cycle[read]) {
+      ++read;
+    }
+    if (read < kNumTowers) {
+      break;
+    }
+    for (size_t tower = 0; tower < kNumTowers; ++tower) {
+      ecal_towers[tower / kEtaTowers][tower % kEtaTowers].push_back(
+          ecal_cycle[tower]);
+      hcal_towers[tower / kEtaTowers][tower % kEtaTowers].push_back(
+          hcal_cycle[tower]);
     }
   }
 
   cout << "Found " << ecal_towers[0][0].size() << " cycles.\n";
-  signal_content::codec::ShannonEntropyAccumulator<int> entropy_accumulator_e;
-  signal_content::codec::ShannonEntropyAccumulator<int> entropy_accumulator_h;
 
-  for (auto& v1 : ecal_towers) {
-    for (auto& v2 : v1) {
-      for (int e_val : v2) {
-        entropy_accumulator_e.AddSample(e_val);
-      }
-    }
+  ThreadPool pool;
+  PrintEntropy(ecal_towers, hcal_towers, &pool);
+  if (analyze_context) {
+    PrintContextInformation(ecal_towers, hcal_towers, &pool);
   }
-  for (auto& v1 : hcal_towers) {
-    for (auto& v2 : v1) {
-      for (int e_val : v2) {
-        entropy_accumulator_h.AddSample(e_val);
-      }
-    }
+  if (analyze_rows) {
+    PrintRowEntropy(ecal_towers, hcal_towers);
   }
 
-  cout << "Entropy: " << entropy_accumulator_e.GetEntropy() << " bits.\n";
-  cout << "Entropy: " << entropy_accumulator_h.GetEntropy() << " bits.\n";
-
   return 0;
 }
-
-
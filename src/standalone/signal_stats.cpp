@@ -0,0 +1,141 @@
+/*
+ * signal_stats.cpp
+ *
+ * Reports per-bit-position signal statistics (P(1), toggle rate, X/Z
+ * occurrence and the most correlated bit pairs) for a tower file or for a
+ * bit string file such as a generate_epims memory image.
+ *
+ * Usage:
+ *   signal_stats --towers <towers_XxY.txt> [options]
+ *   signal_stats --bits <memory_image.txt> --frame-size <bits> [options]
+ * Options:
+ *   --threads <n>   Worker threads; 0 (the default) uses every core.
+ *   --pairs <n>     Number of correlated bit pairs to list; 0 disables the
+ *                   pairwise statistics. Defaults to 10.
+ */
+
+#include <cstdlib>
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../base/frame_view.h"
+#include "../base/packed_fv.h"
+#include "../codec/bit_statistics.h"
+#include "../parser/bit_string_parser.h"
+#include "../parser/tower_parser.h"
+
+using namespace std;
+using namespace signal_content;
+
+namespace {
+
+void PrintUsage(const char* program) {
+  cerr << "Usage: " << program << " --towers <file> [--threads <n>] "
+       << "[--pairs <n>]\n"
+       << "       " << program << " --bits <file> --frame-size <bits> "
+       << "[--threads <n>] [--pairs <n>]\n";
+}
+
+vector<string> TowerBitNames() {
+  vector<string> names;
+  names.push_back("fg");
+  for (int bit = 7; bit >= 0; --bit) {
+    names.push_back("ecal" + to_string(bit));
+  }
+  for (int bit = 7; bit >= 0; --bit) {
+    names.push_back("hcal" + to_string(bit));
+  }
+  return names;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  string towers_file;
+  string bits_file;
+  size_t frame_size = 0;
+  size_t num_threads = 0;
+  size_t top_pairs = 10;
+
+  for (int i = 1; i < argc; ++i) {
+    const string flag(argv[i]);
+    if (i + 1 >= argc) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    const char* value = argv[++i];
+    if (flag == "--towers") {
+      towers_file = value;
+    } else if (flag == "--bits") {
+      bits_file = value;
+    } else if (flag == "--frame-size") {
+      frame_size = strtoul(value, nullptr, 10);
+    } else if (flag == "--threads") {
+      num_threads = strtoul(value, nullptr, 10);
+    } else if (flag == "--pairs") {
+      top_pairs = strtoul(value, nullptr, 10);
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (towers_file.empty() == bits_file.empty() ||
+      (!bits_file.empty() && frame_size == 0)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  try {
+    const auto start = chrono::steady_clock::now();
+    const bool pairwise = top_pairs > 0;
+    vector<string> bit_names;
+    parser::TowerGrid grid;
+    base::PackedFv bits;
+    vector<base::VFrameView> streams;
+
+    if (!towers_file.empty()) {
+      grid = parser::ParseTowerFile(towers_file);
+      cout << "Towers: " << grid.x_dim << "x" << grid.y_dim << ", "
+           << grid.num_cycles << " cycles\n";
+      // Each tower is its own stream, so toggles never cross towers.
+      for (size_t tower = 0; tower < grid.num_towers(); ++tower) {
+        streams.push_back(grid.TowerStream(tower));
+      }
+      bit_names = TowerBitNames();
+    } else {
+      bits = parser::ParseBitStringFile(bits_file);
+      const size_t usable = bits.size() - bits.size() % frame_size;
+      if (usable != bits.size()) {
+        cerr << "Ignoring " << bits.size() - usable
+             << " trailing bits that do not fill a frame.\n";
+      }
+      streams.push_back(base::VFrameView(bits, frame_size, 0, frame_size,
+                                         usable / frame_size));
+    }
+
+    const auto parsed = chrono::steady_clock::now();
+    codec::BitStatistics stats =
+        codec::ComputeBitStatistics(streams, pairwise, num_threads);
+    const auto done = chrono::steady_clock::now();
+
+    stats.PrintReport(cout, bit_names, top_pairs);
+    const double parse_seconds =
+        chrono::duration<double>(parsed - start).count();
+    const double analysis_seconds =
+        chrono::duration<double>(done - parsed).count();
+    const double megabytes =
+        double(stats.num_frames()) * stats.frame_size() / 8 / 1e6;
+    cout << "Parse time: " << parse_seconds << " s\n";
+    cout << "Analysis time: " << analysis_seconds << " s ("
+         << (analysis_seconds > 0 ? megabytes / analysis_seconds : 0.0)
+         << " MB/s)\n";
+  } catch (const exception& e) {
+    cerr << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
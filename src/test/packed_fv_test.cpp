@@ -0,0 +1,85 @@
+/*
+ * packed_fv_test.cpp
+ *
+ * Checks that PackedFv keeps X and Z when they are pushed onto a container
+ * that is empty, whether new, cleared or popped, since the codecs read their
+ * input through PackedFv, and that the word accessors reject out-of-range
+ * indices. Reports each failure on stderr and exits non-zero if any fail.
+ *
+ * Usage:
+ *   packed_fv_test
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "../base/four_value_logic.h"
+#include "../base/packed_fv.h"
+
+using namespace std;
+using namespace signal_content;
+using base::FourValueLogic;
+using base::PackedFv;
+
+namespace {
+
+const FourValueLogic kValues[] = {FourValueLogic::X, FourValueLogic::Z,
+                                  FourValueLogic::ONE, FourValueLogic::ZERO};
+const size_t kNumValues = sizeof(kValues) / sizeof(kValues[0]);
+
+bool Matches(const string& how, const PackedFv& bits) {
+  bool same = (bits.size() == kNumValues);
+  for (size_t i = 0; same && i < kNumValues; ++i) {
+    same = (bits.at(i) == kValues[i]);
+  }
+  if (!same) {
+    cerr << "PackedFv loses X/Z when " << how << "\n";
+  }
+  return same;
+}
+
+bool UnknownValuesRoundTrip() {
+  bool ok = true;
+  PackedFv bits;
+  for (FourValueLogic value : kValues) {
+    bits.push_back(value);
+  }
+  ok = Matches("pushed onto a new container", bits) && ok;
+  bits.clear();
+  bits.PushValues(kValues, kNumValues);
+  ok = Matches("pushed onto a cleared container", bits) && ok;
+  bits.pop(bits.size());
+  bits.PushValues(kValues, kNumValues);
+  ok = Matches("pushed after popping everything", bits) && ok;
+  return ok;
+}
+
+bool WordIndexChecked() {
+  PackedFv bits;
+  bits.PushValues(kValues, kNumValues);
+  bool ok = true;
+  try {
+    bits.ValueWord(bits.num_words());
+    ok = false;
+  } catch (const out_of_range&) {
+  }
+  try {
+    bits.UnknownWord(bits.num_words());
+    ok = false;
+  } catch (const out_of_range&) {
+  }
+  if (!ok) {
+    cerr << "PackedFv word accessors accept an index past num_words()\n";
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main() {
+  bool ok = UnknownValuesRoundTrip();
+  ok = WordIndexChecked() && ok;
+  cout << (ok ? "PASS" : "FAIL") << " packed_fv_test\n";
+  return ok ? 0 : 1;
+}